@@ -1,64 +1,141 @@
 /* min-vplot: Minimal motion controller for v-plotter. */
 
+#include "Arduino.h"
+
 #include "buffer.h"
+#include "planner.h"
+#include "ring.h"
+
+static ring<gc_block, BUFFER_SIZE> gc_buffer;
 
-#define BUFFER_SIZE 5
-gc_block gc_buffer[BUFFER_SIZE];
+static long end_x = 0; /* of the last block added, in units */
+static long end_y = 0;
 
-int buffer_front = 0;
-int buffer_back = 0;
+/* The last move added, from (move_x, move_y), and the blocks it is split into. */
+static gc_block move_state;
+static long move_x = 0;
+static long move_y = 0;
+static long move_dx = 0;
+static long move_dy = 0;
+static uint8_t move_blocks = 0;
+static uint8_t move_added = 0;
 
 int get_buffer_front()
 {
-  return buffer_front;
+  return gc_buffer.get_front();
 }
 
-bool get_buffer_empty()
+int get_buffer_back()
 {
-  return buffer_front == buffer_back;
+  return gc_buffer.get_back();
 }
 
-int get_next()
+int get_buffer_count()
 {
-  if (buffer_back >= BUFFER_SIZE - 1)
-    return 0;
-  else
-    return buffer_back + 1;
+  return gc_buffer.count();
+}
+
+bool get_buffer_empty()
+{
+  return gc_buffer.empty();
 }
 
 bool get_buffer_full()
 {
-  return buffer_front == get_next();
+  return gc_buffer.full();
 }
 
-gc_block buffer_advance()
+void buffer_advance()
 {
-  int current = buffer_front;
-  buffer_front++;
-  if (buffer_front >= BUFFER_SIZE)
-    buffer_front = 0;
-  return gc_buffer[current];
+  gc_buffer.pop();
 }
 
 gc_block & buffer_current()
 {
-  return gc_buffer[buffer_front];
+  return gc_buffer.front();
 }
 
 gc_block & buffer_last()
 {
-  return gc_buffer[buffer_back - 1 < 0 ? BUFFER_SIZE - 1 : buffer_back - 1];
+  /* The slot of the last block added stays intact once it is advanced past, until the ring
+   * wraps around to it, so this is also the state the buffer ended in. */
+  return gc_buffer.at(gc_buffer.get_back() - 1);
+}
+
+long get_buffer_end_x()
+{
+  return end_x;
+}
+
+long get_buffer_end_y()
+{
+  return end_y;
+}
+
+gc_block & buffer_at(int index)
+{
+  return gc_buffer.at(index);
+}
+
+int buffer_next(int index)
+{
+  return (uint8_t)(index + 1);
+}
+
+int buffer_prev(int index)
+{
+  return (uint8_t)(index - 1);
 }
 
-bool buffer_add(gc_block gc_add)
+bool buffer_add(const gc_block & gc_add, long x, long y)
 {
-  if (get_buffer_full())
+  if (gc_buffer.full() || move_added != move_blocks)
     return false;
 
-  int next = buffer_back;
-  gc_buffer[next] = gc_add;
+  move_state = gc_add;
+  move_x = end_x;
+  move_y = end_y;
+  move_dx = x - end_x;
+  move_dy = y - end_y;
 
-  buffer_back = get_next();
+  const long longest = max(abs(move_dx), abs(move_dy));
+
+  move_blocks = max((longest + BLOCK_MAX_DELTA - 1) / BLOCK_MAX_DELTA, 1L);
+  move_added = 0;
+
+  buffer_fill();
 
   return true;
 }
+
+bool buffer_fill()
+{
+  while (move_added != move_blocks)
+  {
+    if (gc_buffer.full())
+      return true;
+
+    /* Block n ends n / move_blocks along the move, so the blocks keep to its line and the last
+     * ends exactly at its end. */
+    move_added++;
+
+    const long x = move_x + move_dx * move_added / move_blocks;
+    const long y = move_y + move_dy * move_added / move_blocks;
+
+    gc_block & block = gc_buffer.back();
+    const gc_block & previous = buffer_last();
+
+    block = move_state;
+    block.dx = x - end_x;
+    block.dy = y - end_y;
+    planner_add(block, previous);
+
+    gc_buffer.push();
+    end_x = x;
+    end_y = y;
+
+    planner_recalculate();
+  }
+
+  return false;
+}
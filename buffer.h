@@ -4,17 +4,43 @@
 
 #include "gcode.h"
 
+/* Deep enough for the planner to see a few millimetres of short moves ahead; a power of two
+ * (see ring.h), and every slot holds a block. 352 bytes on the AVR. */
+#define BUFFER_SIZE 32
+
 int get_buffer_front();
+int get_buffer_back();
 
-bool get_buffer_empty();
+/* Number of blocks buffered. */
+int get_buffer_count();
 
-int get_next();
+bool get_buffer_empty();
 
 bool get_buffer_full();
 
-gc_block buffer_advance();
+/* The oldest block, and buffer_advance() to remove it once done with it. */
 gc_block & buffer_current();
+void buffer_advance();
 
+/* The last block added, or the default block before the first one. */
 gc_block & buffer_last();
 
-bool buffer_add(gc_block gc_add);
+/* Where the last block added ends, in 1 / BLOCK_UNITS_PER_MM mm. */
+long get_buffer_end_x();
+long get_buffer_end_y();
+
+/* Blocks by index, from get_buffer_front() up to (not including) get_buffer_back(); indices
+ * wrap, so step them with buffer_next() and buffer_prev(). */
+gc_block & buffer_at(int index);
+int buffer_next(int index);
+int buffer_prev(int index);
+
+/* Adds a block with the feed and pen state of gc_add moving to (x, y), in units, and re-plans
+ * the buffer (see planner.h); at the end of the buffer, the block only changes the feed or the
+ * pen. A move of more than BLOCK_MAX_DELTA along either axis is split into blocks along the same
+ * line, and those that do not fit are added by buffer_fill(). False if the buffer is full or
+ * still holding part of the last move. */
+bool buffer_add(const gc_block & gc_add, long x, long y);
+
+/* Adds the blocks left of the last move as the buffer makes room; true while some are. */
+bool buffer_fill();
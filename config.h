@@ -15,12 +15,42 @@
 
 #define STEPS_PER_MM 1.0 / (PULLEY_CIRCUMFERENCE / STEPS_PER_REVOLUTION / MICROSTEP_RESOLUTION)
 
-#define MAX_FEED_MM_PER_S 50.0
-#define INTERRUPT_PERIOD_US 50
+/* Feed is the speed of the pen. The frame protocol carries up to 127 mm/s. */
+#define MAX_FEED_MM_PER_S 120.0
+
+/* The stepper ISR is scheduled for each step and servo pulse edge (see stepper_isr): no sooner
+ * than MIN_STEP_PERIOD_US after the last, which bounds the step rate, and no later than
+ * IDLE_PERIOD_US, to pick up new segments while the motors stand still. */
+#define MIN_STEP_PERIOD_US 40
+#define IDLE_PERIOD_US 1000
+
+/* Motion planning (see planner.h): acceleration along the path, how far the pen may cut inside
+ * a corner to take it without stopping, and the time the speed is held constant for. */
+#define ACCELERATION_MM_PER_S2 1000.0
+#define JUNCTION_DEVIATION_MM 0.05
+#define SEGMENT_TIME_MS 10.0
+
+/* Split moves into segments of LINE_SEGMENT_MM to keep the motors on the straight cartesian line
+ * (see prepare_motion). Can be 0 when the sender splits moves with --segment, which keeps
+ * constant motor speeds on the line. */
+#ifndef LINE_CORRECTION
+#define LINE_CORRECTION 1
+#endif
+
+#define LINE_SEGMENT_MM 1.0
+
+/* Solve the segments' string lengths (line_kinematics) in integer steps, with an integer square
+ * root, instead of float. Off by default: both are within a step, but bench_kinematics
+ * (min-vplot-sim) estimates the integer path at about twice the AVR cycles of avr-libc's sqrt. */
+#ifndef INTEGER_KINEMATICS
+#define INTEGER_KINEMATICS 0
+#endif
 
 #define SERVO_LIFT_POSITION 90
 
-/* TODO: Interrupt period could be calculated from the maximum feed vs steps per MM. */
+/* Time for the servo to move the pen and settle, during which the motors stand still. Lifting
+ * starts with the last segment before it, as the motors slow to a stop. */
+#define PEN_SETTLE_MS 1000
 
 /* Stepper objects */
 #define ENABLE_PIN 6
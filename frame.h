@@ -0,0 +1,311 @@
+/* min-vplot: Minimal motion controller for v-plotter. */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/* Binary frame protocol, an alternative to one text line per move. This header is the one
+ * codec shared by the firmware, the sender and the host tools.
+ *
+ * After "Ready", the sender may send the text line "$B". Firmware that reads frames answers
+ * "ok" and expects frames from then on; older firmware answers "error", and the sender keeps
+ * sending text lines.
+ *
+ * Frame: FRAME_SYNC, sequence number, payload length, payload, then a CRC-16 (CCITT, high
+ * byte first) over the sequence number, length and payload.
+ *
+ * Payload: a state byte (FRAME_LIFT, and the feed in mm/s in the low bits) that applies
+ * from the start of the frame, then any number of points. Each point is the change in X
+ * and Y from the previous point in 1 / FRAME_UNITS_PER_MM mm, as two zigzag varints; a move
+ * under 0.64 mm takes one byte per axis.
+ *
+ * A good frame is answered "ok", as a text line would be (also when it repeats one that was
+ * accepted), so the sender can count bytes in flight the same way. Once a frame is damaged
+ * or out of order, or bytes do not complete one, the controller reads and discards whatever
+ * follows without answering. The sender's window fills and it stops, and after
+ * FRAME_TIMEOUT_MS without a byte, the controller answers once: "rs <n>", n being the
+ * sequence number it expects next. Nothing is in flight any more then, so the sender can
+ * send again from frame n. */
+
+#define FRAME_SYNC 0xA5
+#define FRAME_HEADER_BYTES 3 /* sync, sequence number, payload length */
+#define FRAME_CRC_BYTES 2
+#define FRAME_MAX_PAYLOAD 48 /* a whole frame fits the AVR's 64 byte serial RX buffer */
+#define FRAME_MAX_BYTES (FRAME_HEADER_BYTES + FRAME_MAX_PAYLOAD + FRAME_CRC_BYTES)
+
+#define FRAME_TIMEOUT_MS 50
+
+#define FRAME_UNITS_PER_MM 100
+
+#define FRAME_LIFT 0x80
+#define FRAME_MAX_FEED 0x7F
+
+/* CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF) update without a table. */
+inline uint16_t frame_crc_update(uint16_t crc, uint8_t data)
+{
+  crc = (uint16_t)((crc >> 8) | (crc << 8));
+  crc ^= data;
+  crc ^= (uint8_t)(crc & 0xFF) >> 4;
+  crc ^= (uint16_t)(crc << 12);
+  crc ^= (uint16_t)((crc & 0xFF) << 5);
+  return crc;
+}
+
+inline uint16_t frame_crc(const uint8_t * data, uint8_t length)
+{
+  uint16_t crc = 0xFFFF;
+
+  for (uint8_t n = 0; n < length; n++)
+    crc = frame_crc_update(crc, data[n]);
+
+  return crc;
+}
+
+/* Builds one frame in a buffer of FRAME_MAX_BYTES. */
+class frame_writer
+{
+  uint8_t * buf;
+  uint8_t length; /* bytes written, header included */
+
+  static uint8_t put_varint(uint8_t * out, int32_t value)
+  {
+    uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    uint8_t count = 0;
+
+    while (zigzag >= 0x80)
+    {
+      out[count++] = (uint8_t)(zigzag | 0x80);
+      zigzag >>= 7;
+    }
+
+    out[count++] = (uint8_t)zigzag;
+    return count;
+  }
+
+public:
+  explicit frame_writer(uint8_t * buf) : buf(buf)
+  {
+    clear();
+  }
+
+  /* Starts over with no points and the pen lifted. */
+  void clear()
+  {
+    length = FRAME_HEADER_BYTES + 1;
+    buf[FRAME_HEADER_BYTES] = FRAME_LIFT | FRAME_MAX_FEED;
+  }
+
+  bool has_points() const { return length > FRAME_HEADER_BYTES + 1; }
+
+  /* Pen and feed state from the start of the frame; feed is clamped to FRAME_MAX_FEED. */
+  void set_state(bool lift, uint8_t feed)
+  {
+    buf[FRAME_HEADER_BYTES] = (lift ? FRAME_LIFT : 0) | (feed > FRAME_MAX_FEED ? FRAME_MAX_FEED : feed);
+  }
+
+  /* Adds a point; false if it does not fit, leaving the frame as it was. */
+  bool add_point(int32_t dx, int32_t dy)
+  {
+    uint8_t encoded[10];
+    uint8_t count = put_varint(encoded, dx);
+    count += put_varint(encoded + count, dy);
+
+    if (length + count > FRAME_HEADER_BYTES + FRAME_MAX_PAYLOAD)
+      return false;
+
+    memcpy(buf + length, encoded, count);
+    length += count;
+
+    return true;
+  }
+
+  /* Completes the header and CRC; returns the frame's length in bytes. */
+  uint8_t finish(uint8_t seq)
+  {
+    buf[0] = FRAME_SYNC;
+    buf[1] = seq;
+    buf[2] = (uint8_t)(length - FRAME_HEADER_BYTES);
+
+    const uint16_t crc = frame_crc(buf + 1, (uint8_t)(length - 1));
+    buf[length++] = (uint8_t)(crc >> 8);
+    buf[length++] = (uint8_t)crc;
+
+    return length;
+  }
+};
+
+/* Reads the state and points of a received payload. */
+class frame_reader
+{
+  const uint8_t * next;
+  const uint8_t * end;
+
+  bool get_varint(int32_t & value)
+  {
+    uint32_t zigzag = 0;
+
+    for (uint8_t shift = 0; next < end && shift < 35; shift += 7)
+    {
+      const uint8_t byte = *next++;
+      zigzag |= (uint32_t)(byte & 0x7F) << shift;
+
+      if (!(byte & 0x80))
+      {
+        value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+public:
+  bool lift = true;
+  uint8_t feed = FRAME_MAX_FEED;
+
+  frame_reader() : next(0), end(0) {}
+
+  frame_reader(const uint8_t * payload, uint8_t length) : next(payload), end(payload + length)
+  {
+    if (next < end)
+    {
+      lift = *next & FRAME_LIFT;
+      feed = *next & FRAME_MAX_FEED;
+      next++;
+    }
+  }
+
+  /* The next point's change in position; false after the last one. */
+  bool next_point(int32_t & dx, int32_t & dy)
+  {
+    return get_varint(dx) && get_varint(dy);
+  }
+};
+
+/* Reassembles frames from received bytes and checks them. */
+class frame_receiver
+{
+  uint8_t buf[FRAME_MAX_BYTES];
+  uint8_t count = 0;
+  bool input = false;      /* bytes received since the last answered frame */
+  bool discarding = false; /* a frame was rejected; skip bytes until the link is idle */
+
+public:
+  enum result : uint8_t
+  {
+    incomplete,
+    accepted, /* the expected frame; its payload is valid until the next byte is added */
+    repeated, /* a frame accepted before, sent again */
+    rejected  /* from idle(): the bytes since the last answered frame did not make a good one */
+  };
+
+  uint8_t expected_seq = 0;
+
+private:
+  result discard()
+  {
+    count = 0;
+    discarding = true;
+
+    return incomplete;
+  }
+
+public:
+  result add(uint8_t byte)
+  {
+    input = true;
+
+    /* Bytes outside a frame are skipped; a damaged sync byte is caught by the next frame being
+     * out of order, or by idle() after the last one. */
+    if (discarding || (count == 0 && byte != FRAME_SYNC))
+      return incomplete;
+
+    buf[count++] = byte;
+
+    if (count == FRAME_HEADER_BYTES && buf[2] > FRAME_MAX_PAYLOAD)
+      return discard();
+
+    if (count < FRAME_HEADER_BYTES || count < buf[2] + FRAME_HEADER_BYTES + FRAME_CRC_BYTES)
+      return incomplete;
+
+    count = 0;
+
+    const uint8_t crc_at = buf[2] + FRAME_HEADER_BYTES;
+    const uint16_t crc = frame_crc(buf + 1, (uint8_t)(crc_at - 1));
+
+    if (buf[crc_at] != (uint8_t)(crc >> 8) || buf[crc_at + 1] != (uint8_t)crc)
+      return discard();
+
+    const uint8_t behind = (uint8_t)(expected_seq - buf[1]);
+
+    if (behind >= 128)
+      return discard();
+
+    input = false;
+
+    if (behind == 0)
+    {
+      expected_seq++;
+      return accepted;
+    }
+
+    return repeated;
+  }
+
+  /* Call after FRAME_TIMEOUT_MS without a byte. Rejects whatever was received since the last
+   * answered frame, as the rest of it was lost or damaged. */
+  result idle()
+  {
+    const bool had_input = input;
+
+    count = 0;
+    input = false;
+    discarding = false;
+
+    return had_input ? rejected : incomplete;
+  }
+
+  bool has_input() const { return input; }
+
+  const uint8_t * payload() const { return buf + FRAME_HEADER_BYTES; }
+  uint8_t payload_length() const { return buf[2]; }
+};
+
+/* Tells from the bytes received so far whether the next one falls between frames, where the
+ * firmware takes a STATUS_QUERY out of the input (see status.h) before frame_receiver sees it.
+ * It follows the sync and length bytes the way frame_receiver does, so the two agree as long as
+ * both are reset when the link goes idle. */
+class frame_boundary
+{
+  uint8_t left = 0;    /* bytes of the current frame still to come */
+  bool header = false; /* the length byte is among them */
+
+public:
+  bool between() const { return left == 0; }
+
+  void add(uint8_t byte)
+  {
+    if (left == 0)
+    {
+      if (byte == FRAME_SYNC)
+      {
+        left = 2;
+        header = true;
+      }
+    }
+    else if (--left == 0 && header)
+    {
+      header = false;
+
+      if (byte <= FRAME_MAX_PAYLOAD) /* else frame_receiver discards the frame */
+        left = byte + FRAME_CRC_BYTES;
+    }
+  }
+
+  void reset()
+  {
+    left = 0;
+    header = false;
+  }
+};
@@ -2,18 +2,59 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include "geo.h"
 #include "config.h"
 
-/* gcode block object; contains movement and state change data. Parsed from serial and stored in buffer. */
+/* Block coordinates are fixed point, in 1 / BLOCK_UNITS_PER_MM mm: as FRAME_UNITS_PER_MM, so a
+ * frame's points are buffered as they are, and finer than a step. */
+#define BLOCK_UNITS_PER_MM 100
+
+/* Longest move of one block along either axis, in units (327 mm); the buffer splits longer
+ * ones (see buffer_add). */
+#define BLOCK_MAX_DELTA 32767L
+
+/* Coordinates beyond this are taken as this, which keeps a move in units within a long and its
+ * split within 255 blocks. */
+#define BLOCK_MAX_COORDINATE_MM 20000.0
+
+/* Planned speeds are fixed point too, in 1 / BLOCK_SPEED_UNITS mm/s. */
+#define BLOCK_SPEED_UNITS 256
+
+/* gcode block object; contains movement and state change data. Parsed from serial and stored in
+ * buffer, packed into 11 bytes on the AVR: a move is the change in X and Y from the end of the
+ * block before, and its length and planned speeds are fixed point. */
 class gc_block
 {
 public:
-  cartesian_pt pt;
+  /* Units to the end of the move; 0 for pen and feed changes. */
+  int16_t dx = 0;
+  int16_t dy = 0;
+
+  /* One byte, as in the frame header (see frame.h). */
+  uint8_t feed : 7; /* mm/s, up to MAX_FEED_MM_PER_S */
+  uint8_t lift : 1;
 
-  int feed = MAX_FEED_MM_PER_S;
-  bool lift = true;
+  /* Set by the planner when the block is buffered: the length in units, rounded, and the
+   * speeds, rounded down so they never exceed what was planned. */
+  uint16_t length = 0;
+  uint16_t max_entry_speed = 0;
+  uint16_t entry_speed = 0;
 
-  gc_block() {}
-  gc_block(float x, float y, bool lift) : pt(x, y), lift(lift) {}
+  gc_block() : feed(MAX_FEED_MM_PER_S), lift(true) {}
+
+  bool is_move() const { return dx != 0 || dy != 0; }
+
+  /* mm */
+  float get_length() const { return length * (1.0 / BLOCK_UNITS_PER_MM); }
+
+  /* mm/s */
+  float get_max_entry_speed() const { return max_entry_speed * (1.0 / BLOCK_SPEED_UNITS); }
+  void set_max_entry_speed(float speed) { max_entry_speed = speed * BLOCK_SPEED_UNITS; }
+
+  float get_entry_speed() const { return entry_speed * (1.0 / BLOCK_SPEED_UNITS); }
+  void set_entry_speed(float speed) { entry_speed = speed * BLOCK_SPEED_UNITS; }
 };
+
+static_assert(MAX_FEED_MM_PER_S * BLOCK_SPEED_UNITS < 65536, "planned speeds must fit 16 bits");
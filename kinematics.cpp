@@ -0,0 +1,125 @@
+/* min-vplot: Minimal motion controller for v-plotter. */
+
+#include "Arduino.h"
+
+#include "kinematics.h"
+#include "config.h"
+
+plot_pos pos_from_pt(const cartesian_pt & pt)
+{
+  const float dxa = pt.x - ORIGIN_X;
+  const float dxb = pt.x + ORIGIN_X;
+
+  const float dy = pt.y - ORIGIN_Y;
+
+  return plot_pos(
+    sqrt(dxa * dxa + dy * dy),
+    sqrt(dxb * dxb + dy * dy)
+  );
+}
+
+cartesian_pt pt_from_pos(const plot_pos & pos)
+{
+  const float b_p_a_sq = pos.b * pos.b + pos.a * pos.a;
+  const float b_m_a_sq = pos.b * pos.b - pos.a * pos.a;
+
+  const float x = b_m_a_sq / (2.0 * STEPPER_DISTANCE_MM);
+  const float y = ORIGIN_Y - (1.0 / SQRT_2) *
+    sqrt(b_p_a_sq -
+      (STEPPER_DISTANCE_MM * STEPPER_DISTANCE_MM / 2.0) -
+      ((b_m_a_sq * b_m_a_sq) / (2.0 * STEPPER_DISTANCE_MM * STEPPER_DISTANCE_MM)));
+
+  return cartesian_pt(x, y);
+}
+
+#if INTEGER_KINEMATICS
+
+/* The float coefficients are converted once per move; in steps, a0_sq is below 2^35 and carries
+ * under 2^10 steps^2 of float rounding, a small fraction of a step of string length. */
+void line_kinematics::start(const cartesian_pt & from, const cartesian_pt & to, float length)
+{
+  const float dxa = (from.x - ORIGIN_X) * STEPS_PER_MM;
+  const float dxb = (from.x + ORIGIN_X) * STEPS_PER_MM;
+  const float dy = (from.y - ORIGIN_Y) * STEPS_PER_MM;
+
+  const float scale = 2.0 / length; /* 2 * unit vector of the move, per mm of it */
+  const float ux2 = (to.x - from.x) * scale;
+  const float uy2 = (to.y - from.y) * scale;
+
+  a0_sq = (int64_t)(dxa * dxa + dy * dy);
+  b0_sq = (int64_t)(dxb * dxb + dy * dy);
+
+  two_ka = (int32_t)(dxa * ux2 + dy * uy2);
+  two_kb = (int32_t)(dxb * ux2 + dy * uy2);
+}
+
+plot_pos line_kinematics::at(float x) const
+{
+  const int32_t steps = (int32_t)(x * STEPS_PER_MM + 0.5);
+
+  const int64_t a_sq = a0_sq + (int64_t)steps * (two_ka + steps);
+  const int64_t b_sq = b0_sq + (int64_t)steps * (two_kb + steps);
+
+  /* Rounding can take a string through a motor slightly below 0. The middle of the step the
+   * root falls in, so the caller's truncation to steps gives the root back. */
+  const float step_mm = 1.0 / (STEPS_PER_MM);
+
+  return plot_pos(
+    (isqrt(max(a_sq, (int64_t)0)) + 0.5f) * step_mm,
+    (isqrt(max(b_sq, (int64_t)0)) + 0.5f) * step_mm);
+}
+
+#else
+
+void line_kinematics::start(const cartesian_pt & from, const cartesian_pt & to, float length)
+{
+  const float dxa = from.x - ORIGIN_X;
+  const float dxb = from.x + ORIGIN_X;
+  const float dy = from.y - ORIGIN_Y;
+
+  const float scale = 2.0 / length; /* 2 * unit vector of the move, per mm of it */
+  const float ux2 = (to.x - from.x) * scale;
+  const float uy2 = (to.y - from.y) * scale;
+
+  a0_sq = dxa * dxa + dy * dy;
+  b0_sq = dxb * dxb + dy * dy;
+
+  two_ka = dxa * ux2 + dy * uy2;
+  two_kb = dxb * ux2 + dy * uy2;
+}
+
+plot_pos line_kinematics::at(float x) const
+{
+  /* Rounding can take a string through a motor slightly below 0. */
+  return plot_pos(
+    sqrt(max(a0_sq + x * (two_ka + x), 0.0f)),
+    sqrt(max(b0_sq + x * (two_kb + x), 0.0f)));
+}
+
+#endif
+
+uint32_t isqrt(uint64_t n)
+{
+  /* Two bits of n per iteration: the remainder stays below 2 * root + 1, so 32 bits hold it. */
+  uint32_t root = 0;
+  uint32_t remainder = 0;
+
+  n <<= 64 - 42;
+
+  for (uint8_t i = 0; i < 21; i++)
+  {
+    remainder = (remainder << 2) | (uint32_t)(n >> 62);
+    n <<= 2;
+    root <<= 1;
+
+    const uint32_t trial = 2 * root + 1;
+
+    if (remainder >= trial)
+    {
+      remainder -= trial;
+      root++;
+    }
+  }
+
+  return root;
+}
@@ -0,0 +1,50 @@
+/* min-vplot: Minimal motion controller for v-plotter. */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "geo.h"
+
+/* Inverse kinematics: string lengths at a cartesian point. */
+plot_pos pos_from_pt(const cartesian_pt & pt);
+
+/* Forward kinematics: cartesian point at string lengths.
+   Equation from: http://www.diale.org/vbot.html */
+cartesian_pt pt_from_pos(const plot_pos & pos);
+
+/* Inverse kinematics along a straight move, for the segments prepare_motion splits it into.
+ * The squared string lengths are quadratic in the distance x along the move:
+ *
+ *   a(x)^2 = a(0)^2 + x * (2 * k_a + x),  k_a = (start - motor a) . unit vector of the move
+ *
+ * so once set up for a move, a point costs two sqrts, two multiplies and four adds; interpolating
+ * the point and solving it with pos_from_pt costs the same sqrts, a divide and about a dozen
+ * multiplies and adds (see bench_kinematics in min-vplot-sim for errors and cycle counts). */
+class line_kinematics
+{
+#if INTEGER_KINEMATICS
+  /* The same coefficients in steps, for x in steps: a(x)^2 is then exact in 64 bits, and its
+   * root is taken with isqrt. */
+  int64_t a0_sq = 0;
+  int64_t b0_sq = 0;
+  int32_t two_ka = 0;
+  int32_t two_kb = 0;
+#else
+  float a0_sq = 0.0;
+  float b0_sq = 0.0;
+  float two_ka = 0.0;
+  float two_kb = 0.0;
+#endif
+
+public:
+  /* Sets up the move from from to to, length mm long (not 0). */
+  void start(const cartesian_pt & from, const cartesian_pt & to, float length);
+
+  /* String lengths x mm along the move. */
+  plot_pos at(float x) const;
+};
+
+/* Integer square root: the largest r with r * r <= n, for n below 2^42 (string lengths under
+ * 2^21 steps), one result bit per iteration. */
+uint32_t isqrt(uint64_t n);
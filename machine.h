@@ -2,11 +2,12 @@
 
 #pragma once
 
-#include <RBD_Servo.h>
-#include "dStepper.h"
+#include "stepper.h"
+#include "servo.h"
 
 #include "config.h"
 #include "geo.h"
+#include "kinematics.h"
 
 /* gcode & machine state object; contains current movement parameters and state for the plotter. */
 class machine_state
@@ -16,29 +17,44 @@ public:
 
   bool rapid = false;
 
+  /* End of the last move fully queued (pt), and of the queued segments (pos, a_steps, b_steps). */
   cartesian_pt pt;
   plot_pos pos;
 
   long a_steps = 0L;
   long b_steps = 0L;
 
+  /* Destination and step period of the segment the stepper ISR is executing. */
   long a_dest = 0L;
   long b_dest = 0L;
 
-  bool lift = true;
+  uint32_t period = 0;
 
-  dStepper motor_a;
-  dStepper motor_b;
+  bool lift = true; /* after the queued segments */
+
+  /* Set by the stepper ISR: waiting for the pen servo, and the time it waited over how many pen
+   * changes, since prepare_motion last reported them. */
+  volatile bool settling = false;
+  volatile unsigned long dwell_ms = 0UL;
+  volatile unsigned int pen_changes = 0;
+
+  /* Set by the stepper ISR since start up, for the status report, wrapping at 2^16: milliseconds
+   * with nothing to execute, and steps taken after their time. */
+  volatile uint16_t idle_ms = 0;
+  volatile uint16_t late_steps = 0;
+
+  stepper motor_a;
+  stepper motor_b;
 
   /* Servo object */
-  RBD::Servo servo;
+  servo pen_servo;
 
   machine_state() :
      pos(STEPPER_DISTANCE_MM * sqrt(2.0) / 2.0,
          STEPPER_DISTANCE_MM * sqrt(2.0) / 2.0),
-         motor_a(STEPS_PER_MM, 0, 1000000 /* us / s */ / INTERRUPT_PERIOD_US, 4, 3, ENABLE_PIN),
-         motor_b(STEPS_PER_MM, 1, 1000000 /* us / s */ / INTERRUPT_PERIOD_US, 8, 7, ENABLE_PIN),
-         servo(2 /* pin */, 1000 /* pulse_min */, 2750 /* pulse_max */)
+         motor_a(false, 4 /* step pin */, 3 /* dir pin */),
+         motor_b(true, 8 /* step pin */, 7 /* dir pin */),
+         pen_servo(2 /* pin */, 1000 /* pulse_min */, 2750 /* pulse_max */)
   {
     a_steps = STEPS_PER_MM * pos.a;
     b_steps = STEPS_PER_MM * pos.b;
@@ -47,28 +63,20 @@ public:
     b_dest = b_steps;
   }
 
+  /* The motor positions, copied with the stepper ISR off. */
   plot_pos get_current_plot_pos()
   {
-    return plot_pos(
-      motor_a.getPositionSteps() / (STEPS_PER_MM),
-      motor_b.getPositionSteps() / (STEPS_PER_MM));
+    noInterrupts();
+    const long a = motor_a.get_position();
+    const long b = motor_b.get_position();
+    interrupts();
+
+    return plot_pos(a / (STEPS_PER_MM), b / (STEPS_PER_MM));
   }
 
-  /* Forward kinematics: Calculate cartesian coordinates from current plotter position.
-     Equation from: http://www.diale.org/vbot.html */
+  /* Forward kinematics: Calculate cartesian coordinates from current plotter position. */
   cartesian_pt get_current_cartesian_location()
   {
-    const plot_pos current_pos = get_current_plot_pos();
-
-    const float b_p_a_sq = current_pos.b * current_pos.b + current_pos.a * current_pos.a;
-    const float b_m_a_sq = current_pos.b * current_pos.b - current_pos.a * current_pos.a;
-
-    const float x = b_m_a_sq / (2.0 * STEPPER_DISTANCE_MM);
-    const float y = ORIGIN_Y - (1.0 / SQRT_2) *
-      sqrt(b_p_a_sq -
-        (STEPPER_DISTANCE_MM * STEPPER_DISTANCE_MM / 2.0) -
-        ((b_m_a_sq * b_m_a_sq) / (2.0 * STEPPER_DISTANCE_MM * STEPPER_DISTANCE_MM)));
-
-    return cartesian_pt(x, y);
+    return pt_from_pos(get_current_plot_pos());
   }
 };
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cmath>
+
+#include "types.h"
+
+/* 2D affine transform: x' = xx x + xy y + x0, y' = yx x + yy y + y0.
+
+   Transforms are composed with then() into a single matrix, which is applied to the whole
+   toolpath at once (see toolpath::transform). */
+struct affine
+{
+	float xx = 1.0f, xy = 0.0f, x0 = 0.0f;
+	float yx = 0.0f, yy = 1.0f, y0 = 0.0f;
+
+	static affine translate(float dx, float dy)
+	{
+		affine m;
+		m.x0 = dx;
+		m.y0 = dy;
+		return m;
+	}
+
+	static affine scale(float sx, float sy)
+	{
+		affine m;
+		m.xx = sx;
+		m.yy = sy;
+		return m;
+	}
+
+	/* Counterclockwise about the origin. */
+	static affine rotate(float degrees)
+	{
+		const float radians = degrees * PI / 180.0f;
+		const float c = std::cos(radians), s = std::sin(radians);
+
+		affine m;
+		m.xx = c;
+		m.xy = -s;
+		m.yx = s;
+		m.yy = c;
+		return m;
+	}
+
+	/* This transform followed by next. */
+	affine then(const affine & next) const
+	{
+		affine m;
+		m.xx = next.xx * xx + next.xy * yx;
+		m.xy = next.xx * xy + next.xy * yy;
+		m.x0 = next.xx * x0 + next.xy * y0 + next.x0;
+		m.yx = next.yx * xx + next.yy * yx;
+		m.yy = next.yx * xy + next.yy * yy;
+		m.y0 = next.yx * x0 + next.yy * y0 + next.y0;
+		return m;
+	}
+
+	pos2 apply(pos2 p) const
+	{
+		return pos2(xx * p.first + xy * p.second + x0, yx * p.first + yy * p.second + y0);
+	}
+
+	/* True if x' only depends on x and y' only on y. */
+	bool axis_aligned() const { return xy == 0.0f && yx == 0.0f; }
+
+	bool identity() const
+	{
+		return axis_aligned() && xx == 1.0f && yy == 1.0f && x0 == 0.0f && y0 == 0.0f;
+	}
+};
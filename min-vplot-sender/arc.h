@@ -1,13 +1,12 @@
 #pragma once
 
-#include <functional>
-#include <list>
+#include <algorithm>
+#include <vector>
 
 #include <assert.h>
 #include <cmath>
 
 #include "types.h"
-#include "block.h"
 
 enum move_arc_dir
 {
@@ -15,60 +14,140 @@ enum move_arc_dir
 	ccw
 };
 
-std::list<block> move_arc(pos2 start, pos2 dest, pos2 dcenter, float arc_tol, move_arc_dir dir)
+/* Default maximum distance between an arc and its chords, in mm. About one motor step. */
+const float default_arc_tolerance = 0.01f;
+
+/* Points computed with the rotation recurrence between exact cos/sin corrections. */
+const int arc_correction_interval = 12;
+
+/* Angle in (0, 2 pi] an arc turns through from start_vec to dest_vec, both from its center;
+   equal vectors are a full circle. */
+float arc_sweep(vec2 start_vec, vec2 dest_vec, move_arc_dir dir)
 {
-	std::list<block> blocks;
+	/* Signed angle from start_vec to dest_vec, then taken the way the arc turns. */
+	float arc_angle = std::atan2(
+		start_vec.first * dest_vec.second - start_vec.second * dest_vec.first,
+		start_vec.first * dest_vec.first + start_vec.second * dest_vec.second);
+
+	if (dir == cw)
+		arc_angle = -arc_angle;
+
+	if (arc_angle <= 0.0f)
+		arc_angle += TWO_PI; /* also turns start == dest into a full circle */
 
+	return arc_angle;
+}
+
+/* Linearizes a G2/G3 arc from start to dest around start + dcenter, appending the end point of
+   each chord to points (the last one is dest). The number of chords is the smallest for which
+   no chord strays more than max_error from the arc (its sagitta). Start equal to dest is a full
+   circle. Returns false, appending nothing, if the arc is inconsistent. */
+bool move_arc(pos2 start, pos2 dest, pos2 dcenter, float max_error, move_arc_dir dir, std::vector<pos2> & points)
+{
 	const vec2 center{ start.first + dcenter.first, start.second + dcenter.second };
 
 	const vec2 start_vec{ -dcenter.first, -dcenter.second };
 	const vec2 dest_vec{ dest.first - center.first, dest.second - center.second };
 
-	const float start_angle = fmod(TWO_PI + atan2(start_vec.second, start_vec.first), TWO_PI);
-	const float dest_angle = fmod(TWO_PI + atan2(dest_vec.second, dest_vec.first), TWO_PI);
-
-	const float arc_angle_original = dir == ccw ? dest_angle - start_angle : start_angle - dest_angle;
-	const float arc_angle = fmod(TWO_PI + arc_angle_original, TWO_PI);
-
-	if (arc_angle < 0.0)
+	const float arc_radius = std::hypot(start_vec.first, start_vec.second);
+	const float dest_arc_radius = std::hypot(dest_vec.first, dest_vec.second);
+	if (std::abs(arc_radius - dest_arc_radius) > 0.50f)
 	{
-		assert(!"G2/3 arc angle invalid");
-		return blocks;
+		assert(!"start/destination radii different");
+		return false;
 	}
 
-	const float arc_radius = sqrt(pow(start_vec.first, 2) + pow(start_vec.second, 2));
-	const float dest_arc_radius = sqrt(pow(dest_vec.first, 2) + pow(dest_vec.second, 2));
-	if (abs(arc_radius - dest_arc_radius) > 0.50)
+	const float arc_angle = arc_sweep(start_vec, dest_vec, dir);
+
+	if (arc_radius <= max_error)
 	{
-		assert(!"start/destination radii different");
-		return blocks;
+		points.push_back(dest); /* the whole arc lies within tolerance of its center */
+		return true;
 	}
 
-	const float arc_length = arc_angle * arc_radius;
-	assert(arc_length > 0.0);
+	/* sagitta = r (1 - cos(angle / 2)) <= max_error */
+	const float max_segment_angle = 2.0f * std::acos(1.0f - max_error / arc_radius);
+	const int segments = std::max(1, static_cast<int>(std::ceil(arc_angle / max_segment_angle)));
+
+	const float segment_angle = (dir == cw ? -1.0f : 1.0f) * arc_angle / segments;
+	const float cos_t = std::cos(segment_angle);
+	const float sin_t = std::sin(segment_angle);
 
-	if (arc_length < arc_tol) /* Arc length less than arc tolerance, just move to destination. */
+	const float start_angle = std::atan2(start_vec.second, start_vec.first);
+
+	float rx = start_vec.first;
+	float ry = start_vec.second;
+
+	points.reserve(points.size() + segments);
+
+	for (int segment = 1; segment < segments; segment++)
 	{
-		blocks.push_back(block(dest, units::mm));
-		return blocks;
+		if (segment % arc_correction_interval == 0)
+		{
+			const float angle = start_angle + segment * segment_angle;
+			rx = std::cos(angle) * arc_radius;
+			ry = std::sin(angle) * arc_radius;
+		}
+		else
+		{
+			const float next_rx = rx * cos_t - ry * sin_t;
+			ry = rx * sin_t + ry * cos_t;
+			rx = next_rx;
+		}
+
+		points.emplace_back(center.first + rx, center.second + ry);
 	}
 
-	/* This is the angle corresponding to the arc tolerance. Step through the arc by this amount. */
-	const float tol_angle = arc_angle * arc_tol / arc_length;
+	points.push_back(dest);
+	return true;
+}
+
+/* Extends x and y over the arc move_arc would linearize, from its geometry alone: its end point
+   and the points where it crosses the axes through its center. The start is not added, as it is
+   the end of the move before. The chords lie inside, so the extents can be up to max_error
+   wider than those of the points move_arc appends. Returns false, extending nothing, if the arc
+   is inconsistent. */
+bool arc_extents(pos2 start, pos2 dest, pos2 dcenter, move_arc_dir dir, range & x, range & y)
+{
+	const vec2 center{ start.first + dcenter.first, start.second + dcenter.second };
+
+	const vec2 start_vec{ -dcenter.first, -dcenter.second };
+	const vec2 dest_vec{ dest.first - center.first, dest.second - center.second };
+
+	const float arc_radius = std::hypot(start_vec.first, start_vec.second);
+	if (std::abs(arc_radius - std::hypot(dest_vec.first, dest_vec.second)) > 0.50f)
+		return false;
 
-	float current_dangle = tol_angle;
-	while (current_dangle < arc_angle)
+	auto extend = [&x, &y](float px, float py)
 	{
-		const float current_angle = (dir == cw ? -1.0f : 1.0f) * current_dangle + start_angle;
+		x = range(std::min(x.first, px), std::max(x.second, px));
+		y = range(std::min(y.first, py), std::max(y.second, py));
+	};
 
-		const float move_x = cos(current_angle) * arc_radius + center.first;
-		const float move_y = sin(current_angle) * arc_radius + center.second;
+	extend(dest.first, dest.second);
 
-		blocks.push_back(block(pos2(move_x, move_y), units::mm));
+	const float arc_angle = arc_sweep(start_vec, dest_vec, dir);
+	const float start_angle = std::atan2(start_vec.second, start_vec.first);
 
-		current_dangle += tol_angle;
+	for (int quadrant = 0; quadrant < 4; quadrant++)
+	{
+		/* Angle from the start to the axis, the way the arc turns, in [0, 2 pi). */
+		float to_axis = quadrant * (PI / 2.0f) - start_angle;
+		if (dir == cw)
+			to_axis = -to_axis;
+
+		to_axis = std::fmod(to_axis, TWO_PI);
+		if (to_axis < 0.0f)
+			to_axis += TWO_PI;
+
+		if (to_axis <= arc_angle)
+		{
+			static const float axis_x[] = { 1.0f, 0.0f, -1.0f, 0.0f };
+			static const float axis_y[] = { 0.0f, 1.0f, 0.0f, -1.0f };
+
+			extend(center.first + arc_radius * axis_x[quadrant], center.second + arc_radius * axis_y[quadrant]);
+		}
 	}
 
-	blocks.push_back(block(dest, units::mm));
-	return blocks;
+	return true;
 }
@@ -0,0 +1,209 @@
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../block.h"
+
+using namespace std;
+
+/*
+ bench_block
+
+ Measures block parsing and formatting throughput (lines/second) on a synthetic NC program,
+ comparing the regex/stringstream implementation block.h used to have against the current
+ single pass tokenizer and to_chars formatter.
+
+ First checks the formatter: coordinates from 0.001 mm to 1e6 mm, both signs, must read back
+ within half a thousandth of a mm (and float rounding), in fixed notation the firmware can
+ parse; a few are compared with their expected text. Exits with 1 if one is off.
+
+ Usage: bench_block [line count, default 1000000]
+ */
+
+namespace legacy
+{
+	optional<float> parse_float(const std::string & line, char g_char)
+	{
+		auto char_idx = line.find(g_char);
+
+		if (char_idx == std::string::npos)
+			return optional<float>();
+
+		const std::regex rr = std::regex("((\\+|-)?[[:digit:]]+)(\\.(([[:digit:]]+)?))?");
+
+		std::smatch match;
+		const std::string match_str = line.substr(char_idx + 1);
+		if (std::regex_search(match_str, match, rr))
+			return std::stof(match.str(0));
+
+		return optional<float>();
+	}
+
+	optional<int> parse_int(const std::string & line, char g_char)
+	{
+		auto fres = parse_float(line, g_char);
+
+		if (fres)
+			return optional<int>(static_cast<int>(*fres));
+
+		return nullopt;
+	}
+
+	std::string format(const optional<int> & g, const optional<int> & m, const optional<float> & x, const optional<float> & y)
+	{
+		std::stringstream buf;
+		buf.precision(4);
+
+		if (g)
+			buf << "G" << *g << " ";
+
+		if (m)
+			buf << "M" << *m << " ";
+
+		if (x)
+			buf << "X" << *x << " ";
+
+		if (y)
+			buf << "Y" << *y << " ";
+
+		std::stringstream of;
+		of << buf.str();
+		return of.str();
+	}
+}
+
+vector<string> make_lines(size_t count)
+{
+	mt19937 rng(1);
+	uniform_real_distribution<float> coord(-20.0f, 20.0f);
+
+	vector<string> lines;
+	lines.reserve(count);
+
+	char buf[128];
+	for (size_t n = 0; n < count; n++)
+	{
+		const auto kind = n % 16;
+
+		if (kind == 0)
+			lines.push_back("(Start cutting path id: path328)");
+		else if (kind < 8)
+			snprintf(buf, sizeof(buf), "G01 X%.6f Y%.6f Z-1.000000", coord(rng), coord(rng)), lines.push_back(buf);
+		else
+			snprintf(buf, sizeof(buf), "G0%d X%.6f Y%.6f Z-1.000000 I%.6f J%.6f", kind % 2 ? 2 : 3,
+				coord(rng), coord(rng), coord(rng), coord(rng)), lines.push_back(buf);
+	}
+
+	return lines;
+}
+
+/* The formatted line of a G1 move to (x, y), without its trailing space. */
+string format_move(float x, float y)
+{
+	block::line_buffer buf;
+	const string_view text = block(pos2(x, y)).format(buf);
+
+	return string(text.substr(0, text.length() - 1));
+}
+
+bool check_format()
+{
+	const pair<pos2, const char *> expected[] = {
+		{ pos2(277.834f, -100.0f), "G1 X277.834 Y-100" },
+		{ pos2(12345.678f, 999.9999f), "G1 X12345.678 Y1000" },
+		{ pos2(100.5f, -0.0001f), "G1 X100.5 Y0" },
+		{ pos2(-1500.25f, 0.0f), "G1 X-1500.25 Y0" },
+	};
+
+	bool ok = true;
+
+	for (const auto & [point, text] : expected)
+	{
+		const string formatted = format_move(point.first, point.second);
+
+		if (formatted != text)
+		{
+			cout << "format: " << formatted << ", expected " << text << endl;
+			ok = false;
+		}
+	}
+
+	for (float magnitude = 0.001f; magnitude <= 1e6f; magnitude *= 1.37f)
+	{
+		for (const float value : { magnitude, -magnitude })
+		{
+			const string formatted = format_move(value, value);
+			const auto words = gcode_words::tokenize(formatted);
+			const float error = abs(words.get('X') - value);
+
+			/* Rounding to three decimals, then reading back into a float. */
+			const float allowed = 0.0005f + 2.0f * abs(value) * numeric_limits<float>::epsilon();
+
+			if (formatted.find_first_of("eE") != string::npos || !words.has('X') || error > allowed)
+			{
+				cout << "format: " << value << " -> " << formatted << ", off by " << error << " mm" << endl;
+				ok = false;
+			}
+		}
+	}
+
+	cout << "format check: " << (ok ? "ok" : "FAILED") << endl;
+
+	return ok;
+}
+
+template <typename fn>
+void measure(const char * name, size_t count, fn f)
+{
+	const auto start = chrono::steady_clock::now();
+	const size_t checksum = f();
+	const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	cout << name << ": " << static_cast<size_t>(count / elapsed.count()) << " lines/s ("
+		<< elapsed.count() << " s, checksum " << checksum << ")" << endl;
+}
+
+int main(int argc, const char * argv[])
+{
+	const size_t count = argc > 1 ? stoul(argv[1]) : 1000000;
+
+	if (!check_format())
+		return 1;
+
+	const auto lines = make_lines(count);
+
+	measure("regex parse + stringstream format", count, [&lines]
+	{
+		size_t total = 0;
+		for (const auto & line : lines)
+		{
+			const auto x = legacy::parse_float(line, 'X');
+			const auto y = legacy::parse_float(line, 'Y');
+			const auto i = legacy::parse_float(line, 'I');
+			const auto j = legacy::parse_float(line, 'J');
+
+			if (!x && !y && !i && !j)
+				total += line.size();
+			else
+				total += legacy::format(legacy::parse_int(line, 'G'), legacy::parse_int(line, 'M'), x, y).size();
+		}
+		return total;
+	});
+
+	measure("tokenize + to_chars format", count, [&lines]
+	{
+		size_t total = 0;
+		block::line_buffer buf;
+		for (const auto & line : lines)
+			total += block(line).format(buf).size();
+		return total;
+	});
+
+	return 0;
+}
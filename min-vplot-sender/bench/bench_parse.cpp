@@ -0,0 +1,100 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "../parallel_parse.h"
+#include "../mapped_file.h"
+
+using namespace std;
+
+/*
+ bench_parse
+
+ Times parsing an NC file on one thread with gcode_parser, then with parallel_parser on
+ doubling thread counts, and checks that each parallel result matches the single threaded
+ one. Then times the --stream pre-scan (parallel_parser::scan_extents) on as many threads, and
+ checks its extents cover the parsed ones and are at most the arc tolerance wider. The file should be a few MB or more for the parallel passes to have work to share;
+ smaller files are parsed on one thread.
+
+ Usage: bench_parse <nc file> [largest thread count, default one per core]
+ */
+
+bool same(const gcode_parser & a, const gcode_parser & b)
+{
+	const toolpath & pa = a.get_toolpath();
+	const toolpath & pb = b.get_toolpath();
+
+	return pa.xs == pb.xs && pa.ys == pb.ys && pa.flags == pb.flags && pa.g_codes == pb.g_codes && pa.m_codes == pb.m_codes &&
+		a.get_x_extent() == b.get_x_extent() && a.get_y_extent() == b.get_y_extent() &&
+		a.get_modal_state() == b.get_modal_state();
+}
+
+/* scanned covers parsed, and is at most the arc tolerance (and float rounding) wider. */
+bool covers(range scanned, range parsed)
+{
+	const float slack = default_arc_tolerance + 1e-3f;
+
+	return scanned.first <= parsed.first && scanned.second >= parsed.second &&
+		parsed.first - scanned.first <= slack && scanned.second - parsed.second <= slack;
+}
+
+int main(int argc, const char * argv[])
+{
+	if (argc < 2)
+	{
+		cout << "Usage: bench_parse <nc file> [largest thread count]" << endl;
+		return 1;
+	}
+
+	mapped_file nc_file;
+	if (!nc_file.open(argv[1]))
+	{
+		cout << "Input file error:" << argv[1] << endl;
+		return 1;
+	}
+
+	const unsigned largest = argc > 2 ? stoul(argv[2]) : max(thread::hardware_concurrency(), 1u);
+	const string_view text = nc_file.view();
+
+	auto start = chrono::steady_clock::now();
+
+	gcode_parser serial;
+	for (size_t offset = 0; offset < text.length();)
+	{
+		auto line_end = text.find('\n', offset);
+		if (line_end == string_view::npos)
+			line_end = text.length();
+
+		serial.add(text.substr(offset, line_end - offset));
+		offset = line_end + 1;
+	}
+
+	const chrono::duration<double> serial_elapsed = chrono::steady_clock::now() - start;
+
+	cout << text.length() << " bytes, " << serial.size() << " blocks" << endl;
+	cout << "gcode_parser: " << serial_elapsed.count() << " s" << endl;
+
+	for (unsigned threads = 1; threads <= largest; threads *= 2)
+	{
+		start = chrono::steady_clock::now();
+		const gcode_parser parsed = parallel_parser(text, default_arc_tolerance, threads).parse();
+		const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+		cout << "parallel_parser, " << threads << " threads: " << elapsed.count() << " s, "
+			<< serial_elapsed.count() / elapsed.count() << "x" << (same(serial, parsed) ? "" : ", MISMATCH") << endl;
+	}
+
+	for (unsigned threads = 1; threads <= largest; threads *= 2)
+	{
+		start = chrono::steady_clock::now();
+		const auto extents = parallel_parser(text, default_arc_tolerance, threads).scan_extents();
+		const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+		cout << "scan_extents, " << threads << " threads: " << elapsed.count() << " s, "
+			<< serial_elapsed.count() / elapsed.count() << "x"
+			<< (covers(extents.first, serial.get_x_extent()) && covers(extents.second, serial.get_y_extent()) ? "" : ", MISMATCH") << endl;
+	}
+
+	return 0;
+}
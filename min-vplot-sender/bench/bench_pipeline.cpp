@@ -0,0 +1,335 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "../parallel_parse.h"
+#include "../mapped_file.h"
+#include "../transforms.h"
+#include "../estimate.h"
+
+using namespace std;
+
+/*
+ bench_pipeline
+
+ Runs each stage of the sender's pipeline over an NC file (see tools/gen_nc for synthetic ones)
+ and reports, per stage, its throughput, the heap allocations it made and the peak resident set
+ size of the process while it ran. The output is tab separated, one line per stage, so the
+ results of two commits can be compared with diff or a spreadsheet:
+
+ - lines:          split the file into lines
+ - tokenize:       gcode_words::tokenize every line
+ - block:          construct a block from every line
+ - move_arc:       linearize every G2/G3 arc (found in an untimed pass)
+ - parse:          gcode_parser::add every line, on one thread
+ - parallel_parse: parallel_parser on the given number of threads
+ - transform:      center, scale, rotate and translate, folded into one affine transform
+ - simplify:       polyline_simplifier, 0.05 mm
+ - segment:        kinematic_segmenter, 0.05 mm
+ - format:         format every block as the text line sent
+ - estimate:       job_estimator (--dry-run), character counting
+
+ Items are lines for the first five stages, arcs for move_arc and blocks for the rest. Peak RSS
+ is reset before each stage on Linux (/proc/self/clear_refs), so it is the largest the process
+ got during the stage, including what earlier stages still hold; elsewhere it is the peak so far.
+
+ Usage: bench_pipeline <nc file> [-o <tsv file>] [--threads <n>, default one per core]
+ */
+
+static atomic<size_t> allocations{ 0 };
+static atomic<size_t> allocated_bytes{ 0 };
+
+void * operator new(size_t size)
+{
+	allocations.fetch_add(1, memory_order_relaxed);
+	allocated_bytes.fetch_add(size, memory_order_relaxed);
+
+	if (void * ptr = malloc(size))
+		return ptr;
+
+	throw bad_alloc();
+}
+
+/* Not inlined, or GCC's -Wmismatched-new-delete sees free() paired with operator new. */
+__attribute__((noinline)) void operator delete(void * ptr) noexcept
+{
+	free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void * ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+namespace
+{
+	void reset_peak_rss()
+	{
+		ofstream("/proc/self/clear_refs") << "5";
+	}
+
+	size_t peak_rss_kb()
+	{
+		ifstream status("/proc/self/status");
+
+		for (string line; getline(status, line);)
+			if (line.compare(0, 6, "VmHWM:") == 0)
+				return stoul(line.substr(6));
+
+		rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+
+#ifdef __APPLE__
+		return usage.ru_maxrss / 1024; /* bytes */
+#else
+		return usage.ru_maxrss;
+#endif
+	}
+
+	/* Measures the stages, writing a line per stage. */
+	class stage_timer
+	{
+		ostream & out;
+
+	public:
+		stage_timer(ostream & out) : out(out)
+		{
+			out << "stage\titems\tseconds\titems_per_s\tallocations\tallocated_bytes\tpeak_rss_kb\n";
+		}
+
+		/* Runs stage, which returns the number of items it processed. */
+		template <typename function>
+		void run(const char * name, function stage)
+		{
+			reset_peak_rss();
+
+			const size_t allocations_before = allocations;
+			const size_t bytes_before = allocated_bytes;
+			const auto start = chrono::steady_clock::now();
+
+			const size_t items = stage();
+
+			const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+			out << name << '\t' << items << '\t' << elapsed.count() << '\t' << static_cast<size_t>(items / elapsed.count()) << '\t'
+				<< allocations - allocations_before << '\t' << allocated_bytes - bytes_before << '\t' << peak_rss_kb() << endl;
+		}
+	};
+
+	struct arc
+	{
+		pos2 start, dest, center;
+		move_arc_dir dir;
+	};
+
+	/* The arcs of the program with their start points, as gcode_parser finds them. */
+	vector<arc> find_arcs(const vector<string_view> & lines)
+	{
+		vector<arc> arcs;
+		float scale = 1.0f, x = 0.0f, y = 0.0f;
+
+		for (const auto line : lines)
+		{
+			const auto words = gcode_words::tokenize(line);
+			const auto g = words.get_int('G');
+
+			if (g && (*g == 20 || *g == 21))
+				scale = *g == 20 ? 25.4f : 1.0f;
+
+			const float next_x = words.has('X') ? words.get('X') * scale : x;
+			const float next_y = words.has('Y') ? words.get('Y') * scale : y;
+
+			if (g && (*g == 2 || *g == 3) && words.has('X') && words.has('Y') && words.has('I') && words.has('J'))
+				arcs.push_back(arc{ pos2(x, y), pos2(next_x, next_y), pos2(words.get('I') * scale, words.get('J') * scale), *g == 2 ? cw : ccw });
+
+			x = next_x;
+			y = next_y;
+		}
+
+		return arcs;
+	}
+}
+
+int main(int argc, const char * argv[])
+{
+	if (argc < 2)
+	{
+		cout << "usage: bench_pipeline <nc file> [-o <tsv file>] [--threads <n>]" << endl;
+		return 1;
+	}
+
+	string out_path;
+	unsigned threads = max(thread::hardware_concurrency(), 1u);
+
+	for (int arg_idx = 2; arg_idx + 1 < argc; arg_idx += 2)
+	{
+		const string arg = argv[arg_idx];
+
+		if (arg == "-o")
+			out_path = argv[arg_idx + 1];
+		else if (arg == "--threads")
+			threads = max(static_cast<unsigned>(stoul(argv[arg_idx + 1])), 1u);
+		else
+		{
+			cout << "Unknown option: " << arg << endl;
+			return 1;
+		}
+	}
+
+	mapped_file nc_file;
+	if (!nc_file.open(argv[1]))
+	{
+		cout << "Input file error:" << argv[1] << endl;
+		return 1;
+	}
+
+	ofstream out_file;
+	if (!out_path.empty())
+		out_file.open(out_path);
+
+	ostream & out = out_path.empty() ? cout : out_file;
+	const string_view text = nc_file.view();
+
+	out << "# " << argv[1] << ": " << text.length() << " bytes, " << threads << " threads\n";
+
+	stage_timer timer(out);
+
+	vector<string_view> lines;
+	size_t checksum = 0; /* of results nothing else reads, so they are not optimized away */
+
+	timer.run("lines", [&]
+	{
+		for (size_t offset = 0; offset < text.length();)
+		{
+			auto line_end = text.find('\n', offset);
+			if (line_end == string_view::npos)
+				line_end = text.length();
+
+			lines.push_back(text.substr(offset, line_end - offset));
+			offset = line_end + 1;
+		}
+
+		return lines.size();
+	});
+
+	timer.run("tokenize", [&]
+	{
+		for (const auto line : lines)
+			checksum += gcode_words::tokenize(line).present;
+
+		return lines.size();
+	});
+
+	timer.run("block", [&]
+	{
+		for (const auto line : lines)
+			checksum += block(line).parsed();
+
+		return lines.size();
+	});
+
+	const vector<arc> arcs = find_arcs(lines);
+
+	timer.run("move_arc", [&]
+	{
+		vector<pos2> points;
+
+		for (const auto & a : arcs)
+		{
+			points.clear();
+			move_arc(a.start, a.dest, a.center, default_arc_tolerance, a.dir, points);
+			checksum += points.size();
+		}
+
+		return arcs.size();
+	});
+
+	gcode_parser parser;
+
+	timer.run("parse", [&]
+	{
+		for (const auto line : lines)
+			parser.add(line);
+
+		return lines.size();
+	});
+
+	timer.run("parallel_parse", [&]
+	{
+		const gcode_parser parsed = parallel_parser(text, default_arc_tolerance, threads).parse();
+		checksum += parsed.size();
+
+		return lines.size();
+	});
+
+	timer.run("transform", [&]
+	{
+		const range x_extent = parser.get_x_extent(), y_extent = parser.get_y_extent();
+
+		const affine transformation = center_x(x_extent)
+			.then(center_y(y_extent))
+			.then(scale_width(x_extent, 500.0f))
+			.then(affine::rotate(30.0f))
+			.then(affine::translate(10.0f, -20.0f));
+
+		parser.transform(transformation);
+
+		return parser.size();
+	});
+
+	timer.run("simplify", [&]
+	{
+		polyline_simplifier simplifier(0.05f);
+		parser.simplify(simplifier, pos2(0.0f, 0.0f));
+
+		return simplifier.stats.blocks;
+	});
+
+	timer.run("segment", [&]
+	{
+		kinematic_segmenter segmenter(0.05f);
+		parser.segment(segmenter, pos2(0.0f, 0.0f));
+
+		return parser.size();
+	});
+
+	const toolpath & path = parser.get_toolpath();
+
+	timer.run("format", [&]
+	{
+		block::line_buffer buf;
+
+		for (size_t idx = 0; idx < path.size(); idx++)
+			checksum += path.get(idx).format(buf).length();
+
+		return path.size();
+	});
+
+	timer.run("estimate", [&]
+	{
+		link_model link;
+		link.rx_buffer = 64;
+
+		job_estimator estimator(link);
+
+		for (size_t idx = 0; idx < path.size(); idx++)
+			estimator.add(path.get(idx));
+
+		checksum += static_cast<size_t>(estimator.finish().wall_s);
+
+		return path.size();
+	});
+
+	out << "# checksum " << checksum << endl;
+
+	return 0;
+}
@@ -0,0 +1,70 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "../reorder.h"
+
+using namespace std;
+
+/*
+ bench_reorder
+
+ Measures stroke reordering time and pen-up travel on a synthetic program of short random
+ walks scattered over a 800 x 800 mm sheet, each drawn between M4 and M3.
+
+ Usage: bench_reorder [stroke count, default 100000]
+ */
+
+toolpath make_toolpath(size_t strokes)
+{
+	mt19937 rng(1);
+	uniform_real_distribution<float> coord(-400.0f, 400.0f);
+	uniform_real_distribution<float> turn(-0.5f, 0.5f);
+	uniform_int_distribution<int> length(1, 12);
+
+	toolpath path;
+	path.add(block("M3"));
+
+	for (size_t s = 0; s < strokes; s++)
+	{
+		float x = coord(rng), y = coord(rng), angle = coord(rng);
+
+		block travel(pos2(x, y));
+		travel.g_number = 0;
+		path.add(travel);
+		path.add(block("M4"));
+
+		for (int n = length(rng); n > 0; n--)
+		{
+			angle += turn(rng);
+			x += 2.0f * cos(angle);
+			y += 2.0f * sin(angle);
+			path.add(block(pos2(x, y)));
+		}
+
+		path.add(block("M3"));
+	}
+
+	return path;
+}
+
+int main(int argc, const char * argv[])
+{
+	const size_t strokes = argc > 1 ? stoul(argv[1]) : 100000;
+
+	toolpath path = make_toolpath(strokes);
+	stroke_reorderer reorderer;
+
+	const auto start = chrono::steady_clock::now();
+	reorderer.reorder(path);
+	const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	const auto & stats = reorderer.stats;
+
+	cout << stats.strokes << " strokes (" << stats.reversed << " reversed) in " << elapsed.count() << " s" << endl;
+	cout << "pen-up travel: " << stats.travel_before << " mm -> " << stats.travel_after << " mm" << endl;
+
+	return 0;
+}
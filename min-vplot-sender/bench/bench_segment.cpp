@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "../kinematics.h"
+
+using namespace std;
+
+/*
+ bench_segment
+
+ Measures kinematic segmentation throughput, and checks the result: random G1 lines of up to
+ 500 mm within a 1200 x 1100 mm drawing area are split, then every part is sampled at constant
+ string speeds to find its largest distance from the line, which must stay within tolerance.
+
+ Usage: bench_segment [tolerance mm, default 0.05] [line count, default 100000]
+ */
+
+int main(int argc, const char * argv[])
+{
+	const float tolerance = argc > 1 ? stof(argv[1]) : 0.05f;
+	const size_t count = argc > 2 ? stoul(argv[2]) : 100000;
+
+	mt19937 rng(1);
+	uniform_real_distribution<float> x_pos(-600.0f, 600.0f);
+	uniform_real_distribution<float> y_pos(-500.0f, 600.0f);
+	uniform_real_distribution<float> length(1.0f, 500.0f);
+	uniform_real_distribution<float> angle(0.0f, 2.0f * PI);
+
+	toolpath path;
+	path.reserve(count);
+
+	for (size_t n = 0; n < count; n++)
+	{
+		const float x = x_pos(rng), y = y_pos(rng), l = length(rng), a = angle(rng);
+		path.add(block(pos2(x, y)));
+		path.add(block(pos2(clamp(x + l * cos(a), -600.0f, 600.0f), clamp(y + l * sin(a), -500.0f, 600.0f))));
+	}
+
+	kinematic_segmenter segmenter(tolerance);
+
+	const auto start = chrono::steady_clock::now();
+	segmenter.segment(path, 0, pos2(0.0f, 0.0f));
+	const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	double worst = 0.0;
+
+	for (size_t idx = 1; idx < path.size(); idx++)
+	{
+		const double px = path.xs[idx - 1], py = path.ys[idx - 1];
+		const double qx = path.xs[idx], qy = path.ys[idx];
+		const double l = hypot(qx - px, qy - py);
+
+		const auto [pa, pb] = vplotter::lengths(px, py);
+		const auto [qa, qb] = vplotter::lengths(qx, qy);
+
+		for (int k = 1; k < 32 && l > 0.0; k++)
+		{
+			const double t = k / 32.0;
+			const auto [mx, my] = vplotter::point(pa + t * (qa - pa), pb + t * (qb - pb));
+			worst = max(worst, abs((qx - px) * (my - py) - (qy - py) * (mx - px)) / l);
+		}
+	}
+
+	const auto & stats = segmenter.stats;
+
+	cout << stats.moves << " moves, " << stats.split << " split, " << stats.added << " blocks added: "
+		<< elapsed.count() << " s, " << elapsed.count() * 1e9 / stats.added << " ns/block added" << endl;
+	cout << "largest deviation: " << worst << " mm (tolerance " << tolerance << " mm)" << endl;
+
+	return worst <= tolerance ? 0 : 1;
+}
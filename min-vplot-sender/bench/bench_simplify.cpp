@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "../simplify.h"
+
+using namespace std;
+
+/*
+ bench_simplify
+
+ Measures polyline simplification throughput on synthetic toolpaths of doubling size, to
+ check that the cost stays linear in the number of points. Each toolpath is a pen-down G1
+ run along a noisy spiral of 0.05 mm steps, broken every few thousand points by a G0 travel
+ and an M3/M4 pen change.
+
+ Usage: bench_simplify [tolerance mm, default 0.05] [largest point count, default 4000000]
+ */
+
+toolpath make_toolpath(size_t count)
+{
+	mt19937 rng(1);
+	uniform_real_distribution<float> noise(-0.01f, 0.01f);
+	uniform_int_distribution<size_t> run_length(100, 5000);
+
+	toolpath path;
+	path.reserve(count + count / 100);
+
+	double angle = 0.0;
+	size_t run_left = 0;
+
+	for (size_t n = 0; n < count; n++)
+	{
+		const double radius = 10.0 + 0.0005 * n;
+		const float x = static_cast<float>(radius * cos(angle)) + noise(rng);
+		const float y = static_cast<float>(radius * sin(angle)) + noise(rng);
+
+		angle += 0.05 / radius;
+
+		block b(pos2(x, y));
+
+		if (run_left == 0)
+		{
+			path.add(block("M3"));
+
+			b.g_number = 0;
+			path.add(b);
+
+			path.add(block("M4"));
+
+			run_left = run_length(rng);
+			continue;
+		}
+
+		path.add(b);
+		run_left--;
+	}
+
+	return path;
+}
+
+int main(int argc, const char * argv[])
+{
+	const float tolerance = argc > 1 ? stof(argv[1]) : 0.05f;
+	const size_t largest = argc > 2 ? stoul(argv[2]) : 4000000;
+
+	for (size_t count = largest / 8; count <= largest; count *= 2)
+	{
+		toolpath path = make_toolpath(count);
+		polyline_simplifier simplifier(tolerance);
+
+		const auto start = chrono::steady_clock::now();
+		simplifier.simplify(path, 0, pos2(0.0f, 0.0f));
+		const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+		cout << simplifier.stats.blocks << " blocks -> " << path.size() << ": "
+			<< elapsed.count() << " s, " << elapsed.count() * 1e9 / simplifier.stats.blocks << " ns/block" << endl;
+	}
+
+	return 0;
+}
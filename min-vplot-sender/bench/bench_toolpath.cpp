@@ -0,0 +1,118 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../parse.h"
+
+using namespace std;
+
+/*
+ bench_toolpath
+
+ Compares the heap memory needed to hold a parsed program as a std::list<block>, as the
+ parser used to, against the columnar toolpath store. The input file is repeated to scale
+ it up.
+
+ Usage: bench_toolpath <nc file> [repeat count, default 1000]
+ */
+
+static size_t allocated_bytes = 0;
+
+void * operator new(size_t size)
+{
+	allocated_bytes += size;
+
+	if (void * ptr = malloc(size))
+		return ptr;
+
+	throw bad_alloc();
+}
+
+void operator delete(void * ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void * ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+int main(int argc, const char * argv[])
+{
+	if (argc < 2)
+	{
+		cout << "usage: bench_toolpath <nc file> [repeat count]" << endl;
+		return 1;
+	}
+
+	ifstream file(argv[1]);
+	vector<string> lines;
+	for (string line; getline(file, line);)
+		lines.push_back(line);
+
+	const size_t repeat = argc > 2 ? stoul(argv[2]) : 1000;
+
+	/* Parse with gcode_parser (arc expansion, units) once per repetition, and copy its blocks
+	   into the list as the parser used to store them. */
+	size_t block_count = 0;
+	size_t list_bytes = 0;
+	size_t toolpath_bytes = 0;
+	{
+		list<block> blocks;
+
+		const size_t before = allocated_bytes;
+
+		for (size_t n = 0; n < repeat; n++)
+		{
+			gcode_parser parser;
+			for (const auto & line : lines)
+			{
+				parser.add(line);
+
+				/* The list kept each block's source text; arc segments had none. */
+				const bool single = parser.size() == 1;
+
+				for (; !parser.empty(); parser.pop_front())
+				{
+					block b = parser.front();
+					b.line = single ? line : string();
+					blocks.push_back(b);
+				}
+			}
+		}
+
+		list_bytes = allocated_bytes - before;
+		block_count = blocks.size();
+	}
+
+	{
+		const size_t before = allocated_bytes;
+
+		gcode_parser parser;
+		for (size_t n = 0; n < repeat; n++)
+		{
+			for (const auto & line : lines)
+				parser.add(line);
+
+			auto state = parser.get_modal_state();
+			state.unit = units::unknown; /* each repeat starts in the file's initial unit mode */
+			parser.set_modal_state(state);
+		}
+
+		toolpath_bytes = parser.get_toolpath().memory_usage();
+
+		cout << "blocks: " << block_count << " / " << parser.size() << endl;
+		cout << "allocated while parsing into toolpath: " << allocated_bytes - before << " bytes" << endl;
+	}
+
+	cout << "std::list<block>: " << list_bytes << " bytes, " << list_bytes / block_count << " bytes/block" << endl;
+	cout << "toolpath: " << toolpath_bytes << " bytes, " << toolpath_bytes / block_count << " bytes/block" << endl;
+	cout << "reduction: " << static_cast<double>(list_bytes) / toolpath_bytes << "x" << endl;
+
+	return 0;
+}
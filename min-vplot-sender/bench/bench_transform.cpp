@@ -0,0 +1,126 @@
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <random>
+#include <string>
+
+#include "../toolpath.h"
+#include "../transforms.h"
+
+using namespace std;
+
+/*
+ bench_transform
+
+ Compares applying center + scale + rotate to every block through a list of std::function
+ block transformers, as the sender used to for each block sent, against one folded affine
+ matrix applied to the toolpath's coordinate columns.
+
+ Usage: bench_transform [block count, default 1000000]
+ */
+
+namespace legacy
+{
+	block::transformer translate(float dx, float dy)
+	{
+		return [dx, dy](block b)
+		{
+			if (b.x)
+				b.x = *b.x + dx;
+
+			if (b.y)
+				b.y = *b.y + dy;
+
+			return b;
+		};
+	}
+
+	block::transformer scale(float factor)
+	{
+		return [factor](block b)
+		{
+			if (b.x)
+				b.x = *b.x * factor;
+
+			if (b.y)
+				b.y = *b.y * factor;
+
+			return b;
+		};
+	}
+
+	block::transformer rotate(float degrees)
+	{
+		const affine m = affine::rotate(degrees);
+
+		return [m](block b)
+		{
+			const pos2 p = m.apply(pos2(b.x ? *b.x : 0.0f, b.y ? *b.y : 0.0f));
+			b.x = p.first;
+			b.y = p.second;
+			return b;
+		};
+	}
+
+	block::transformer composite(std::list<block::transformer> & transforms)
+	{
+		return [transforms](block b)
+		{
+			block tb = b;
+			for (auto t : transforms)
+				tb = t(tb);
+			return tb;
+		};
+	}
+}
+
+template <typename fn>
+void measure(const char * name, size_t count, fn f)
+{
+	const auto start = chrono::steady_clock::now();
+	const double checksum = f();
+	const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+	cout << name << ": " << elapsed.count() * 1e9 / count << " ns/block (" << elapsed.count()
+		<< " s, checksum " << checksum << ")" << endl;
+}
+
+int main(int argc, const char * argv[])
+{
+	const size_t count = argc > 1 ? stoul(argv[1]) : 1000000;
+
+	mt19937 rng(1);
+	uniform_real_distribution<float> coord(0.0f, 500.0f);
+
+	toolpath path;
+	path.reserve(count);
+	for (size_t n = 0; n < count; n++)
+		path.add(block(pos2(coord(rng), coord(rng))));
+
+	measure("std::function chain per block", count, [&]
+	{
+		list<block::transformer> transforms{ legacy::translate(-250.0f, -250.0f), legacy::scale(0.6f), legacy::rotate(30.0f) };
+		const block::transformer all_transforms(legacy::composite(transforms));
+
+		double sum = 0.0;
+		for (size_t idx = 0; idx < path.size(); idx++)
+		{
+			const block b = path.get(idx).transform(all_transforms);
+			sum += *b.x + *b.y;
+		}
+		return sum;
+	});
+
+	measure("folded affine over the columns", count, [&]
+	{
+		const affine m = affine::translate(-250.0f, -250.0f).then(affine::scale(0.6f, 0.6f)).then(affine::rotate(30.0f));
+		path.transform(m);
+
+		double sum = 0.0;
+		for (size_t idx = 0; idx < path.size(); idx++)
+			sum += path.xs[idx] + path.ys[idx];
+		return sum;
+	});
+
+	return 0;
+}
@@ -1,10 +1,15 @@
 #pragma once
 
+#include <array>
+#include <charconv>
+#include <functional>
 #include <string>
+#include <string_view>
 #include <ostream>
-#include <sstream>
+#include <type_traits>
 
 #include "types.h"
+#include "words.h"
 
 struct block;
 std::ostream & operator<<(std::ostream & of, const block & b);
@@ -17,8 +22,6 @@ struct block
 
 	units unit = units::unknown;
 
-	static units new_block_unit;
-
 	optional<int> g_number;
 	optional<int> m_number;
 
@@ -34,15 +37,17 @@ struct block
 		unit = units::mm;
 	}
 
-	block(std::string _line)
+	/* Coordinates are converted to mm from line_unit, the G20/G21 mode the line is read in. */
+	block(std::string_view _line, units line_unit = units::unknown) : block(_line, gcode_words::tokenize(_line), line_unit) {}
+
+	block(std::string_view _line, const gcode_words & words, units line_unit = units::unknown) : line(_line)
 	{
-		line = _line;
-		unit = new_block_unit;
+		unit = line_unit;
 
-		x = parse_float(line, 'X');
-		y = parse_float(line, 'Y');
-		i = parse_float(line, 'I');
-		j = parse_float(line, 'J');
+		x = words.get_float('X');
+		y = words.get_float('Y');
+		i = words.get_float('I');
+		j = words.get_float('J');
 
 		if (x)
 			x = get_converted(*x);
@@ -58,8 +63,8 @@ struct block
 
 		unit = units::mm;
 
-		g_number = parse_int(line, 'G');
-		m_number = parse_int(line, 'M');
+		g_number = words.get_int('G');
+		m_number = words.get_int('M');
 	}
 
 	bool parsed() const
@@ -80,68 +85,118 @@ struct block
 		return value;
 	}
 
-	operator std::string() const
-	{
-		std::stringstream buf;
-		buf << *this;
+	/* Outbound text buffer; large enough for "G<int> M<int> X<float> Y<float> " with the
+	   coordinates in fixed notation, whatever their magnitude. */
+	using line_buffer = std::array<char, 128>;
 
-		return buf.str();
-	}
+	/* Decimals of the coordinates sent as text: 0.001 mm, finer than the frames' 1 /
+	   FRAME_UNITS_PER_MM and than the arc, simplify and segment tolerances. */
+	static constexpr int coordinate_decimals = 3;
 
-	static optional<float> parse_float(const std::string & line, char g_char)
+	/* A line passed through without its "(...)" and ";" comments and trailing spaces, copied to
+	   buf if it had any; the whole line if the rest does not fit buf, as it is then too long for
+	   the controller's RX buffer anyway. */
+	static std::string_view strip_comments(std::string_view line, line_buffer & buf)
 	{
-		auto char_idx = line.find(g_char);
+		if (line.find_first_of("(;") == std::string_view::npos)
+			return line;
+
+		size_t length = 0;
+		bool comment = false;
+
+		for (const char c : line)
+		{
+			if (comment)
+			{
+				comment = c != ')';
+				continue;
+			}
 
-		if (char_idx == std::string::npos)
-			return optional<float>();
+			if (c == ';')
+				break;
 
-		const std::regex rr = std::regex("((\\+|-)?[[:digit:]]+)(\\.(([[:digit:]]+)?))?");
+			if (c == '(')
+			{
+				comment = true;
+				continue;
+			}
 
-		std::smatch match;
-		const std::string match_str = line.substr(char_idx + 1);
-		if (std::regex_search(match_str, match, rr))
-			return std::stof(match.str(0));
+			if (length == buf.size())
+				return line;
 
-		return optional<float>();
+			buf[length++] = c;
+		}
+
+		while (length > 0 && buf[length - 1] == ' ')
+			length--;
+
+		return std::string_view(buf.data(), length);
 	}
 
-	static optional<int> parse_int(const std::string & line, char g_char)
+	/* Formats this block for sending without allocating. The result points into buf, or into
+	   line for blocks that are passed through unparsed, and is valid until either changes. */
+	std::string_view format(line_buffer & buf) const
 	{
-		auto fres = parse_float(line, g_char);
+		if (!parsed())
+			return strip_comments(line, buf);
 
-		if (fres)
-			return optional<int>(static_cast<int>(*fres));
+		char * ptr = buf.data();
+		char * const end = ptr + buf.size();
 
-		return nullopt;
-	}
-};
+		auto put_word = [&ptr, end](char letter, auto value)
+		{
+			*ptr++ = letter;
 
-std::ostream & operator<<(std::ostream & of, const block & b)
-{
-	std::stringstream buf;
-	buf.precision(4);
+			if constexpr (std::is_floating_point_v<decltype(value)>)
+			{
+				/* Fixed notation, as the firmware reads no exponent, without trailing zeros. */
+				char * const number = ptr;
+				ptr = std::to_chars(ptr, end, value, std::chars_format::fixed, coordinate_decimals).ptr;
 
-	if (!b.parsed())
-	{
-		of << b.line;
-		return of;
-	}
+				while (ptr[-1] == '0')
+					ptr--;
+
+				if (ptr[-1] == '.')
+					ptr--;
 
-	if (b.g_number)
-		buf << "G" << *b.g_number << " ";
+				if (ptr - number == 2 && number[0] == '-' && number[1] == '0')
+				{
+					number[0] = '0'; /* -0.0001 */
+					ptr = number + 1;
+				}
+			}
+			else
+			{
+				ptr = std::to_chars(ptr, end, value).ptr;
+			}
 
-	if (b.m_number)
-		buf << "M" << *b.m_number << " ";
+			*ptr++ = ' ';
+		};
 
-	if (b.x)
-		buf << "X" << *b.x << " ";
+		if (g_number)
+			put_word('G', *g_number);
 
-	if (b.y)
-		buf << "Y" << *b.y << " ";
+		if (m_number)
+			put_word('M', *m_number);
+
+		if (x)
+			put_word('X', *x);
 
-	of << buf.str();
-	return of;
+		if (y)
+			put_word('Y', *y);
+
+		return std::string_view(buf.data(), ptr - buf.data());
+	}
+
+	operator std::string() const
+	{
+		line_buffer buf;
+		return std::string(format(buf));
+	}
 };
 
-// static
-units block::new_block_unit = units::unknown;
+std::ostream & operator<<(std::ostream & of, const block & b)
+{
+	block::line_buffer buf;
+	return of << b.format(buf);
+}
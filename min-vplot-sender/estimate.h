@@ -0,0 +1,467 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+#include "types.h"
+#include "block.h"
+#include "words.h"
+#include "frame_encoder.h"
+#include "kinematics.h"
+
+#include "../config.h"
+#include "../buffer.h"
+
+/* Serial link and flow control the job is estimated for. */
+struct link_model
+{
+	double baud = 115200.0;  /* as the serial ports are opened */
+	double latency_s = 0.001; /* from the controller's "ok" to the host sending again (USB adapter) */
+	size_t rx_buffer = 0;     /* character counting with this controller RX buffer; ping-pong if 0 */
+	bool binary = false;      /* binary frames instead of text lines */
+};
+
+/* Predicted job, from job_estimator. */
+struct job_estimate
+{
+	size_t blocks = 0;
+	size_t moves = 0;         /* blocks with a length */
+	size_t pen_changes = 0;
+	size_t lifts = 0;         /* of these, lifting the pen */
+
+	double pen_down_mm = 0.0;
+	double pen_up_mm = 0.0;
+
+	double wall_s = 0.0;      /* from the first byte sent to the end of the last move */
+	double moving_s = 0.0;
+	double dwell_s = 0.0;     /* waiting for the pen servo */
+	double starved_s = 0.0;   /* waiting for blocks from the serial link */
+	double transmit_s = 0.0;
+
+	size_t bytes = 0;         /* sent, responses excluded */
+	size_t transmit_bound = 0; /* blocks whose transmit time exceeds their execution time */
+
+	double peak_steps_per_s = 0.0; /* of the faster motor, at the top speed of a move */
+
+	/* Moves by length: below 0.1, 0.5, 1, 5, 10 and 50 mm, and longer. */
+	static constexpr std::array<double, 6> length_bins = { 0.1, 0.5, 1.0, 5.0, 10.0, 50.0 };
+	std::array<size_t, length_bins.size() + 1> length_counts{};
+};
+
+std::ostream & operator<<(std::ostream & of, const job_estimate & e)
+{
+	const double transmit_bound = e.blocks ? 100.0 * e.transmit_bound / e.blocks : 0.0;
+
+	const auto flags = of.flags();
+	const auto precision = of.precision();
+	of << std::fixed << std::setprecision(1);
+
+	of << "Dry run: " << e.blocks << " blocks, " << e.moves << " moves, " << e.pen_changes << " pen changes ("
+		<< e.lifts << " lifts)\n"
+		<< "  predicted time   " << e.wall_s << " s: " << e.moving_s << " s moving, " << e.dwell_s << " s pen dwell, "
+		<< e.starved_s << " s waiting for serial\n"
+		<< "  distance         " << e.pen_down_mm << " mm pen down, " << e.pen_up_mm << " mm pen up\n"
+		<< "  serial           " << e.bytes << " bytes, " << e.transmit_s << " s to send; " << transmit_bound
+		<< "% of blocks take longer to send than to execute\n"
+		<< "  peak step rate   " << std::lround(e.peak_steps_per_s) << " steps/s (at most " << 1000000 / MIN_STEP_PERIOD_US << ")\n"
+		<< "  move lengths (mm):";
+
+	of.flags(flags);
+	of.precision(precision);
+
+	for (size_t bin = 0; bin < e.length_counts.size(); bin++)
+	{
+		if (bin < e.length_bins.size())
+			of << "  <" << e.length_bins[bin] << ": " << e.length_counts[bin];
+		else
+			of << "  >=" << e.length_bins.back() << ": " << e.length_counts[bin];
+	}
+
+	return of;
+}
+
+/* Predicts how long the controller takes over a job, and whether the serial link keeps up, from
+   the blocks as they would be sent. The firmware's handling is followed block by block:
+
+   - the pen and feed state follow the same words as frame_encoder; feed is clamped to 0 to
+     MAX_FEED_MM_PER_S as the firmware takes it, and a pen change stops the machine for
+     PEN_SETTLE_MS,
+   - a feed under min_speed (F0 included) is planned at min_speed: the firmware's segments are
+     at least ACCELERATION_MM_PER_S2 * SEGMENT_TIME_MS^2 long and take at most twice
+     SEGMENT_TIME_MS, so it never moves slower than that,
+   - moves get trapezoidal profiles at ACCELERATION_MM_PER_S2 and corner speeds from
+     JUNCTION_DEVIATION_MM, as planner_add gives them, and each one is planned with the blocks
+     after it in the buffer (up to BUFFER_SIZE), stopping at the last, as planner_recalculate,
+   - lines (or frames) are sent at the baud rate as send_blocks does: with ping-pong flow
+     control once the one before is answered, with character counting once the answers leave
+     room for them in the RX buffer; an answer ("ok") comes back at the baud rate, plus the
+     adapter latency, once the controller has read all of the line,
+   - a move of more than BLOCK_MAX_DELTA along either axis takes as many blocks along its line
+     as buffer_add splits it into,
+   - the controller reads a block once it has all of its line, and the block BUFFER_SIZE
+     before it has started, and starts it once the one before it is done.
+
+   A move is planned with the blocks read by the time it ends, which may be fewer than the buffer
+   holds: a link falling behind shows as slower moves, and as waits once the buffer runs empty.
+   The time to send a line or frame, shared by its blocks, is compared with the time they take
+   to execute. */
+class job_estimator
+{
+	/* A block waiting for the blocks after it to be planned. */
+	struct planned
+	{
+		float length = 0.0f;
+		float feed = 0.0f;
+		float max_entry_speed = 0.0f;
+		float string_rate = 0.0f; /* of the faster motor, per mm of the move */
+		bool pen_change = false;
+		bool lift = false;
+
+		/* Its line or frame: the bytes on its first block, the end on its last (a line with a
+		   pen change and a move makes two blocks, a frame many); known once it is complete. */
+		bool costed = false;
+		size_t bytes = 0;
+		bool last = false;
+		double transmit_s = 0.0;  /* share of the time to send it */
+
+		double read_s = 0.0;      /* into the buffer, once the blocks before it have been */
+	};
+
+	static constexpr size_t lookahead = BUFFER_SIZE;
+	static constexpr double acceleration = ACCELERATION_MM_PER_S2;
+	static constexpr float min_speed = ACCELERATION_MM_PER_S2 * SEGMENT_TIME_MS / 1000.0 / 2.0;
+
+	link_model link;
+
+	std::deque<planned> pending;
+
+	/* Machine state after the blocks added, as the firmware would have it. */
+	double x = 0.0, y = 0.0;
+	bool lift = true;
+	float feed = MAX_FEED_MM_PER_S;
+	double unit_x = 0.0, unit_y = 0.0; /* direction of the last move */
+	float previous_feed = 0.0f;        /* 0 after a pen change */
+
+	frame_encoder encoder;
+	size_t uncosted = 0; /* blocks at the end of pending in the current line or frame */
+
+	/* Serial link and controller input: when each line or frame is sent and answered, and each
+	   block read into the buffer. */
+	struct link_state
+	{
+		double line_free_s = 0.0; /* the last line or frame is sent */
+		std::deque<std::pair<size_t, double>> in_flight; /* bytes and answer time of those unanswered */
+		size_t in_flight_bytes = 0;
+		double read_s = 0.0;      /* the last block was read */
+
+		/* Time b is read, once room_s has made room for it in the buffer. */
+		double read(const planned & b, double room_s, const link_model & link)
+		{
+			const double byte_s = 10.0 / link.baud;
+
+			if (b.bytes)
+			{
+				/* Sent after the one before, once answers make room for it, as send_blocks. */
+				double send_s = line_free_s;
+
+				while (!in_flight.empty() && (!link.rx_buffer || in_flight_bytes + b.bytes > link.rx_buffer))
+				{
+					send_s = std::max(send_s, in_flight.front().second);
+					in_flight_bytes -= in_flight.front().first;
+					in_flight.pop_front();
+				}
+
+				line_free_s = send_s + b.bytes * byte_s;
+
+				in_flight.emplace_back(b.bytes, 0.0);
+				in_flight_bytes += b.bytes;
+			}
+
+			read_s = std::max({ read_s, line_free_s, room_s });
+
+			if (b.last)
+				in_flight.back().second = read_s + 4 /* "ok\r\n" */ * byte_s + link.latency_s;
+
+			return read_s;
+		}
+	};
+
+	link_state input;
+	size_t read_ahead = 0; /* pending blocks read */
+
+	/* Timeline of the blocks executed so far. */
+	double speed = 0.0;
+	double done_s = 0.0;                    /* the last block is done */
+	std::array<double, lookahead> starts{}; /* start times of the last lookahead blocks */
+	size_t executed = 0;
+
+	job_estimate estimate;
+
+	static double reachable_speed(double v, double distance)
+	{
+		return std::sqrt(v * v + 2.0 * acceleration * distance);
+	}
+
+	/* Ends the line or frame of the blocks not yet costed, bytes long. Sending it takes a round
+	   trip with ping-pong flow control, only the bytes with character counting. */
+	void end_message(size_t bytes)
+	{
+		if (!uncosted)
+			return;
+
+		const double byte_s = 10.0 / link.baud;
+		const double round_trip_s = link.rx_buffer ? bytes * byte_s : (bytes + 4) * byte_s + link.latency_s;
+
+		for (size_t idx = pending.size() - uncosted; idx < pending.size(); idx++)
+		{
+			pending[idx].transmit_s = round_trip_s / uncosted;
+			pending[idx].costed = true;
+		}
+
+		pending[pending.size() - uncosted].bytes = bytes;
+		pending.back().last = true;
+
+		estimate.bytes += bytes;
+		uncosted = 0;
+	}
+
+	/* Time the buffer has room for the block count after the oldest pending one (less than
+	   lookahead): the start of the block lookahead before it. */
+	double start_of(size_t count) const
+	{
+		return executed + count >= lookahead ? starts[(executed + count) % lookahead] : 0.0;
+	}
+
+	/* Time to execute the oldest pending block, with the depth blocks after it in the buffer;
+	   sets the speed it ends at and its top speed. */
+	double profile(size_t depth, double & exit_speed, double & peak) const
+	{
+		const planned & b = pending.front();
+
+		/* Backward over the buffer from a stop at its end, as planner_recalculate. */
+		double next_entry = 0.0;
+		for (size_t idx = depth; idx > 0; idx--)
+			next_entry = std::min<double>(pending[idx].max_entry_speed, reachable_speed(next_entry, pending[idx].length));
+
+		const double v0 = std::min<double>(speed, b.feed);
+		const double v1 = std::min({ next_entry, reachable_speed(v0, b.length), double(b.feed) });
+
+		peak = std::min<double>(b.feed, std::sqrt(acceleration * b.length + 0.5 * (v0 * v0 + v1 * v1)));
+		exit_speed = v1;
+
+		const double accelerate_mm = (peak * peak - v0 * v0) / (2.0 * acceleration);
+		const double decelerate_mm = (peak * peak - v1 * v1) / (2.0 * acceleration);
+		const double cruise_mm = std::max(b.length - accelerate_mm - decelerate_mm, 0.0);
+
+		return (peak - v0) / acceleration + (peak - v1) / acceleration + (peak > 0.0 ? cruise_mm / peak : 0.0);
+	}
+
+	/* Reads the pending blocks up to count, started_s being the start of the oldest one (once
+	   started): the buffer has room for each once the block lookahead before it has started,
+	   all of which have, so a block is read once, whenever it is first needed. */
+	void read(size_t count, double started_s)
+	{
+		for (; read_ahead < count; read_ahead++)
+			pending[read_ahead].read_s = input.read(pending[read_ahead], read_ahead < lookahead ? start_of(read_ahead) : started_s, link);
+	}
+
+	/* Executes the oldest pending block. */
+	void execute()
+	{
+		const planned & b = pending.front();
+
+		read(1, 0.0);
+
+		const double start_s = std::max(done_s, b.read_s);
+		double time_s = 0.0;
+
+		if (b.pen_change)
+		{
+			time_s = PEN_SETTLE_MS / 1000.0;
+			speed = 0.0;
+			estimate.dwell_s += time_s;
+		}
+		else if (b.length > 0.0f)
+		{
+			/* The planner only sees the blocks read by the time the move ends, which are fewer
+			   than the buffer holds if the link falls behind. */
+			const size_t full = std::min(lookahead, pending.size() - 1);
+			double exit_speed, peak;
+
+			time_s = profile(full, exit_speed, peak);
+
+			read(full + 1, start_s);
+
+			size_t depth = 0;
+
+			while (depth < full && pending[depth + 1].read_s <= start_s + time_s)
+				depth++;
+
+			if (depth < full)
+				time_s = profile(depth, exit_speed, peak);
+
+			speed = exit_speed;
+
+			estimate.moving_s += time_s;
+			estimate.peak_steps_per_s = std::max<double>(estimate.peak_steps_per_s, peak * b.string_rate * vplotter::steps_per_mm);
+		}
+
+		estimate.starved_s += start_s - done_s;
+		estimate.transmit_s += b.transmit_s;
+
+		if (b.transmit_s > time_s)
+			estimate.transmit_bound++;
+
+		starts[executed++ % lookahead] = start_s;
+		done_s = start_s + time_s;
+
+		pending.pop_front();
+		read_ahead--;
+	}
+
+	void push(const planned & b)
+	{
+		pending.push_back(b);
+		uncosted++;
+	}
+
+	void execute_ready()
+	{
+		while (pending.size() > lookahead && pending[lookahead].costed)
+			execute();
+	}
+
+public:
+	job_estimator(const link_model & link) : link(link) {}
+
+	void add(const block & b)
+	{
+		optional<float> bx = b.x, by = b.y, bf;
+		optional<int> bm = b.m_number;
+
+		if (!b.parsed())
+		{
+			const auto words = gcode_words::tokenize(b.line);
+
+			bx = words.get_float('X');
+			by = words.get_float('Y');
+			bf = words.get_float('F');
+			bm = words.get_int('M');
+		}
+
+		/* A frame that b does not fit in is complete with the blocks before it. */
+		if (link.binary && !encoder.add(b))
+		{
+			end_message(encoder.finish().length());
+			encoder.add(b);
+		}
+
+		planned next;
+		feed = bf ? std::max(std::min(std::floor(*bf), float(MAX_FEED_MM_PER_S)), 0.0f) : feed;
+
+		const int m = bm.value_or(0);
+
+		next.feed = std::max(feed, min_speed);
+		next.lift = m != 0 ? m == 3 : lift;
+
+		const double next_x = bx ? *bx : x, next_y = by ? *by : y;
+		const double dx = next_x - x, dy = next_y - y;
+		const double length = std::sqrt(dx * dx + dy * dy);
+
+		const bool pen_change = next.lift != lift;
+
+		if (pen_change)
+		{
+			estimate.pen_changes++;
+			estimate.lifts += next.lift;
+			previous_feed = 0.0f;
+			lift = next.lift;
+
+			/* A line with both is taken as the pen change and then the move, as a frame carries them. */
+			if (length > 0.0)
+			{
+				planned change = next;
+				change.pen_change = true;
+				push(change);
+			}
+			else
+			{
+				next.pen_change = true;
+			}
+		}
+
+		const double longest_units = std::max(std::abs(dx), std::abs(dy)) * BLOCK_UNITS_PER_MM;
+		const size_t split = std::max(static_cast<size_t>(std::ceil(longest_units / BLOCK_MAX_DELTA)), size_t(1));
+
+		next.length = static_cast<float>(length / split);
+		next.max_entry_speed = next.pen_change ? 0.0f : MAX_FEED_MM_PER_S;
+
+		if (length > 0.0)
+		{
+			/* Junction speed, as planner_add. */
+			const double ux = dx / length, uy = dy / length;
+			const double cos_theta = -(unit_x * ux + unit_y * uy);
+			const double sin_theta_d2 = std::sqrt(std::max(0.5 * (1.0 - cos_theta), 0.0));
+
+			double junction_speed = next.feed;
+
+			if (sin_theta_d2 < 0.999)
+				junction_speed = std::sqrt(acceleration * JUNCTION_DEVIATION_MM * sin_theta_d2 / (1.0 - sin_theta_d2));
+
+			next.max_entry_speed = static_cast<float>(std::min({ junction_speed, double(next.feed), double(previous_feed) }));
+
+			const auto [a0, b0] = vplotter::lengths(x, y);
+			const auto [a1, b1] = vplotter::lengths(next_x, next_y);
+			next.string_rate = static_cast<float>(std::max(std::abs(a1 - a0), std::abs(b1 - b0)) / length);
+
+			unit_x = ux;
+			unit_y = uy;
+			previous_feed = next.feed;
+
+			estimate.moves++;
+			(lift ? estimate.pen_up_mm : estimate.pen_down_mm) += length;
+			estimate.length_counts[std::upper_bound(estimate.length_bins.begin(), estimate.length_bins.end(), length) - estimate.length_bins.begin()]++;
+		}
+
+		x = next_x;
+		y = next_y;
+
+		estimate.blocks++;
+
+		push(next);
+
+		for (size_t n = 1; n < split; n++)
+		{
+			next.max_entry_speed = next.feed; /* straight on */
+			push(next);
+		}
+
+		if (!link.binary)
+		{
+			block::line_buffer buf;
+			end_message(b.format(buf).length() + 2 /* "\r\n" */);
+		}
+
+		execute_ready();
+	}
+
+	/* Executes the blocks still pending, with the buffer running empty, and returns the estimate. */
+	job_estimate finish()
+	{
+		if (!encoder.empty())
+			end_message(encoder.finish().length());
+
+		while (!pending.empty())
+			execute();
+
+		estimate.wall_s = done_s;
+
+		return estimate;
+	}
+};
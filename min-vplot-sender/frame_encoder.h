@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+#include "types.h"
+#include "block.h"
+#include "words.h"
+
+#include "../frame.h"
+
+/* Packs blocks into binary frames (see ../frame.h) for firmware that reads them.
+
+   The firmware only acts on a few words of a text line: X and Y, M3 (lift the pen) or any
+   other M code but M0 (lower it), and F (feed). The encoder follows the state these give
+   and sends only its changes: one point per move, and the pen and feed state at the start of
+   a frame. Other words, and the M0 diagnostic printout, have no binary form. */
+class frame_encoder
+{
+	std::array<uint8_t, FRAME_MAX_BYTES> buf;
+	frame_writer writer{ buf.data() };
+
+	/* State after the blocks added so far, X and Y in 1 / FRAME_UNITS_PER_MM mm. */
+	int32_t x = 0;
+	int32_t y = 0;
+	bool lift = true;
+	uint8_t feed = FRAME_MAX_FEED;
+
+	bool state_changed = false; /* by a block of the current frame */
+	uint8_t seq = 0;
+
+	static int32_t to_units(float mm)
+	{
+		return static_cast<int32_t>(std::lround(mm * FRAME_UNITS_PER_MM));
+	}
+
+public:
+	struct frame_stats
+	{
+		size_t blocks = 0;
+		size_t frames = 0;
+		size_t bytes = 0;
+	};
+
+	frame_stats stats;
+
+	/* Nothing to send since the last frame. */
+	bool empty() const { return !writer.has_points() && !state_changed; }
+
+	/* Adds b to the current frame. False if it does not fit: a full frame, or a second pen or
+	   feed change, as a frame carries one state from its start. Finish the frame and add b
+	   again. */
+	bool add(const block & b)
+	{
+		optional<float> bx = b.x, by = b.y, bf;
+		optional<int> bm = b.m_number;
+
+		if (!b.parsed())
+		{
+			const auto words = gcode_words::tokenize(b.line);
+
+			bx = words.get_float('X');
+			by = words.get_float('Y');
+			bf = words.get_float('F');
+			bm = words.get_int('M');
+		}
+
+		const bool next_lift = bm && *bm != 0 ? *bm == 3 : lift;
+		const uint8_t next_feed = bf ? static_cast<uint8_t>(std::min(std::max(*bf, 0.0f), float(FRAME_MAX_FEED))) : feed;
+
+		const int32_t next_x = bx ? to_units(*bx) : x;
+		const int32_t next_y = by ? to_units(*by) : y;
+
+		if (next_lift != lift || next_feed != feed)
+		{
+			if (writer.has_points() || state_changed)
+				return false;
+
+			lift = next_lift;
+			feed = next_feed;
+			state_changed = true;
+
+			writer.set_state(lift, feed);
+		}
+
+		if ((next_x != x || next_y != y) && !writer.add_point(next_x - x, next_y - y))
+			return false;
+
+		x = next_x;
+		y = next_y;
+
+		stats.blocks++;
+
+		return true;
+	}
+
+	/* Completes the current frame and returns its bytes; the next frame starts in the state
+	   this one ends in. */
+	std::string finish()
+	{
+		const uint8_t length = writer.finish(seq++);
+		std::string frame(reinterpret_cast<const char *>(buf.data()), length);
+
+		writer.clear();
+		writer.set_state(lift, feed);
+		state_changed = false;
+
+		stats.frames++;
+		stats.bytes += length;
+
+		return frame;
+	}
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+#include "toolpath.h"
+
+#include "../config.h"
+
+/* V-plotter geometry of the firmware (pos_from_pt, machine_state::get_current_cartesian_location),
+   in double precision. */
+namespace vplotter
+{
+	constexpr double motor_distance = STEPPER_DISTANCE_MM;
+	constexpr double origin_x = ORIGIN_X;
+	constexpr double origin_y = ORIGIN_Y;
+	const double steps_per_mm = STEPS_PER_MM;
+
+	/* Inverse kinematics: string lengths (a, b) at a cartesian point. */
+	inline std::pair<double, double> lengths(double x, double y)
+	{
+		const double dy = y - origin_y;
+
+		return std::make_pair(std::hypot(x - origin_x, dy), std::hypot(x + origin_x, dy));
+	}
+
+	/* Forward kinematics: cartesian point at string lengths (a, b). */
+	inline std::pair<double, double> point(double a, double b)
+	{
+		const double b_p_a_sq = b * b + a * a;
+		const double b_m_a_sq = b * b - a * a;
+
+		const double x = b_m_a_sq / (2.0 * motor_distance);
+		const double y = origin_y - std::sqrt(std::max(0.0, 0.5 * (b_p_a_sq -
+			motor_distance * motor_distance / 2.0 -
+			b_m_a_sq * b_m_a_sq / (2.0 * motor_distance * motor_distance))));
+
+		return std::make_pair(x, y);
+	}
+}
+
+/* Counts kept by a kinematic_segmenter over all the toolpaths it has processed. */
+struct segment_stats
+{
+	size_t moves = 0; /* G1 moves looked at */
+	size_t split = 0; /* of these, split into shorter ones */
+	size_t added = 0; /* blocks added */
+};
+
+/* Splits G1 moves so each part stays within tolerance (mm) of the straight line when the
+   motors run at constant speeds over it, as they do between two points on the controller
+   without its line correction (see prepare_motion).
+
+   Constant string speeds trace a curve whose deviation from the chord grows with the square of
+   its length and with the local curvature of the kinematics, which is highest near the motors
+   and along the strings. Points are placed by marching along each move: a step is tried, its
+   deviation measured at its quarter points (it peaks halfway over short steps, but a long step
+   along a string can curve both ways), and the step shrunk in proportion to the square
+   root of the excess until it fits, and the next one tried a little longer. The spacing so
+   follows the curvature along the move. tolerance must be positive. */
+class kinematic_segmenter
+{
+	float tolerance;
+
+	std::vector<uint32_t> extra;
+	std::vector<pos2> points;
+
+	/* Largest distance from the chord p-q of the points reached a quarter, half and three
+	   quarters of the way from p to q at constant string speeds. */
+	static double deviation(double px, double py, double qx, double qy)
+	{
+		const auto [pa, pb] = vplotter::lengths(px, py);
+		const auto [qa, qb] = vplotter::lengths(qx, qy);
+
+		const double vx = qx - px, vy = qy - py;
+		const double length = std::hypot(vx, vy);
+
+		if (!(length > 0.0))
+			return 0.0;
+
+		double max_distance = 0.0;
+
+		for (const double t : { 0.25, 0.5, 0.75 })
+		{
+			const auto [mx, my] = vplotter::point(pa + t * (qa - pa), pb + t * (qb - pb));
+			max_distance = std::max(max_distance, std::abs(vx * (my - py) - vy * (mx - px)) / length);
+		}
+
+		return max_distance;
+	}
+
+	/* Appends the points between p and q to points; returns how many. */
+	uint32_t split(double px, double py, double qx, double qy)
+	{
+		const double length = std::hypot(qx - px, qy - py);
+		const double ux = (qx - px) / length, uy = (qy - py) / length;
+
+		uint32_t count = 0;
+		double s = 0.0;    /* distance along the move of the last point */
+		double step = length;
+
+		while (s < length)
+		{
+			const double remaining = length - s;
+
+			/* Halve what is left rather than leaving a sliver at the end. */
+			step = remaining <= step ? remaining : std::min(step, remaining / 2.0);
+
+			/* Off its middle, the peak can fall between the points measured; aim a little lower. */
+			const double target = 0.9 * tolerance;
+
+			/* Not below a motor step: the controller rounds to steps anyway, and outside the reach of
+			   the strings nothing would fit. */
+			const double min_step = std::min(remaining, 1.0 / vplotter::steps_per_mm);
+
+			for (double d; step > min_step && (d = deviation(px + ux * s, py + uy * s, px + ux * (s + step), py + uy * (s + step))) > target;)
+				step = std::max(min_step, step * std::max(0.25, 0.9 * std::sqrt(target / d)));
+
+			s += step;
+			step *= 1.5;
+
+			if (s < length - 1e-6)
+			{
+				points.emplace_back(static_cast<float>(px + ux * s), static_cast<float>(py + uy * s));
+				count++;
+			}
+		}
+
+		return count;
+	}
+
+public:
+	segment_stats stats;
+
+	kinematic_segmenter(float tolerance) : tolerance(tolerance) {}
+
+	/* Splits the G1 moves of path from index begin on; start is the position the machine is at
+	   before path[begin]. Returns the number of blocks added. */
+	size_t segment(toolpath & path, size_t begin, pos2 start)
+	{
+		extra.assign(path.size(), 0);
+		points.clear();
+
+		float x = start.first;
+		float y = start.second;
+
+		/* A block with an M code changes the pen before it moves, so it is left whole. */
+		constexpr uint8_t move_mask = toolpath::passthrough | toolpath::has_g | toolpath::has_m;
+
+		for (size_t idx = begin; idx < path.size(); idx++)
+		{
+			const uint8_t f = path.flags[idx];
+
+			if (f & toolpath::passthrough)
+				continue;
+
+			const float next_x = f & toolpath::has_x ? path.xs[idx] : x;
+			const float next_y = f & toolpath::has_y ? path.ys[idx] : y;
+
+			if ((f & move_mask) == toolpath::has_g && path.g_codes[idx] == 1 && (next_x != x || next_y != y))
+			{
+				extra[idx] = split(x, y, next_x, next_y);
+
+				stats.moves++;
+				stats.split += extra[idx] > 0;
+				stats.added += extra[idx];
+			}
+
+			x = next_x;
+			y = next_y;
+		}
+
+		path.subdivide(extra, points);
+
+		return points.size();
+	}
+};
@@ -0,0 +1,298 @@
+#pragma once
+
+#include "../serial.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* Event driven serial port for Linux: epoll over a non-blocking termios fd.
+
+   Received bytes go into a fixed buffer and lines are returned as views into it, so framing
+   copies nothing except a partial trailing line when the buffer is compacted. Outbound lines
+   (and binary frames) are collected and sent with a single writev per flush(), the lines'
+   "\r\n" endings referencing one shared constant. wait() returns as soon as the kernel has
+   input, rather than after a fixed sleep. */
+class serial_linux : public serial
+{
+	static constexpr size_t rx_size = 4096;
+	static constexpr size_t tx_size = 4096;
+	static constexpr size_t max_lines = 64;
+	static constexpr char crlf[] = "\r\n";
+
+	int tty_fd = -1;
+	int epoll_fd = -1;
+
+	char rx[rx_size];
+	size_t rx_begin = 0; /* start of the first line not yet returned */
+	size_t rx_scan = 0;  /* everything before this has been searched for line endings */
+	size_t rx_end = 0;
+
+	char tx[tx_size];
+	size_t tx_used = 0;
+	iovec tx_iov[2 * max_lines];
+	size_t tx_iov_count = 0;
+
+	/* Reads what the tty has into rx; false on a read error, or once it has nothing left after a
+	   hangup (with VMIN = VTIME = 0 an empty tty reads 0 bytes either way). */
+	bool read_available(bool hung_up)
+	{
+		if (rx_begin == rx_end)
+			rx_begin = rx_scan = rx_end = 0; /* every line consumed; start over at the front */
+
+		while (true)
+		{
+			if (rx_end == rx_size)
+			{
+				if (rx_begin == 0)
+				{
+					std::cout << "serial receive overflow, dropping " << rx_size << " bytes" << std::endl;
+					rx_scan = rx_end = 0;
+				}
+				else
+				{
+					memmove(rx, rx + rx_begin, rx_end - rx_begin);
+					rx_scan -= rx_begin;
+					rx_end -= rx_begin;
+					rx_begin = 0;
+				}
+			}
+
+			const ssize_t count = ::read(tty_fd, rx + rx_end, rx_size - rx_end);
+
+			if (count > 0)
+				rx_end += count;
+			else if (count == 0)
+				return !hung_up;
+			else
+				return errno == EAGAIN || errno == EINTR;
+		}
+	}
+
+	/* Writes all of iov, waiting for the tty to take more whenever it is full, as the fd is non
+	   blocking; the iovecs are advanced past what was written. False on an error. */
+	bool write_all(iovec * iov, size_t iov_count) const
+	{
+		while (iov_count > 0)
+		{
+			const ssize_t written = ::writev(tty_fd, iov, static_cast<int>(std::min<size_t>(iov_count, IOV_MAX)));
+
+			if (written < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				if (errno != EAGAIN)
+					return false;
+
+				pollfd pfd{ tty_fd, POLLOUT, 0 };
+				poll(&pfd, 1, 100);
+				continue;
+			}
+
+			/* Skip what was written, including a partially written iovec. */
+			size_t remaining = static_cast<size_t>(written);
+			while (iov_count > 0 && remaining >= iov->iov_len)
+			{
+				remaining -= iov->iov_len;
+				iov++;
+				iov_count--;
+			}
+
+			if (iov_count > 0)
+			{
+				iov->iov_base = static_cast<char *>(iov->iov_base) + remaining;
+				iov->iov_len -= remaining;
+			}
+		}
+
+		return true;
+	}
+
+	/* Writes bytes and, with line_ending, "\r\n" straight to the tty. */
+	bool write_now(std::string_view bytes, bool line_ending) const
+	{
+		iovec iov[2] = { { const_cast<char *>(bytes.data()), bytes.length() }, { const_cast<char *>(crlf), 2 } };
+
+		return write_all(iov, line_ending ? 2 : 1);
+	}
+
+	bool queue(std::string_view bytes, bool line_ending)
+	{
+		if (tx_used + bytes.length() > tx_size || tx_iov_count + 2 > 2 * max_lines)
+		{
+			if (!flush())
+				return false;
+
+			if (bytes.length() > tx_size)
+				return write_now(bytes, line_ending);
+		}
+
+		memcpy(tx + tx_used, bytes.data(), bytes.length());
+
+		tx_iov[tx_iov_count++] = iovec{ tx + tx_used, bytes.length() };
+
+		if (line_ending)
+			tx_iov[tx_iov_count++] = iovec{ const_cast<char *>(crlf), 2 };
+
+		tx_used += bytes.length();
+
+		return true;
+	}
+
+public:
+	serial_linux() {}
+	serial_linux(const serial_linux &) = delete;
+	serial_linux & operator=(const serial_linux &) = delete;
+
+	virtual ~serial_linux()
+	{
+		if (epoll_fd != -1)
+			::close(epoll_fd);
+
+		if (tty_fd != -1)
+			::close(tty_fd);
+	}
+
+	virtual bool setup(const std::string & port_str)
+	{
+		tty_fd = ::open(port_str.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+		if (tty_fd == -1)
+		{
+			std::cout << "Error opening serial device: " << port_str << std::endl;
+			return false;
+		}
+
+		termios tio;
+		memset(&tio, 0, sizeof(tio));
+		tio.c_cflag = CS8 | CREAD | CLOCAL; // 8n1
+		tio.c_cc[VMIN] = 0;
+		tio.c_cc[VTIME] = 0;
+
+		cfsetospeed(&tio, B115200);
+		cfsetispeed(&tio, B115200);
+
+		if (tcsetattr(tty_fd, TCSANOW, &tio) != 0)
+		{
+			std::cout << "Error configuring serial device: " << port_str << ": " << strerror(errno) << std::endl;
+			return false;
+		}
+
+		epoll_fd = epoll_create1(0);
+
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.fd = tty_fd;
+
+		if (epoll_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, tty_fd, &event) != 0)
+		{
+			std::cout << "epoll setup error: " << strerror(errno) << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	/* For the polling interface only: reads the tty directly, past the buffer wait() and
+	   read_line() use, so the two must not be mixed. */
+	virtual optional<std::string> read() const
+	{
+		pollfd pfd{ tty_fd, POLLIN, 0 };
+		const bool hung_up = poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLERR | POLLHUP));
+
+		std::string result;
+		char buf[256];
+
+		while (true)
+		{
+			const ssize_t count = ::read(tty_fd, buf, sizeof(buf));
+
+			if (count > 0)
+				result.append(buf, count);
+			else if (count == 0)
+				return hung_up && result.empty() ? nullopt : optional<std::string>(result);
+			else if (errno == EAGAIN || errno == EINTR)
+				return result;
+			else
+				return nullopt;
+		}
+	}
+
+	virtual bool write(const std::string & string) const
+	{
+		return write_now(string, true);
+	}
+
+	virtual void sleep(const unsigned int ms) const
+	{
+		usleep(ms * 1000);
+	}
+
+	virtual bool wait(unsigned int timeout_ms)
+	{
+		epoll_event event;
+		const int ready = epoll_wait(epoll_fd, &event, 1, static_cast<int>(timeout_ms));
+
+		if (ready < 0)
+			return errno == EINTR;
+
+		if (ready == 0)
+			return true;
+
+		const bool hung_up = event.events & (EPOLLERR | EPOLLHUP);
+
+		if (hung_up && !(event.events & EPOLLIN))
+			return false;
+
+		return read_available(hung_up);
+	}
+
+	virtual optional<std::string_view> read_line()
+	{
+		for (; rx_scan + 1 < rx_end; rx_scan++)
+		{
+			if (rx[rx_scan] == '\r' && rx[rx_scan + 1] == '\n')
+			{
+				const std::string_view line(rx + rx_begin, rx_scan - rx_begin);
+
+				rx_scan += 2;
+				rx_begin = rx_scan;
+
+				return line;
+			}
+		}
+
+		return nullopt;
+	}
+
+	virtual bool write_line(std::string_view line)
+	{
+		return queue(line, true);
+	}
+
+	virtual bool write_bytes(std::string_view bytes)
+	{
+		return queue(bytes, false);
+	}
+
+	virtual bool flush()
+	{
+		if (!write_all(tx_iov, tx_iov_count))
+			return false;
+
+		tx_used = 0;
+		tx_iov_count = 0;
+
+		return true;
+	}
+};
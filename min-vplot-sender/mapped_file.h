@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Read only memory mapping of a whole file. Pages are loaded by the OS as they are touched,
+   so the file contents never have to be copied into process memory. */
+class mapped_file
+{
+	const char * data = nullptr;
+	size_t size = 0;
+
+#ifdef WIN32
+	HANDLE file_handle = INVALID_HANDLE_VALUE;
+	HANDLE mapping_handle = NULL;
+#endif
+
+public:
+	mapped_file() {}
+	mapped_file(const mapped_file &) = delete;
+	mapped_file & operator=(const mapped_file &) = delete;
+
+	~mapped_file()
+	{
+		close();
+	}
+
+	bool open(const std::string & path)
+	{
+		close();
+
+#ifdef WIN32
+		file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+		if (file_handle == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file_handle, &file_size))
+			return false;
+
+		size = static_cast<size_t>(file_size.QuadPart);
+
+		if (size == 0)
+			return true;
+
+		mapping_handle = CreateFileMapping(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping_handle == NULL)
+			return false;
+
+		data = static_cast<const char *>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+#else
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd == -1)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0)
+		{
+			::close(fd);
+			return false;
+		}
+
+		size = static_cast<size_t>(st.st_size);
+
+		if (size > 0)
+		{
+			void * map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			data = map != MAP_FAILED ? static_cast<const char *>(map) : nullptr;
+
+			if (data)
+				madvise(map, size, MADV_SEQUENTIAL);
+		}
+
+		::close(fd); // the mapping keeps its own reference to the file
+#endif
+
+		return size == 0 || data != nullptr;
+	}
+
+	void close()
+	{
+#ifdef WIN32
+		if (data)
+			UnmapViewOfFile(data);
+
+		if (mapping_handle != NULL)
+			CloseHandle(mapping_handle);
+
+		if (file_handle != INVALID_HANDLE_VALUE)
+			CloseHandle(file_handle);
+
+		mapping_handle = NULL;
+		file_handle = INVALID_HANDLE_VALUE;
+#else
+		if (data)
+			munmap(const_cast<char *>(data), size);
+#endif
+
+		data = nullptr;
+		size = 0;
+	}
+
+	std::string_view view() const
+	{
+		return std::string_view(data, size);
+	}
+};
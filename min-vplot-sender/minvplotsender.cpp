@@ -1,22 +1,356 @@
+#include <chrono>
+#include <deque>
 #include <iostream>
-#include <fstream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <sstream>
+#include <thread>
 
 #ifdef WIN32
 #include "win\serial_windows.h"
+#elif defined(__linux__)
+#include "linux/serial_linux.h"
 #else
 #include "serial_osx.h"
 #endif
 
 #include "parse.h"
+#include "stream.h"
+#include "frame_encoder.h"
+#include "estimate.h"
+#include "telemetry.h"
+#include "session_log.h"
+#include "mapped_file.h"
 #include "transforms.h"
 #include "options.h"
 #include "trace.h"
 
+#include "../status.h"
+
 using namespace std;
 
+/* Flow control settings for send_blocks. */
+struct flow_control
+{
+	/* Send the next line only after the previous one is acknowledged. */
+	static flow_control ping_pong() { return flow_control{ 1, 0 }; }
+
+	/* Keep up to rx_buffer bytes of unacknowledged lines in flight (grbl-style character counting). */
+	static flow_control streaming(size_t rx_buffer) { return flow_control{ 0, rx_buffer }; }
+
+	size_t max_lines = 0; /* 0: unlimited */
+
+	/* 0: unlimited. Otherwise the controller's serial RX buffer: a longer line could arrive while
+	   the controller is not reading (its block buffer full), overflow the RX buffer and never be
+	   answered, so the job is aborted before it is sent. */
+	size_t max_bytes = 0;
+};
+
+/*
+ Sends blocks from the source (a gcode_parser holding the whole program, or a gcode_stream
+ parsing it on demand) to the controller. After "Ready", lines are sent as long as the flow
+ control allows; each "ok" or "error" response acknowledges the oldest line in flight.
+
+ With binary set, the sender first asks for binary frames ("$B", see ../frame.h) and packs
+ the blocks into frames if the controller agrees. Frames are flow controlled like lines, and
+ stay queued until acknowledged. The controller stops answering at a damaged frame, so the
+ window fills and the sender stops; once the link is quiet, "rs <n>" comes, and the sender
+ sends again from frame n.
+
+ With status_period_us set, a status query (see ../status.h) goes out between lines or frames
+ that often after "Ready". It takes no room in the controller's RX buffer, so it is not
+ counted in flight, and its report is not echoed.
+
+ Every message either way goes to link_telemetry, reported at the end, and to the session log
+ if one is open; the controller's responses are echoed only without a log.
+ */
+template <typename serial_type, typename block_source>
+int send_blocks(serial_type & serial, block_source & blocks, flow_control flow, bool binary, uint64_t status_period_us,
+	session_log::writer & log)
+{
+	using clock = chrono::steady_clock;
+
+	const auto epoch = clock::now();
+	auto now_us = [epoch] { return static_cast<uint64_t>(chrono::duration_cast<chrono::microseconds>(clock::now() - epoch).count()); };
+
+	link_telemetry telemetry;
+	const bool echo = !log.is_open();
+
+	serial.sleep(100);
+	serial.write_line(">");
+
+	const uint64_t hello_us = now_us();
+	telemetry.sent(3, hello_us);
+	log.add(session_log::line_sent, hello_us, ">");
+	serial.flush();
+	serial.sleep(100);
+
+	enum class link_mode { lines, negotiating, frames };
+	link_mode mode = link_mode::lines;
+
+	bool ready = false;
+	bool home_queued = false;
+
+	string next_line; /* formatted, waiting for room in the controller */
+
+	deque<size_t> in_flight; /* bytes of unacknowledged lines or frames */
+	size_t in_flight_bytes = 0;
+
+	frame_encoder encoder;
+	deque<string> unacked;   /* frames not yet acknowledged, oldest first */
+	size_t unacked_sent = 0; /* of these, sent since the last resend */
+	size_t frames_resent = 0;
+
+	uint64_t next_status_us = 0;
+
+	auto send = [&](string_view bytes, bool line)
+	{
+		if (!(line ? serial.write_line(bytes) : serial.write_bytes(bytes)))
+			return false;
+
+		const size_t sent_bytes = bytes.length() + (line ? 2 : 0); /* "\r\n" */
+		in_flight.push_back(sent_bytes);
+		in_flight_bytes += sent_bytes;
+
+		const uint64_t t_us = now_us();
+		telemetry.sent(sent_bytes, t_us);
+		log.add(line ? session_log::line_sent : session_log::bytes_sent, t_us, bytes);
+
+		return true;
+	};
+
+	auto has_room = [&](size_t bytes)
+	{
+		if (in_flight.empty())
+			return true; /* a line as long as the RX buffer must still go out eventually */
+
+		if (flow.max_lines && in_flight.size() >= flow.max_lines)
+			return false;
+
+		return !flow.max_bytes || in_flight_bytes + bytes <= flow.max_bytes;
+	};
+
+	auto acknowledge = [&]
+	{
+		in_flight_bytes -= in_flight.front();
+		in_flight.pop_front();
+	};
+
+	auto frame_seq = [](const string & frame) { return static_cast<uint8_t>(frame[1]); };
+
+	/* Packs the next blocks into a frame, queued at the end of unacked; false once all are sent. */
+	auto encode_frame = [&]
+	{
+		while (!home_queued)
+		{
+			const bool last = blocks.empty();
+
+			if (!encoder.add(last ? block(pos2(0.0f, 0.0f)) /* return to home */ : blocks.front()))
+				break;
+
+			if (last)
+				home_queued = true;
+			else
+				blocks.pop_front();
+		}
+
+		if (encoder.empty())
+			return false;
+
+		unacked.push_back(encoder.finish());
+		return true;
+	};
+
+	while (true)
+	{
+		unsigned int wait_ms = 100;
+
+		if (ready && status_period_us)
+		{
+			const uint64_t t_us = now_us();
+			wait_ms = next_status_us > t_us ? min<unsigned int>(wait_ms, static_cast<unsigned int>((next_status_us - t_us + 999) / 1000)) : 0;
+		}
+
+		if (!serial.wait(wait_ms))
+		{
+			cout << "Serial port error\n" << telemetry.stats << endl;
+			return 1;
+		}
+
+		// Handle complete responses; a partial response stays buffered in the serial port.
+		while (const auto response = serial.read_line())
+		{
+			const string_view line = *response;
+			const uint64_t t_us = now_us();
+
+			telemetry.received(line, t_us);
+			log.add(session_log::line_received, t_us, line);
+
+			if (echo && line.substr(0, 1) != "<")
+				cout << "<[" << line << "]\n";
+
+			if (line == "Ready")
+			{
+				ready = true;
+
+				if (binary && send("$B", true))
+					mode = link_mode::negotiating;
+			}
+			else if (in_flight.empty())
+			{
+				continue;
+			}
+			else if (mode == link_mode::frames && line == "ok")
+			{
+				acknowledge();
+
+				unacked.pop_front(); /* answers come in the order of unacked */
+				unacked_sent--;
+			}
+			else if (mode == link_mode::frames && line.compare(0, 3, "rs ") == 0)
+			{
+				/* Everything in flight was discarded, unanswered. */
+				while (!in_flight.empty())
+					acknowledge();
+
+				int expected = 0;
+				from_chars(line.data() + 3, line.data() + line.length(), expected);
+
+				/* The controller has everything before the expected frame. */
+				while (unacked_sent > 0 && static_cast<uint8_t>(expected - frame_seq(unacked.front()) - 1) < 127)
+				{
+					unacked.pop_front();
+					unacked_sent--;
+				}
+
+				frames_resent += unacked_sent;
+				unacked_sent = 0;
+			}
+			else if (line == "ok" || line.compare(0, 5, "error") == 0)
+			{
+				acknowledge();
+
+				if (mode == link_mode::negotiating)
+				{
+					mode = line == "ok" ? link_mode::frames : link_mode::lines;
+
+					if (mode == link_mode::lines)
+						cout << "Controller does not read binary frames, sending text" << endl;
+				}
+			}
+		}
+
+		if (ready && status_period_us && now_us() >= next_status_us)
+		{
+			static constexpr char query = STATUS_QUERY;
+
+			if (serial.write_bytes(string_view(&query, 1)))
+			{
+				const uint64_t t_us = now_us();
+
+				telemetry.queried(t_us);
+				log.add(session_log::query_sent, t_us, string_view(&query, 1));
+				next_status_us = t_us + status_period_us;
+			}
+		}
+
+		static bool debug_request_parameters = false;
+
+		if (debug_request_parameters && mode == link_mode::lines) /* M0 has no binary form */
+		{
+			send("M0V0.0", true);
+			debug_request_parameters = false;
+		}
+
+		while (ready && mode == link_mode::lines)
+		{
+			if (next_line.empty())
+			{
+				if (!blocks.empty())
+				{
+					next_line = blocks.front();
+					blocks.pop_front();
+				}
+				else if (!home_queued)
+				{
+					next_line = block(pos2(0.0f, 0.0f)); // return to home
+					home_queued = true;
+				}
+				else
+				{
+					break;
+				}
+			}
+
+			if (flow.max_bytes && next_line.length() + 2 > flow.max_bytes)
+			{
+				cout << "Line longer than the controller's RX buffer (" << flow.max_bytes << " bytes), job aborted: " << next_line << "\n"
+					<< telemetry.stats << endl;
+				return 1;
+			}
+
+			if (!has_room(next_line.length() + 2) || !send(next_line, true))
+				break;
+
+			next_line.clear();
+		}
+
+		while (mode == link_mode::frames)
+		{
+			if (unacked_sent == unacked.size() && !encode_frame())
+				break;
+
+			const string & frame = unacked[unacked_sent];
+
+			if (!has_room(frame.length()) || !send(frame, false))
+				break;
+
+			unacked_sent++;
+		}
+
+		if (!serial.flush())
+		{
+			cout << "Serial port error\n" << telemetry.stats << endl;
+			return 1;
+		}
+
+		if (home_queued && next_line.empty() && unacked.empty() && in_flight.empty()) // done
+		{
+			if (mode == link_mode::frames)
+			{
+				const auto & stats = encoder.stats;
+
+				cout << stats.blocks << " blocks in " << stats.frames << " frames (" << stats.bytes << " bytes, "
+					<< static_cast<double>(stats.bytes) / max<size_t>(stats.blocks, 1) << " per block), "
+					<< frames_resent << " frames resent" << endl;
+			}
+
+			cout << telemetry.stats << endl;
+
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+/* Estimates the job the blocks make, with the return to home send_blocks adds, and prints it. */
+template <typename block_source>
+int dry_run(block_source & blocks, const link_model & link)
+{
+	job_estimator estimator(link);
+
+	for (; !blocks.empty(); blocks.pop_front())
+		estimator.add(blocks.front());
+
+	estimator.add(block(pos2(0.0f, 0.0f)));
+
+	cout << estimator.finish() << endl;
+
+	return 0;
+}
+
 /*
  minvplotsender
 
@@ -35,58 +369,78 @@ int main(int argc, const char * argv[])
 		return 1;
 	}
 
-	ifstream file(opt.nc_path, ifstream::in);
+	const float arc_tolerance = opt.arc_tolerance.value_or(default_arc_tolerance);
+
+	const unsigned threads = opt.threads ? static_cast<unsigned>(*opt.threads) : max(thread::hardware_concurrency(), 1u);
 
-	if (!file)
+	gcode_parser parser;
+
+	mapped_file nc_file;
+	range x_extent, y_extent;
+
+	if (!nc_file.open(opt.nc_path))
 	{
 		cout << "Input file error:" << opt.nc_path << endl;
 		return 1;
 	}
 
-	gcode_parser parser;
-
-	string str;
-	while (getline(file, str))
+	if (opt.stream)
 	{
-		if (!parser.add(str))
-		{
-			cout << "NC file parsing error" << endl;
-			return 1;
-		}
+		tie(x_extent, y_extent) = gcode_stream::scan_extents(nc_file.view(), threads);
+	}
+	else
+	{
+		parser = parallel_parser(nc_file.view(), arc_tolerance, threads).parse();
+
+		x_extent = parser.get_x_extent();
+		y_extent = parser.get_y_extent();
 	}
 
-	list<block::transformer> transforms;
+	affine transformation; /* everything below folded into one matrix */
 
 	if (opt.center_x)
-		transforms.push_back(center_x(parser.get_x_extent()));
+		transformation = transformation.then(center_x(x_extent));
 
 	if (opt.center_y)
-		transforms.push_back(center_y(parser.get_y_extent()));
+		transformation = transformation.then(center_y(y_extent));
 
 	if (opt.scale_width)
-		transforms.push_back(scale_width(parser.get_x_extent(), *opt.scale_width));
+		transformation = transformation.then(scale_width(x_extent, *opt.scale_width));
 	
 	if (opt.scale_height)
-		transforms.push_back(scale_height(parser.get_y_extent(), *opt.scale_height));
+		transformation = transformation.then(scale_height(y_extent, *opt.scale_height));
+
+	if (opt.rotate)
+		transformation = transformation.then(affine::rotate(*opt.rotate));
+
+	if (opt.mirror_x)
+		transformation = transformation.then(mirror_x());
+
+	if (opt.mirror_y)
+		transformation = transformation.then(mirror_y());
+
+	if (opt.translate_x || opt.translate_y)
+		transformation = transformation.then(affine::translate(opt.translate_x.value_or(0.0f), opt.translate_y.value_or(0.0f)));
 
 	if (opt.trace_extents_only)
 	{
 		gcode_parser extents_gcode;
-		extents_gcode.add(make_outline_trace(parser.get_x_extent(), parser.get_y_extent()));
+		extents_gcode.add(make_outline_trace(x_extent, y_extent));
 
 		parser = extents_gcode;
+		opt.stream = false;
 	}
 
-	block::transformer all_transforms(composite(transforms));
-
 //#define DUMP_DEBUG
 #ifdef DUMP_DEBUG
-	cout << "(x extent: (" << parser.get_x_extent().first << ", " << parser.get_x_extent().second << "), "
-		<< "y extent: (" << parser.get_y_extent().first << ", " << parser.get_y_extent().second << "))" << endl;
+	cout << "(x extent: (" << x_extent.first << ", " << x_extent.second << "), "
+		<< "y extent: (" << y_extent.first << ", " << y_extent.second << "))" << endl;
+
+	parser.transform(transformation);
 
-	for (auto & block : parser)
+	for (; !parser.empty(); parser.pop_front())
 	{
-		std::cout << block.transform(all_transforms) << std::endl;
+		std::cout << parser.front() << std::endl;
 	}
 
 	return 0;
@@ -94,72 +448,126 @@ int main(int argc, const char * argv[])
 
 #ifdef WIN32
 	serial_win32 serial;
+#elif defined(__linux__)
+	serial_linux serial;
 #else
 	serial_osx serial;
 #endif
 
-	if (!serial.setup(opt.port_identifier))
+	if (!opt.dry_run && !serial.setup(opt.port_identifier))
 	{
 		return 1;
 	}
 
-	serial.sleep(100);
-	serial.write(">");
-	serial.sleep(100);
-
-	string input;
+	session_log::writer log;
 
-	// Processing loop; await "Ready/ok" from controller and send lines when received.
-	while (true)
+	if (opt.log_path && !opt.dry_run && !log.open(*opt.log_path))
 	{
-		const auto result = serial.read();
+		cout << "Cannot write session log: " << *opt.log_path << endl;
+		return 1;
+	}
 
-		if (!result)
-		{
-			return 1;
-		}
-		else if (result->length() > 0)
-		{
-			input.append(*result); // Add new input; may be incomplete response.
+	const auto flow = opt.rx_buffer ? flow_control::streaming(*opt.rx_buffer) : flow_control::ping_pong();
 
-			auto line_ending_index = string::npos;
+	link_model link;
+	link.baud = opt.baud.value_or(115200.0f);
+	link.latency_s = opt.latency.value_or(1.0f) / 1000.0;
+	link.rx_buffer = flow.max_bytes;
+	link.binary = opt.binary;
 
-			while ((line_ending_index = input.find("\r\n")) != string::npos)
-			{
-				string line = input.substr(0, line_ending_index);
-				cout << "<[" << line << "]" << endl;
+	const uint64_t status_period_us = opt.status_hz ? static_cast<uint64_t>(1e6 / *opt.status_hz) : 0;
 
-				input = input.substr(line_ending_index + 2);
+	auto send = [&](auto & blocks)
+	{
+		if (opt.dry_run)
+			return dry_run(blocks, link);
 
-				if (line.compare("ok") == 0 || line.compare("Ready") == 0)
-				{
-					if (!parser.empty())
-					{
-						serial.write(parser.front().transform(all_transforms));
-
-						parser.pop_front();
-					}
-
-					if (parser.empty()) // done
-					{
-						serial.write(block(pos2(0.0f, 0.0f))); // return to home
-						return 0;
-					}
-				}
-			}
+		int result = send_blocks(serial, blocks, flow, opt.binary, status_period_us, log);
 
-			static bool debug_request_parameters = false;
+		if (log.is_open())
+		{
+			log.close();
 
-			if (debug_request_parameters)
+			if (!log.ok())
 			{
-				serial.write("M0V0.0");
-				debug_request_parameters = false;
+				cout << "Session log write failed: " << *opt.log_path << endl;
+				result = 1;
 			}
 		}
 
-		serial.sleep(1 /* ms */);
+		return result;
+	};
+
+	polyline_simplifier simplifier(opt.simplify_tolerance.value_or(0.0f));
+
+	auto report_simplified = [&]
+	{
+		const auto & stats = simplifier.stats;
+
+		cout << "Simplified: " << stats.blocks << " -> " << stats.blocks - stats.removed << " blocks ("
+			<< (stats.blocks ? 100.0 * stats.removed / stats.blocks : 0.0) << "% fewer), estimated "
+			<< stats.estimated_time_saved_s() << " s saved" << endl;
+	};
+
+	kinematic_segmenter segmenter(opt.segment_tolerance.value_or(0.0f));
+
+	auto report_segmented = [&]
+	{
+		const auto & stats = segmenter.stats;
+
+		cout << "Segmented: " << stats.split << " of " << stats.moves << " G1 moves split, "
+			<< stats.added << " blocks added" << endl;
+	};
+
+	if (opt.stream)
+	{
+		gcode_stream stream(nc_file.view(), arc_tolerance);
+		stream.set_transform(transformation);
+
+		if (opt.simplify_tolerance)
+			stream.set_simplifier(&simplifier);
+
+		if (opt.segment_tolerance)
+			stream.set_segmenter(&segmenter);
+
+		const int result = send(stream);
+
+		if (opt.simplify_tolerance)
+			report_simplified();
+
+		if (opt.segment_tolerance)
+			report_segmented();
+
+		return result;
 	}
 
-	return 0;
-}
+	parser.transform(transformation); // buffered: transform the whole toolpath in place up front
 
+	if (opt.reorder)
+	{
+		stroke_reorderer reorderer;
+		parser.reorder(reorderer);
+
+		const auto & stats = reorderer.stats;
+
+		if (stats.skipped)
+			cout << "Strokes not reordered: " << *stats.skipped << endl;
+		else
+			cout << "Reordered " << stats.strokes << " strokes (" << stats.reversed << " reversed): pen-up travel "
+				<< stats.travel_before << " mm -> " << stats.travel_after << " mm" << endl;
+	}
+
+	if (opt.simplify_tolerance)
+	{
+		parser.simplify(simplifier, pos2(0.0f, 0.0f)); // the machine starts at the origin
+		report_simplified();
+	}
+
+	if (opt.segment_tolerance)
+	{
+		parser.segment(segmenter, pos2(0.0f, 0.0f));
+		report_segmented();
+	}
+
+	return send(parser);
+}
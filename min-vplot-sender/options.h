@@ -0,0 +1,279 @@
+#pragma once
+
+#include <string>
+
+#include "types.h"
+
+/* Command line options for minvplotsender. */
+struct options
+{
+	std::string port_identifier;
+	std::string nc_path;
+
+	bool center_x = false;
+	bool center_y = false;
+
+	optional<float> scale_width;
+	optional<float> scale_height;
+
+	/* Applied after centering and scaling, in this order. */
+	optional<float> rotate; /* degrees counterclockwise */
+	bool mirror_x = false;
+	bool mirror_y = false;
+	optional<float> translate_x;
+	optional<float> translate_y;
+
+	bool trace_extents_only = false;
+
+	/* Maximum distance in mm between a G2/G3 arc and the line segments sent for it. */
+	optional<float> arc_tolerance;
+
+	/* Reorder strokes to shorten pen-up travel; needs the whole program in memory. */
+	bool reorder = false;
+
+	/* Maximum distance in mm between simplified G1 runs and the original path; off if unset. */
+	optional<float> simplify_tolerance;
+
+	/* Maximum distance in mm between the line drawn at constant motor speeds and each G1 move;
+	   off if unset. */
+	optional<float> segment_tolerance;
+
+	bool stream = false;
+
+	/* Threads parsing the NC file; the number of cores if unset. */
+	optional<size_t> threads;
+
+	/* Send moves as binary frames (see ../frame.h) if the controller supports them. */
+	bool binary = false;
+
+	/* Controller serial RX buffer size for character counting flow control; ping-pong if unset. */
+	optional<size_t> rx_buffer;
+
+	/* Estimate the job instead of sending it (see estimate.h); no serial port is needed. */
+	bool dry_run = false;
+
+	/* Link assumed by the dry run: baud rate, and ms from an "ok" to the next line. */
+	optional<float> baud;
+	optional<float> latency;
+
+	/* Record the session to this file (see session_log.h) instead of echoing the responses. */
+	optional<std::string> log_path;
+
+	/* Status queries per second (see ../status.h) while sending; none if unset. At most what the
+	   115200 baud link carries at 10 bits a byte, as reports of up to 56 bytes. */
+	optional<float> status_hz;
+	static constexpr float max_status_hz = 205.0f;
+
+	optional<std::string> error;
+
+	std::string man =
+		"usage: min-vplot-sender <port> <nc file> [options]\n"
+		"       min-vplot-sender --dry-run <nc file> [options]\n"
+		"\n"
+		"  --center-x         center the drawing horizontally on the origin\n"
+		"  --center-y         center the drawing vertically on the origin\n"
+		"  --width <mm>       scale the drawing to the given width\n"
+		"  --height <mm>      scale the drawing to the given height\n"
+		"  --rotate <deg>     rotate the drawing counterclockwise about the origin\n"
+		"  --mirror-x         mirror the drawing horizontally (negate X)\n"
+		"  --mirror-y         mirror the drawing vertically (negate Y)\n"
+		"  --translate-x <mm> move the drawing right\n"
+		"  --translate-y <mm> move the drawing up\n"
+		"  --trace-extents    only trace the outline of the drawing extents\n"
+		"  --arc-tol <mm>     maximum deviation of G2/G3 arc segments from the arc,\n"
+		"                     default 0.01\n"
+		"  --reorder          reorder (and reverse) strokes to shorten pen-up travel\n"
+		"  --simplify <mm>    drop nearly collinear points from runs of G1 moves,\n"
+		"                     keeping the path within the given distance\n"
+		"  --segment <mm>     split G1 moves so that constant motor speeds between the\n"
+		"                     points stay within the given distance of the line\n"
+		"  --stream           memory map the NC file and parse it while sending;\n"
+		"                     memory use stays constant regardless of file size\n"
+		"  --threads <n>      threads parsing the NC file, default one per core\n"
+		"  --binary           send moves as compact binary frames with CRC and resend\n"
+		"                     on error; falls back to text if the controller lacks them\n"
+		"  --streaming        keep the controller's serial RX buffer full instead of\n"
+		"                     waiting for each line's ok (character counting)\n"
+		"  --rx-buffer <n>    controller RX buffer size for --streaming, default 64\n"
+		"                     (implies --streaming)\n"
+		"  --dry-run          predict the job time, distances and serial load for the\n"
+		"                     flow control and protocol options given, without sending\n"
+		"  --baud <n>         baud rate for --dry-run, default 115200\n"
+		"  --latency <ms>     time from an ok to the next line for --dry-run, default 1\n"
+		"  --log <file>       record every line and frame either way, timestamped, to a\n"
+		"                     binary session log for replay_session, instead of echoing\n"
+		"                     the controller's responses\n"
+		"  --status <hz>      query the controller's real-time status at this rate while\n"
+		"                     sending, 10 to 50 works well, and report its idle time,\n"
+		"                     late steps and block buffer fill; a report is up to 56\n"
+		"                     bytes, so 50 Hz takes a quarter of a 115200 baud link, and\n"
+		"                     205 Hz, the most accepted, all of it";
+};
+
+options parse_options(int argc, const char * argv[])
+{
+	options opt;
+
+	auto read_float = [&](int & arg_idx, optional<float> & value)
+	{
+		if (arg_idx + 1 >= argc)
+		{
+			opt.error = std::string("Missing value for ") + argv[arg_idx];
+			return;
+		}
+
+		try
+		{
+			value = std::stof(argv[++arg_idx]);
+		}
+		catch (const std::exception &)
+		{
+			opt.error = std::string("Invalid value for ") + argv[arg_idx - 1] + ": " + argv[arg_idx];
+		}
+	};
+
+	/* Whole decimal numbers only; "2.5", "-1" or "4x" are errors rather than truncated. */
+	auto read_count = [&](int & arg_idx, optional<size_t> & value)
+	{
+		if (arg_idx + 1 >= argc)
+		{
+			opt.error = std::string("Missing value for ") + argv[arg_idx];
+			return;
+		}
+
+		const std::string text = argv[++arg_idx];
+		size_t parsed = 0;
+		unsigned long count = 0;
+
+		try
+		{
+			if (!text.empty() && text[0] >= '0' && text[0] <= '9')
+				count = std::stoul(text, &parsed);
+		}
+		catch (const std::exception &)
+		{
+		}
+
+		if (parsed == 0 || parsed != text.length())
+			opt.error = std::string("Invalid value for ") + argv[arg_idx - 1] + ": " + text;
+		else
+			value = count;
+	};
+
+	int positional = 0;
+
+	for (int arg_idx = 1; arg_idx < argc && !opt.error; arg_idx++)
+	{
+		const std::string arg = argv[arg_idx];
+
+		if (arg == "--center-x")
+			opt.center_x = true;
+		else if (arg == "--center-y")
+			opt.center_y = true;
+		else if (arg == "--width")
+			read_float(arg_idx, opt.scale_width);
+		else if (arg == "--height")
+			read_float(arg_idx, opt.scale_height);
+		else if (arg == "--rotate")
+			read_float(arg_idx, opt.rotate);
+		else if (arg == "--mirror-x")
+			opt.mirror_x = true;
+		else if (arg == "--mirror-y")
+			opt.mirror_y = true;
+		else if (arg == "--translate-x")
+			read_float(arg_idx, opt.translate_x);
+		else if (arg == "--translate-y")
+			read_float(arg_idx, opt.translate_y);
+		else if (arg == "--trace-extents")
+			opt.trace_extents_only = true;
+		else if (arg == "--arc-tol")
+			read_float(arg_idx, opt.arc_tolerance);
+		else if (arg == "--reorder")
+			opt.reorder = true;
+		else if (arg == "--simplify")
+			read_float(arg_idx, opt.simplify_tolerance);
+		else if (arg == "--segment")
+			read_float(arg_idx, opt.segment_tolerance);
+		else if (arg == "--stream")
+			opt.stream = true;
+		else if (arg == "--threads")
+			read_count(arg_idx, opt.threads);
+		else if (arg == "--binary")
+			opt.binary = true;
+		else if (arg == "--streaming")
+		{
+			if (!opt.rx_buffer)
+				opt.rx_buffer = 64; /* SERIAL_RX_BUFFER_SIZE on AVR Arduinos */
+		}
+		else if (arg == "--rx-buffer")
+			read_count(arg_idx, opt.rx_buffer);
+		else if (arg == "--dry-run")
+			opt.dry_run = true;
+		else if (arg == "--baud")
+			read_float(arg_idx, opt.baud);
+		else if (arg == "--latency")
+			read_float(arg_idx, opt.latency);
+		else if (arg == "--log")
+		{
+			if (arg_idx + 1 < argc)
+				opt.log_path = argv[++arg_idx];
+			else
+				opt.error = "Missing value for --log";
+		}
+		else if (arg == "--status")
+			read_float(arg_idx, opt.status_hz);
+		else if (arg.compare(0, 2, "--") == 0)
+			opt.error = "Unknown option: " + arg;
+		else if (positional == 0)
+			opt.port_identifier = arg;
+		else if (positional == 1)
+			opt.nc_path = arg;
+		else
+			opt.error = "Unexpected argument: " + arg;
+
+		if (arg.compare(0, 2, "--") != 0)
+			positional++;
+	}
+
+	if (!opt.error && opt.arc_tolerance && !(*opt.arc_tolerance > 0.0f))
+		opt.error = "--arc-tol must be positive";
+
+	if (!opt.error && opt.simplify_tolerance && !(*opt.simplify_tolerance > 0.0f))
+		opt.error = "--simplify must be positive";
+
+	if (!opt.error && opt.segment_tolerance && !(*opt.segment_tolerance > 0.0f))
+		opt.error = "--segment must be positive";
+
+	if (!opt.error && opt.threads && *opt.threads < 1)
+		opt.error = "--threads must be at least 1";
+
+	if (!opt.error && opt.rx_buffer && *opt.rx_buffer < 1)
+		opt.error = "--rx-buffer must be positive";
+
+	if (!opt.error && opt.reorder && opt.stream)
+		opt.error = "--reorder cannot be combined with --stream";
+
+	if (!opt.error && opt.baud && !(*opt.baud > 0.0f))
+		opt.error = "--baud must be positive";
+
+	if (!opt.error && opt.latency && !(*opt.latency >= 0.0f))
+		opt.error = "--latency must not be negative";
+
+	if (!opt.error && opt.status_hz && !(*opt.status_hz > 0.0f))
+		opt.error = "--status must be positive";
+
+	if (!opt.error && opt.status_hz && *opt.status_hz > options::max_status_hz)
+		opt.error = "--status must be at most 205, the reports a 115200 baud link carries";
+
+	if (!opt.error && opt.dry_run && positional == 1) /* no port */
+	{
+		opt.nc_path = opt.port_identifier;
+		opt.port_identifier.clear();
+	}
+	else if (!opt.error && positional < 2)
+	{
+		opt.error = "Serial port and NC file are required";
+	}
+
+	return opt;
+}
@@ -9,7 +9,7 @@
 #include <termios.h>
 #include <string.h> // needed for memset
 
-class serial_osx
+class serial_osx : public serial
 {
     int tty_fd = 0;
     
@@ -93,6 +93,17 @@ public:
         return true;
     }
     
+    virtual bool write_bytes(std::string_view bytes)
+    {
+        if (::write(tty_fd, bytes.data(), bytes.length()) != static_cast<ssize_t>(bytes.length()))
+        {
+            std::cout << "write_serial error" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+    
     virtual void sleep(const unsigned int ms) const
     {
         usleep(ms * 1000);
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+#include "words.h"
+#include "parse.h"
+
+/* Parses NC text on several threads, with the same result as feeding every line to one
+   gcode_parser.
+
+   Lines only depend on each other through the modal state: the G20/G21 unit mode and the
+   position arcs start from. The text is split into chunks at line boundaries, and parsed in
+   two parallel passes:
+
+   1. Each chunk is tokenized to find how it changes the modal state: its last G20/G21 and its
+      last X and Y words. Words before the chunk's first G20/G21 are left unconverted.
+   2. A sequential pass over the chunk summaries gives the state every chunk starts in. Then
+      each chunk is parsed in full (arc expansion, extents) from that state.
+
+   The chunks are then joined in order. Each chunk's predicted starting state is checked against
+   the state its predecessor actually ended in, which only differs after an arc that could not
+   be expanded; such a chunk is parsed again from the actual state. */
+class parallel_parser
+{
+	static constexpr size_t min_chunk_bytes = 256 * 1024;
+
+	/* How a chunk changes the modal state. */
+	struct chunk_summary
+	{
+		optional<units> unit;
+		optional<float> x, y;
+		bool x_in_incoming_unit = false; /* seen before the chunk's first G20/G21 */
+		bool y_in_incoming_unit = false;
+
+		modal_state apply(modal_state state) const
+		{
+			auto convert = [&state](float value, bool in_incoming_unit)
+			{
+				return in_incoming_unit && state.unit == units::in ? value * 25.4f : value;
+			};
+
+			if (x)
+				state.x = convert(*x, x_in_incoming_unit);
+
+			if (y)
+				state.y = convert(*y, y_in_incoming_unit);
+
+			if (unit)
+				state.unit = *unit;
+
+			return state;
+		}
+	};
+
+	/* Extents of a chunk's moves, and the state it ends in. */
+	struct chunk_extents
+	{
+		range x = range(1e6f, -1e6f);
+		range y = range(1e6f, -1e6f);
+		modal_state state;
+	};
+
+	std::string_view text;
+	float arc_tolerance;
+	unsigned threads;
+
+	std::vector<std::string_view> chunks;
+
+	template <typename fn>
+	static void for_each_line(std::string_view chunk, fn f)
+	{
+		size_t offset = 0;
+
+		while (offset < chunk.length())
+		{
+			auto line_end = chunk.find('\n', offset);
+			if (line_end == std::string_view::npos)
+				line_end = chunk.length();
+
+			f(chunk.substr(offset, line_end - offset));
+
+			offset = line_end + 1;
+		}
+	}
+
+	/* Runs f(index) for every index below count, spread over the threads. */
+	template <typename fn>
+	void run(size_t count, fn f) const
+	{
+		std::atomic<size_t> next_index{ 0 };
+
+		auto worker = [&]
+		{
+			for (size_t idx; (idx = next_index++) < count;)
+				f(idx);
+		};
+
+		std::vector<std::thread> pool;
+		for (unsigned n = 1; n < std::min<size_t>(threads, count); n++)
+			pool.emplace_back(worker);
+
+		worker();
+
+		for (auto & thread : pool)
+			thread.join();
+	}
+
+	static chunk_summary summarize(std::string_view chunk)
+	{
+		chunk_summary summary;
+
+		for_each_line(chunk, [&summary](std::string_view line)
+		{
+			line = line.substr(0, line.find('\r')); /* as gcode_parser::add */
+
+			const auto words = gcode_words::tokenize(line);
+
+			if (words.has('X'))
+			{
+				const float value = words.get('X');
+				summary.x = summary.unit == units::in ? value * 25.4f : value;
+				summary.x_in_incoming_unit = !summary.unit;
+			}
+
+			if (words.has('Y'))
+			{
+				const float value = words.get('Y');
+				summary.y = summary.unit == units::in ? value * 25.4f : value;
+				summary.y_in_incoming_unit = !summary.unit;
+			}
+
+			const auto g = words.get_int('G');
+			if (g && (*g == 20 || *g == 21))
+				summary.unit = *g == 20 ? units::in : units::mm;
+		});
+
+		return summary;
+	}
+
+	/* Follows the X, Y, I and J words of a chunk from state as gcode_parser::add does, but takes
+	   arcs' extents from their geometry (arc_extents) instead of expanding them. */
+	static chunk_extents scan_chunk(std::string_view chunk, const modal_state & state)
+	{
+		chunk_extents scanned;
+		modal_state & s = scanned.state;
+		s = state;
+
+		for_each_line(chunk, [&](std::string_view line)
+		{
+			line = line.substr(0, line.find('\r'));
+
+			const auto words = gcode_words::tokenize(line);
+			const auto g = words.get_int('G');
+
+			/* Converted in the unit the line is read in, before its own G20/G21. */
+			auto get = [&words, &s](char letter)
+			{
+				return s.unit == units::in ? words.get(letter) * 25.4f : words.get(letter);
+			};
+
+			if (g && (*g == 2 || *g == 3))
+			{
+				if (words.has('X') && words.has('Y') && words.has('I') && words.has('J'))
+				{
+					const pos2 dest(get('X'), get('Y'));
+
+					if (arc_extents(pos2(s.x, s.y), dest, pos2(get('I'), get('J')), *g == 2 ? cw : ccw, scanned.x, scanned.y))
+						std::tie(s.x, s.y) = dest;
+				}
+			}
+			else
+			{
+				if (words.has('X'))
+				{
+					s.x = get('X');
+					scanned.x = range(std::min(scanned.x.first, s.x), std::max(scanned.x.second, s.x));
+				}
+
+				if (words.has('Y'))
+				{
+					s.y = get('Y');
+					scanned.y = range(std::min(scanned.y.first, s.y), std::max(scanned.y.second, s.y));
+				}
+			}
+
+			if (g && (*g == 20 || *g == 21))
+				s.unit = *g == 20 ? units::in : units::mm;
+		});
+
+		return scanned;
+	}
+
+	gcode_parser parse_chunk(std::string_view chunk, const modal_state & state, bool keep_blocks) const
+	{
+		gcode_parser parser;
+		parser.set_arc_tolerance(arc_tolerance);
+		parser.set_modal_state(state);
+
+		for_each_line(chunk, [&](std::string_view line)
+		{
+			parser.add(line);
+
+			if (!keep_blocks)
+				parser.discard();
+		});
+
+		return parser;
+	}
+
+public:
+	parallel_parser(std::string_view text, float arc_tolerance, unsigned threads)
+		: text(text), arc_tolerance(arc_tolerance), threads(std::max(threads, 1u))
+	{
+		const size_t chunk_bytes = std::max(min_chunk_bytes, text.length() / (4 * this->threads) + 1);
+
+		for (size_t offset = 0; offset < text.length();)
+		{
+			auto chunk_end = text.find('\n', std::min(offset + chunk_bytes, text.length()) - 1);
+			chunk_end = chunk_end == std::string_view::npos ? text.length() : chunk_end + 1;
+
+			chunks.push_back(text.substr(offset, chunk_end - offset));
+			offset = chunk_end;
+		}
+	}
+
+	/* Returns a parser holding the blocks of the whole text, or with keep_blocks false, only its
+	   extents and final state. */
+	gcode_parser parse(bool keep_blocks = true) const
+	{
+		if (threads == 1 || chunks.size() <= 1)
+			return parse_chunk(text, modal_state(), keep_blocks); /* the summary pass would only add work */
+
+		std::vector<chunk_summary> summaries(chunks.size());
+		run(chunks.size(), [&](size_t idx) { summaries[idx] = summarize(chunks[idx]); });
+
+		std::vector<modal_state> states(chunks.size());
+		for (size_t idx = 1; idx < chunks.size(); idx++)
+			states[idx] = summaries[idx - 1].apply(states[idx - 1]);
+
+		std::vector<gcode_parser> parsed(chunks.size());
+		run(chunks.size(), [&](size_t idx) { parsed[idx] = parse_chunk(chunks[idx], states[idx], keep_blocks); });
+
+		gcode_parser result = std::move(parsed[0]);
+
+		for (size_t idx = 1; idx < chunks.size(); idx++)
+		{
+			if (!(result.get_modal_state() == states[idx]))
+				parsed[idx] = parse_chunk(chunks[idx], result.get_modal_state(), keep_blocks);
+
+			result.append(parsed[idx]);
+		}
+
+		return result;
+	}
+
+	/* Extents of the whole text's moves, as the parser would report them but for arcs, which
+	   may be up to the arc tolerance wider (see arc_extents). Only the words are read: no block
+	   is built and no arc expanded, so this costs a fraction of parse(). */
+	std::pair<range, range> scan_extents() const
+	{
+		if (threads == 1 || chunks.size() <= 1)
+		{
+			const chunk_extents scanned = scan_chunk(text, modal_state());
+			return std::make_pair(scanned.x, scanned.y);
+		}
+
+		std::vector<chunk_summary> summaries(chunks.size());
+		run(chunks.size(), [&](size_t idx) { summaries[idx] = summarize(chunks[idx]); });
+
+		std::vector<modal_state> states(chunks.size());
+		for (size_t idx = 1; idx < chunks.size(); idx++)
+			states[idx] = summaries[idx - 1].apply(states[idx - 1]);
+
+		std::vector<chunk_extents> scanned(chunks.size());
+		run(chunks.size(), [&](size_t idx) { scanned[idx] = scan_chunk(chunks[idx], states[idx]); });
+
+		range x = scanned[0].x;
+		range y = scanned[0].y;
+
+		for (size_t idx = 1; idx < chunks.size(); idx++)
+		{
+			if (!(scanned[idx - 1].state == states[idx]))
+				scanned[idx] = scan_chunk(chunks[idx], scanned[idx - 1].state);
+
+			x = range(std::min(x.first, scanned[idx].x.first), std::max(x.second, scanned[idx].x.second));
+			y = range(std::min(y.first, scanned[idx].y.first), std::max(y.second, scanned[idx].y.second));
+		}
+
+		return std::make_pair(x, y);
+	}
+};
@@ -2,20 +2,46 @@
 
 #include <list>
 #include <string>
-#include <sstream>
-#include <regex>
+#include <string_view>
+#include <vector>
 
 #include "types.h"
 #include "arc.h"
 #include "block.h"
+#include "toolpath.h"
+#include "simplify.h"
+#include "kinematics.h"
+#include "reorder.h"
 
-class gcode_parser : public std::list<block>
+/* Modal state carried from one NC line to the next. */
+struct modal_state
 {
+	units unit = units::unknown; /* G20/G21 */
+	float x = 0.0f;              /* position in mm */
+	float y = 0.0f;
+
+	bool operator==(const modal_state & other) const
+	{
+		return unit == other.unit && x == other.x && y == other.y;
+	}
+};
+
+/* Parses NC lines into a toolpath, expanding arcs and tracking units and extents. Blocks are
+   consumed in order with front/pop_front. */
+class gcode_parser
+{
+	toolpath path;
+	size_t next = 0; /* index of the next block to be consumed */
+
 	range x_extent = range(1e6f, -1e6f);
 	range y_extent = range(1e6f, -1e6f);
 	
+	units unit = units::unknown;
 	float x = 0.0f;
 	float y = 0.0f;
+
+	float arc_tolerance = default_arc_tolerance; /* mm */
+	std::vector<pos2> arc_points; /* reused for every arc */
     
 	void update_pos(const block & b)
 	{
@@ -23,7 +49,8 @@ class gcode_parser : public std::list<block>
 		{
 			if (val < r.first)
 				r.first = val;
-			else if (val > r.second)
+
+			if (val > r.second)
 				r.second = val;
 		};
 
@@ -41,45 +68,130 @@ class gcode_parser : public std::list<block>
 	}
 
 public:
+	/* Maximum deviation of expanded arcs from the true arc, in mm. */
+	void set_arc_tolerance(float tolerance) { arc_tolerance = tolerance; }
+
 	range get_x_extent() const { return x_extent; }
 	range get_y_extent() const { return y_extent; }
 
+	modal_state get_modal_state() const { return modal_state{ unit, x, y }; }
+
+	/* Continues parsing from the given state, e.g. that of the text before this parser's. */
+	void set_modal_state(const modal_state & state)
+	{
+		unit = state.unit;
+		x = state.x;
+		y = state.y;
+	}
+
+	/* Moves the blocks of other, which parsed the text following this parser's, to the end of
+	   this one, and continues from its state. */
+	void append(const gcode_parser & other)
+	{
+		path.append(other.path);
+
+		x_extent = range(std::min(x_extent.first, other.x_extent.first), std::max(x_extent.second, other.x_extent.second));
+		y_extent = range(std::min(y_extent.first, other.y_extent.first), std::max(y_extent.second, other.y_extent.second));
+
+		set_modal_state(other.get_modal_state());
+	}
+
+	/* Drops all blocks; the state and extents are kept. */
+	void discard()
+	{
+		path.clear();
+		next = 0;
+	}
+
+	const toolpath & get_toolpath() const { return path; }
+
+	/* Position after the last block parsed, before any transform. */
+	pos2 get_position() const { return pos2(x, y); }
+
+	size_t size() const { return path.size() - next; }
+	bool empty() const { return next == path.size(); }
+
+	block front() const { return path.get(next); }
+
+	void pop_front()
+	{
+		if (++next == path.size())
+		{
+			path.clear(); /* everything consumed; reuse the storage */
+			next = 0;
+		}
+	}
+
+	/* Applies m to the stored blocks in place; start is the position before the first one. */
+	void transform(const affine & m, pos2 start = pos2(0.0f, 0.0f))
+	{
+		path.transform(m, start);
+	}
+
+	/* Simplifies the blocks not yet consumed; start is the position before the next one. */
+	size_t simplify(polyline_simplifier & simplifier, pos2 start)
+	{
+		return simplifier.simplify(path, next, start);
+	}
+
+	/* Splits the G1 moves not yet consumed; start is the position before the next one. */
+	size_t segment(kinematic_segmenter & segmenter, pos2 start)
+	{
+		return segmenter.segment(path, next, start);
+	}
+
+	/* Reorders the strokes of the program; only before any block has been consumed. */
+	void reorder(stroke_reorderer & reorderer)
+	{
+		reorderer.reorder(path);
+	}
+
 	void add(const block & b)
 	{
 		update_pos(b);
 
-		push_back(b);
+		path.add(b);
 	}
 
-	void add(const list<block> & blocks)
+	void add(const std::list<block> & blocks)
 	{
-		for (auto b : blocks)
+		for (const auto & b : blocks)
 			add(b);
 	}
 
-	bool add(const std::string & line)
+	bool add(std::string_view line)
 	{
 		if (line.empty())
 			return true;
 		
 		const auto cr_idx = line.find('\r');
-		const auto line_trimmed = line.substr(0, cr_idx != std::string::npos ? cr_idx : line.length());
+		const auto line_trimmed = line.substr(0, cr_idx != std::string_view::npos ? cr_idx : line.length());
 		
 		if (line_trimmed.length() == 0)
 			return true;
-	
-		block b(line_trimmed);
+
+		const auto words = gcode_words::tokenize(line_trimmed);
+
+		/* Comment-only lines are ignored by the controller, so they are not sent at all. Lines
+		   too long for its RX buffer make the sender abort the job (see flow_control). */
+		if (words.empty())
+			return true;
+
+		block b(line_trimmed, words, unit);
 		
 		if (b.g_number && (*b.g_number == 2 || *b.g_number == 3))
 		{
-			auto arc_blocks = move_arc(
+			arc_points.clear();
+			move_arc(
 				pos2(x, y),
 				pos2(*b.x, *b.y),
 				pos2(*b.i, *b.j),
-				0.5f /* tol - mm */,
-				*b.g_number == 2 ? cw : ccw);
-			
-			add(arc_blocks);
+				arc_tolerance,
+				*b.g_number == 2 ? cw : ccw,
+				arc_points);
+
+			for (const auto & point : arc_points)
+				add(block(point, units::mm));
 		}
 		else if (b.g_number && (*b.g_number == 0 || *b.g_number == 1))
 		{
@@ -87,8 +199,8 @@ public:
 		}
 		else if (b.g_number && (*b.g_number == 20 || *b.g_number == 21))
 		{
-			block::new_block_unit = *b.g_number == 20 ? units::in : units::mm;
-			
+			unit = *b.g_number == 20 ? units::in : units::mm;
+
 			add(b);
 		}
 		else
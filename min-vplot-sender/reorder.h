@@ -0,0 +1,542 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+#include "words.h"
+#include "toolpath.h"
+
+/* Totals from stroke_reorderer; pen-up travel is measured as straight lines between strokes. */
+struct reorder_stats
+{
+	size_t strokes = 0;
+	size_t reversed = 0;
+
+	double travel_before = 0.0; /* mm */
+	double travel_after = 0.0;  /* mm */
+
+	/* Set when the program could not be reordered safely; nothing was changed. */
+	optional<std::string> skipped;
+};
+
+/* Nearest neighbour lookup over stroke end points in a uniform grid. Points are stored per
+   cell in one array; removing a point swaps it with the last live point of its cell. The grid
+   is rebuilt coarser as it empties, so searches do not crawl over empty cells. */
+class endpoint_grid
+{
+	std::vector<pos2> points;
+	std::vector<uint8_t> live;
+
+	float min_x = 0.0f, min_y = 0.0f, cell = 1.0f;
+	int nx = 1, ny = 1;
+
+	std::vector<uint32_t> cell_begin; /* nx * ny + 1 offsets into ids */
+	std::vector<uint32_t> cell_end;
+	std::vector<uint32_t> ids;
+	std::vector<uint32_t> slot;       /* position of each live point in ids */
+
+	size_t live_count = 0;
+
+	int cell_x(float x) const { return std::min(nx - 1, std::max(0, static_cast<int>((x - min_x) / cell))); }
+	int cell_y(float y) const { return std::min(ny - 1, std::max(0, static_cast<int>((y - min_y) / cell))); }
+
+	void build()
+	{
+		float max_x = -1e30f, max_y = -1e30f;
+		min_x = min_y = 1e30f;
+
+		for (size_t id = 0; id < points.size(); id++)
+		{
+			if (!live[id])
+				continue;
+
+			min_x = std::min(min_x, points[id].first);
+			min_y = std::min(min_y, points[id].second);
+			max_x = std::max(max_x, points[id].first);
+			max_y = std::max(max_y, points[id].second);
+		}
+
+		/* About two points per cell. */
+		const float width = std::max(max_x - min_x, 1e-3f), height = std::max(max_y - min_y, 1e-3f);
+		cell = std::max(std::sqrt(width * height * 2.0f / std::max<size_t>(live_count, 1)), 1e-3f);
+		nx = std::min(4096, static_cast<int>(width / cell) + 1);
+		ny = std::min(4096, static_cast<int>(height / cell) + 1);
+
+		cell_begin.assign(static_cast<size_t>(nx) * ny + 1, 0);
+
+		for (size_t id = 0; id < points.size(); id++)
+			if (live[id])
+				cell_begin[cell_y(points[id].second) * nx + cell_x(points[id].first) + 1]++;
+
+		for (size_t c = 1; c < cell_begin.size(); c++)
+			cell_begin[c] += cell_begin[c - 1];
+
+		cell_end.assign(cell_begin.begin(), cell_begin.end() - 1);
+		ids.resize(live_count);
+
+		for (size_t id = 0; id < points.size(); id++)
+		{
+			if (!live[id])
+				continue;
+
+			const auto c = cell_y(points[id].second) * nx + cell_x(points[id].first);
+			slot[id] = cell_end[c];
+			ids[cell_end[c]++] = static_cast<uint32_t>(id);
+		}
+	}
+
+public:
+	/* Points may be excluded from the start with enabled[id] == 0. */
+	endpoint_grid(std::vector<pos2> points, const std::vector<uint8_t> & enabled)
+		: points(std::move(points)), live(enabled), slot(this->points.size())
+	{
+		live_count = std::count(live.begin(), live.end(), 1);
+		build();
+	}
+
+	bool empty() const { return live_count == 0; }
+
+	void remove(uint32_t id)
+	{
+		if (!live[id])
+			return;
+
+		const auto c = cell_y(points[id].second) * nx + cell_x(points[id].first);
+		const uint32_t last = ids[--cell_end[c]];
+
+		ids[slot[id]] = last;
+		slot[last] = slot[id];
+
+		live[id] = 0;
+		live_count--;
+
+		if (live_count > 0 && live_count * 8 < cell_end.size() && cell_end.size() > 64)
+			build();
+	}
+
+	/* Closest live point to p; the grid must not be empty. */
+	uint32_t nearest(pos2 p) const
+	{
+		const int cx = cell_x(p.first), cy = cell_y(p.second);
+
+		uint32_t best = 0;
+		float best_sq = 1e30f;
+		bool found = false;
+
+		for (int ring = 0; ring <= std::max(nx, ny); ring++)
+		{
+			if (found)
+			{
+				/* Points in this ring are at least (ring - 1) cells away from p. */
+				const float reach = (ring - 1) * cell;
+				if (reach > 0.0f && reach * reach > best_sq)
+					break;
+			}
+
+			for (int y = cy - ring; y <= cy + ring; y++)
+			{
+				if (y < 0 || y >= ny)
+					continue;
+
+				const bool edge_row = y == cy - ring || y == cy + ring;
+
+				for (int x = cx - ring; x <= cx + ring; x += edge_row ? 1 : 2 * ring)
+				{
+					if (x >= 0 && x < nx)
+					{
+						const auto c = y * nx + x;
+
+						for (uint32_t n = cell_begin[c]; n < cell_end[c]; n++)
+						{
+							const pos2 & q = points[ids[n]];
+							const float dx = q.first - p.first, dy = q.second - p.second;
+							const float d_sq = dx * dx + dy * dy;
+
+							if (d_sq < best_sq)
+							{
+								best_sq = d_sq;
+								best = ids[n];
+								found = true;
+							}
+						}
+					}
+
+					if (ring == 0)
+						break;
+				}
+			}
+		}
+
+		return best;
+	}
+};
+
+/* Reorders the strokes of a toolpath to shorten pen-up travel.
+
+   The program is split at travel moves: moves made with the pen lifted, after an M3 and until
+   the next M code other than M0, which lowers it as in the firmware (see frame_encoder). G0
+   does not lift the pen, as the firmware draws it like G1, so a G0 with the pen down is a
+   drawing move and strokes joined by one stay together. A stroke is a run of travel moves followed by everything up to the next
+   travel move; the travel moves are replaced by a single move to wherever the stroke is entered
+   from. Blocks before the first travel move and a trailing part without drawing moves stay in
+   place. A stroke may be drawn backwards if all its drawing moves are consecutive G1 moves with
+   X and Y; any other blocks before and after them keep their place at the stroke's ends.
+
+   Strokes are chained greedily, each time picking the closest free end point, then improved by
+   2-opt moves reversing runs of up to two_opt_window strokes. Reordering needs every stroke to
+   start and end with the pen lifted or every stroke to start and end with it down, as the pen
+   state carries over from one stroke to the next; otherwise the toolpath is left unchanged. */
+class stroke_reorderer
+{
+	static constexpr size_t two_opt_window = 64;
+	static constexpr int two_opt_passes = 4;
+
+	struct stroke
+	{
+		uint32_t begin;        /* first travel move */
+		uint32_t body;         /* first block after the travel moves */
+		uint32_t motion_begin; /* drawing moves, if reversible */
+		uint32_t motion_end;
+		uint32_t end;
+
+		pos2 start;            /* position when the travel moves are done */
+		pos2 finish;           /* position at the end of the stroke */
+
+		bool reversible;
+	};
+
+	std::vector<stroke> strokes;
+	size_t prefix_end = 0;
+	size_t suffix_begin = 0;
+	pos2 origin;
+
+	std::vector<uint32_t> order;
+	std::vector<uint8_t> reversed;
+
+	static double distance(pos2 a, pos2 b)
+	{
+		return std::hypot(static_cast<double>(a.first) - b.first, static_cast<double>(a.second) - b.second);
+	}
+
+	pos2 entry(size_t k) const { return reversed[k] ? strokes[order[k]].finish : strokes[order[k]].start; }
+	pos2 exit(size_t k) const { return reversed[k] ? strokes[order[k]].start : strokes[order[k]].finish; }
+
+	double travel() const
+	{
+		double total = 0.0;
+		pos2 at = origin;
+
+		for (size_t k = 0; k < order.size(); k++)
+		{
+			total += distance(at, entry(k));
+			at = exit(k);
+		}
+
+		return total;
+	}
+
+	/* Splits path into strokes; false with a reason if it cannot be reordered. */
+	bool split(const toolpath & path, std::string & reason)
+	{
+		float x = 0.0f, y = 0.0f;
+		bool lifted = true;   /* the controller starts with the pen up */
+		int motion_mode = 0;  /* modal G0/G1; only G1 runs are reversed */
+
+		bool in_stroke = false, drawing = false, in_travel = false;
+		bool state_known = false, stroke_lifted = true, stroke_start_lifted = true;
+
+		stroke current{};
+
+		auto finish_stroke = [&](uint32_t end)
+		{
+			current.end = end;
+			current.finish = pos2(x, y);
+
+			if (current.motion_begin == current.motion_end)
+				current.reversible = false;
+
+			if (!state_known)
+			{
+				stroke_lifted = stroke_start_lifted;
+				state_known = true;
+			}
+
+			if (stroke_start_lifted != stroke_lifted || lifted != stroke_lifted)
+				return false;
+
+			strokes.push_back(current);
+			return true;
+		};
+
+		for (size_t idx = 0; idx < path.size(); idx++)
+		{
+			const uint8_t f = path.flags[idx];
+
+			optional<int> g, m;
+			if (f & toolpath::passthrough)
+			{
+				const auto words = gcode_words::tokenize(path.passthrough_line(idx));
+				g = words.get_int('G');
+				m = words.get_int('M');
+			}
+			else
+			{
+				if (f & toolpath::has_g)
+					g = path.g_codes[idx];
+
+				if (f & toolpath::has_m)
+					m = path.m_codes[idx];
+			}
+
+			if (g && (*g == 0 || *g == 1))
+				motion_mode = *g;
+
+			const bool motion = !(f & toolpath::passthrough) && (f & (toolpath::has_x | toolpath::has_y));
+			const bool travel = motion && !m && lifted;
+
+			if (travel && (!in_stroke || drawing))
+			{
+				if (in_stroke && !finish_stroke(static_cast<uint32_t>(idx)))
+				{
+					reason = "pen state differs between strokes";
+					return false;
+				}
+
+				if (!in_stroke)
+					prefix_end = idx;
+
+				current = stroke{};
+				current.begin = static_cast<uint32_t>(idx);
+				current.reversible = true;
+
+				stroke_start_lifted = lifted;
+				in_stroke = in_travel = true;
+				drawing = false;
+			}
+			else if (in_travel && !travel)
+			{
+				in_travel = false;
+				current.body = static_cast<uint32_t>(idx);
+				current.start = pos2(x, y);
+			}
+
+			if (in_stroke && !in_travel && motion)
+			{
+				if (travel)
+				{
+					current.reversible = false; /* pen-up moves before the first drawing move */
+				}
+				else
+				{
+					const bool plain_g1 = !m && motion_mode == 1 && (f & toolpath::has_x) && (f & toolpath::has_y);
+
+					if (!drawing)
+						current.motion_begin = current.motion_end = static_cast<uint32_t>(idx);
+
+					if (!plain_g1 || current.motion_end != idx)
+						current.reversible = false; /* other blocks between the drawing moves */
+
+					current.motion_end = static_cast<uint32_t>(idx + 1);
+					drawing = true;
+				}
+			}
+
+			if (motion)
+			{
+				if (f & toolpath::has_x)
+					x = path.xs[idx];
+
+				if (f & toolpath::has_y)
+					y = path.ys[idx];
+			}
+
+			if (m && *m != 0)
+				lifted = *m == 3;
+
+			if (!in_stroke)
+				origin = pos2(x, y);
+		}
+
+		if (in_stroke && in_travel)
+		{
+			current.body = static_cast<uint32_t>(path.size());
+			current.start = pos2(x, y);
+		}
+
+		suffix_begin = in_stroke ? (drawing ? path.size() : current.begin) : path.size();
+
+		if (in_stroke && drawing && !finish_stroke(static_cast<uint32_t>(path.size())))
+		{
+			reason = "pen state differs between strokes";
+			return false;
+		}
+
+		if (!in_stroke)
+			prefix_end = path.size();
+
+		return true;
+	}
+
+	void chain_nearest()
+	{
+		std::vector<pos2> points(2 * strokes.size());
+		std::vector<uint8_t> enabled(2 * strokes.size(), 1);
+
+		for (size_t s = 0; s < strokes.size(); s++)
+		{
+			points[2 * s] = strokes[s].start;
+			points[2 * s + 1] = strokes[s].finish;
+			enabled[2 * s + 1] = strokes[s].reversible;
+		}
+
+		endpoint_grid grid(points, enabled);
+
+		order.clear();
+		reversed.clear();
+
+		pos2 at = origin;
+
+		while (!grid.empty())
+		{
+			const uint32_t id = grid.nearest(at);
+			const uint32_t s = id / 2;
+
+			grid.remove(2 * s);
+			grid.remove(2 * s + 1);
+
+			order.push_back(s);
+			reversed.push_back(id & 1);
+
+			at = (id & 1) ? strokes[s].start : strokes[s].finish;
+		}
+	}
+
+	void two_opt()
+	{
+		const size_t n = order.size();
+
+		for (int pass = 0; pass < two_opt_passes; pass++)
+		{
+			bool improved = false;
+
+			for (size_t i = 0; i < n; i++)
+			{
+				if (!strokes[order[i]].reversible)
+					continue;
+
+				const pos2 before = i > 0 ? exit(i - 1) : origin;
+
+				for (size_t j = i; j < n && j < i + two_opt_window; j++)
+				{
+					if (!strokes[order[j]].reversible)
+						break; /* every stroke in [i, j] gets reversed */
+
+					const double old_cost = distance(before, entry(i)) + (j + 1 < n ? distance(exit(j), entry(j + 1)) : 0.0);
+					const double new_cost = distance(before, exit(j)) + (j + 1 < n ? distance(entry(i), entry(j + 1)) : 0.0);
+
+					if (new_cost < old_cost - 1e-6)
+					{
+						std::reverse(order.begin() + i, order.begin() + j + 1);
+						std::reverse(reversed.begin() + i, reversed.begin() + j + 1);
+
+						for (size_t k = i; k <= j; k++)
+							reversed[k] = !reversed[k];
+
+						improved = true;
+					}
+				}
+			}
+
+			if (!improved)
+				break;
+		}
+	}
+
+	/* Copies the blocks of path into out in the new stroke order. */
+	void rebuild(const toolpath & path, toolpath & out) const
+	{
+		out.reserve(path.size());
+
+		for (size_t idx = 0; idx < prefix_end; idx++)
+			out.add(path.get(idx));
+
+		for (size_t k = 0; k < order.size(); k++)
+		{
+			const stroke & s = strokes[order[k]];
+
+			/* One move in place of the travel moves, keeping the last one's G/M words. */
+			block travel = path.get(s.body - 1);
+			const pos2 to = entry(k);
+			travel.x = to.first;
+			travel.y = to.second;
+			out.add(travel);
+
+			if (!reversed[k])
+			{
+				for (size_t idx = s.body; idx < s.end; idx++)
+					out.add(path.get(idx));
+
+				continue;
+			}
+
+			for (size_t idx = s.body; idx < s.motion_begin; idx++)
+				out.add(path.get(idx));
+
+			/* Back through the points the drawing moves started from. */
+			for (size_t idx = s.motion_end - 1; idx > s.motion_begin; idx--)
+				out.add(block(pos2(path.xs[idx - 1], path.ys[idx - 1])));
+
+			out.add(block(s.start));
+
+			for (size_t idx = s.motion_end; idx < s.end; idx++)
+				out.add(path.get(idx));
+		}
+
+		for (size_t idx = suffix_begin; idx < path.size(); idx++)
+			out.add(path.get(idx));
+	}
+
+public:
+	reorder_stats stats;
+
+	void reorder(toolpath & path)
+	{
+		std::string reason;
+
+		if (!split(path, reason))
+		{
+			stats.skipped = reason;
+			return;
+		}
+
+		stats.strokes = strokes.size();
+
+		order.resize(strokes.size());
+		reversed.assign(strokes.size(), 0);
+		for (size_t s = 0; s < strokes.size(); s++)
+			order[s] = static_cast<uint32_t>(s);
+
+		stats.travel_before = travel();
+
+		if (strokes.size() < 2)
+		{
+			stats.travel_after = stats.travel_before;
+			return;
+		}
+
+		chain_nearest();
+		two_opt();
+
+		stats.travel_after = travel();
+		stats.reversed = std::count(reversed.begin(), reversed.end(), 1);
+
+		toolpath out;
+		rebuild(path, out);
+		path = std::move(out);
+	}
+};
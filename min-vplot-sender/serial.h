@@ -2,11 +2,19 @@
 
 #include "types.h"
 
+#include <algorithm>
 #include <string>
+#include <string_view>
 
 class serial
 {
+	/* Received text not yet returned by read_line; consumed lines are dropped lazily. */
+	std::string input;
+	size_t consumed = 0;
+
 public:
+	virtual ~serial() {}
+
 	virtual bool setup(const std::string & port_str) = 0;
 
 	virtual optional<std::string> read() const = 0;
@@ -17,4 +25,51 @@ public:
     }
 
 	virtual void sleep(const unsigned int ms) const = 0;
+
+	/* Line based interface used by the send loop. The defaults poll read() and write each line
+	   immediately; event driven backends override all four. */
+
+	/* Waits until input may be available, at most timeout_ms; false on a port error. */
+	virtual bool wait(unsigned int timeout_ms)
+	{
+		sleep(std::min(timeout_ms, 1u)); // polling backends keep their 1 ms cadence
+
+		const auto result = read();
+		if (!result)
+			return false;
+
+		input.erase(0, consumed);
+		consumed = 0;
+		input.append(*result);
+
+		return true;
+	}
+
+	/* Next complete line received, without its "\r\n"; valid until the next wait(). */
+	virtual optional<std::string_view> read_line()
+	{
+		const auto line_end = input.find("\r\n", consumed);
+		if (line_end == std::string::npos)
+			return nullopt;
+
+		const std::string_view line(input.data() + consumed, line_end - consumed);
+		consumed = line_end + 2;
+
+		return line;
+	}
+
+	/* Sends bytes as they are, e.g. a binary frame; event driven backends queue them as write_line. */
+	virtual bool write_bytes(std::string_view bytes) = 0;
+
+	/* Queues a line for sending; the line ending is added. */
+	virtual bool write_line(std::string_view line)
+	{
+		return write(std::string(line));
+	}
+
+	/* Sends all queued lines. */
+	virtual bool flush()
+	{
+		return true;
+	}
 };
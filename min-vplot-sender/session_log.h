@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* Binary record of the messages on a serial session, written by the sender with --log and read
+   by tools/replay_session. After an 8 byte header ("MVPLOG" and a version, 1, and a zero), each
+   message is one record:
+
+   - its kind: 's' a line sent, 'b' bytes sent as they are (a binary frame), 'q' a status query
+     (see ../status.h), 'r' a line received,
+   - the microseconds since the record before (since the session started for the first one),
+   - its length, then its bytes: lines without their "\r\n".
+
+   The two numbers are unsigned LEB128, seven bits per byte, least significant first, so a
+   typical record takes three bytes besides the message itself. */
+namespace session_log
+{
+	static constexpr char header[8] = { 'M', 'V', 'P', 'L', 'O', 'G', 1, 0 };
+
+	enum kind : char
+	{
+		line_sent = 's',
+		bytes_sent = 'b',
+		query_sent = 'q',
+		line_received = 'r',
+	};
+
+	struct record
+	{
+		kind type;
+		uint64_t t_us; /* since the session started */
+		std::string_view data;
+	};
+
+	/* Writes records through a buffer, so that the send loop does not wait for the disk on every
+	   message; the file is written a block at a time and when closed. A failed write does not
+	   stop the session; ok() tells after close() whether the whole log reached the file. */
+	class writer
+	{
+		static constexpr size_t flush_size = 1 << 16;
+
+		FILE * file = nullptr;
+		std::vector<char> buf;
+		uint64_t last_us = 0;
+		bool failed = false;
+
+		void put_number(uint64_t value)
+		{
+			for (; value >= 0x80; value >>= 7)
+				buf.push_back(static_cast<char>((value & 0x7f) | 0x80));
+
+			buf.push_back(static_cast<char>(value));
+		}
+
+	public:
+		writer() {}
+		writer(const writer &) = delete;
+		writer & operator=(const writer &) = delete;
+
+		~writer()
+		{
+			close();
+		}
+
+		bool open(const std::string & path)
+		{
+			close();
+
+			file = std::fopen(path.c_str(), "wb");
+			if (!file)
+				return false;
+
+			buf.reserve(flush_size + 256);
+			buf.assign(header, header + sizeof(header));
+			last_us = 0;
+			failed = false;
+
+			return true;
+		}
+
+		bool is_open() const { return file != nullptr; }
+		bool ok() const { return !failed; }
+
+		/* A message at t_us, not before the one added last. */
+		void add(kind type, uint64_t t_us, std::string_view data)
+		{
+			if (!file)
+				return;
+
+			buf.push_back(type);
+			put_number(t_us - last_us);
+			put_number(data.length());
+			buf.insert(buf.end(), data.begin(), data.end());
+
+			last_us = t_us;
+
+			if (buf.size() >= flush_size)
+				flush();
+		}
+
+		void flush()
+		{
+			if (file && !buf.empty() && std::fwrite(buf.data(), 1, buf.size(), file) != buf.size())
+				failed = true;
+
+			buf.clear();
+		}
+
+		void close()
+		{
+			if (!file)
+				return;
+
+			flush();
+			if (std::fclose(file) != 0)
+				failed = true;
+			file = nullptr;
+		}
+	};
+
+	/* Reads the records of a log in memory (usually a mapped_file view). */
+	class reader
+	{
+		std::string_view text;
+		size_t offset = 0;
+		uint64_t t_us = 0;
+
+		bool get_number(uint64_t & value)
+		{
+			value = 0;
+
+			for (int shift = 0; offset < text.length() && shift < 64; shift += 7)
+			{
+				const uint8_t byte = static_cast<uint8_t>(text[offset++]);
+				value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+				if (!(byte & 0x80))
+					return true;
+			}
+
+			return false;
+		}
+
+	public:
+		/* False if text does not start with a log header. */
+		bool open(std::string_view log)
+		{
+			text = log;
+			offset = sizeof(header);
+			t_us = 0;
+
+			return text.substr(0, sizeof(header)) == std::string_view(header, sizeof(header));
+		}
+
+		/* The next record; false at the end of the log, or at a record cut short (the sender
+		   stopped while writing it). */
+		bool next(record & r)
+		{
+			uint64_t delta_us = 0, length = 0;
+
+			if (offset >= text.length())
+				return false;
+
+			r.type = static_cast<kind>(text[offset++]);
+
+			if (!get_number(delta_us) || !get_number(length) || length > text.length() - offset)
+				return false;
+
+			t_us += delta_us;
+
+			r.t_us = t_us;
+			r.data = text.substr(offset, length);
+			offset += length;
+
+			return true;
+		}
+	};
+}
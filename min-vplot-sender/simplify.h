@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+#include "toolpath.h"
+
+/* Counts kept by a polyline_simplifier over all the toolpaths it has processed. */
+struct simplify_stats
+{
+	size_t blocks = 0;
+	size_t removed = 0;
+
+	/* Each block sent costs about one serial round trip and a stop at its end point on the
+	   controller; ~2 ms per block against the stand-in controller at 115200 baud. */
+	static constexpr double block_overhead_s = 0.002;
+
+	double estimated_time_saved_s() const { return removed * block_overhead_s; }
+};
+
+/* Removes nearly collinear points from runs of G1 moves with Ramer-Douglas-Peucker, keeping
+   the drawn path within tolerance (mm) of the original.
+
+   A run is a sequence of consecutive G1 blocks with both X and Y and no M code; anything else
+   (G0, pen changes, passthrough lines) ends it and is left alone. Runs are simplified in
+   windows of at most max_window points sharing their end points, which bounds the quadratic
+   worst case of RDP and keeps the cost linear in the length of the toolpath. */
+class polyline_simplifier
+{
+	static constexpr size_t max_window = 256;
+
+	float tolerance;
+
+	std::vector<size_t> run;        /* toolpath indices of the current run */
+	std::vector<float> px, py;      /* run points, preceded by the position the run starts from */
+	std::vector<uint8_t> keep_point;
+	std::vector<std::pair<size_t, size_t>> stack;
+
+	/* Squared distance from p to the segment a-b. */
+	static float distance_sq(float x, float y, float ax, float ay, float bx, float by)
+	{
+		const float vx = bx - ax, vy = by - ay;
+		const float wx = x - ax, wy = y - ay;
+
+		const float len_sq = vx * vx + vy * vy;
+		const float t = len_sq > 0.0f ? std::min(1.0f, std::max(0.0f, (wx * vx + wy * vy) / len_sq)) : 0.0f;
+
+		const float dx = wx - t * vx, dy = wy - t * vy;
+		return dx * dx + dy * dy;
+	}
+
+	/* Marks the points of [first, last] to keep; both end points are always kept. */
+	void simplify_window(size_t first, size_t last)
+	{
+		const float tolerance_sq = tolerance * tolerance;
+
+		keep_point[first] = keep_point[last] = 1;
+
+		stack.clear();
+		stack.emplace_back(first, last);
+
+		while (!stack.empty())
+		{
+			const auto [a, b] = stack.back();
+			stack.pop_back();
+
+			float max_sq = tolerance_sq;
+			size_t farthest = 0;
+
+			for (size_t idx = a + 1; idx < b; idx++)
+			{
+				const float d_sq = distance_sq(px[idx], py[idx], px[a], py[a], px[b], py[b]);
+
+				if (d_sq > max_sq)
+				{
+					max_sq = d_sq;
+					farthest = idx;
+				}
+			}
+
+			if (farthest)
+			{
+				keep_point[farthest] = 1;
+				stack.emplace_back(a, farthest);
+				stack.emplace_back(farthest, b);
+			}
+		}
+	}
+
+	void flush_run(std::vector<uint8_t> & keep)
+	{
+		if (run.size() > 1)
+		{
+			keep_point.assign(px.size(), 0);
+
+			for (size_t first = 0; first + 1 < px.size(); first += max_window - 1)
+				simplify_window(first, std::min(first + max_window - 1, px.size() - 1));
+
+			for (size_t idx = 0; idx < run.size(); idx++)
+				keep[run[idx]] = keep_point[idx + 1];
+		}
+
+		run.clear();
+		px.clear();
+		py.clear();
+	}
+
+public:
+	simplify_stats stats;
+
+	polyline_simplifier(float tolerance) : tolerance(tolerance) {}
+
+	/* Simplifies the blocks of path from index begin on; start is the position the machine is
+	   at before path[begin]. Returns the number of blocks removed. */
+	size_t simplify(toolpath & path, size_t begin, pos2 start)
+	{
+		std::vector<uint8_t> keep(path.size(), 1);
+
+		float x = start.first;
+		float y = start.second;
+
+		constexpr uint8_t run_mask = toolpath::passthrough | toolpath::has_x | toolpath::has_y | toolpath::has_g | toolpath::has_m;
+		constexpr uint8_t run_flags = toolpath::has_x | toolpath::has_y | toolpath::has_g;
+
+		for (size_t idx = begin; idx < path.size(); idx++)
+		{
+			const uint8_t f = path.flags[idx];
+
+			if ((f & run_mask) == run_flags && path.g_codes[idx] == 1)
+			{
+				if (run.empty())
+				{
+					px.push_back(x);
+					py.push_back(y);
+				}
+
+				run.push_back(idx);
+				px.push_back(x = path.xs[idx]);
+				py.push_back(y = path.ys[idx]);
+				continue;
+			}
+
+			flush_run(keep);
+
+			if (f & toolpath::passthrough)
+				continue;
+
+			if (f & toolpath::has_x)
+				x = path.xs[idx];
+
+			if (f & toolpath::has_y)
+				y = path.ys[idx];
+		}
+
+		flush_run(keep);
+
+		const size_t before = path.size();
+		path.retain(keep);
+
+		stats.blocks += before - begin;
+		stats.removed += before - path.size();
+
+		return before - path.size();
+	}
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string_view>
+
+#include "types.h"
+#include "block.h"
+#include "parse.h"
+#include "parallel_parse.h"
+
+/* Parses NC text lazily as blocks are consumed, so only the blocks of the current line (one
+   line, or the segments of one expanded arc) or of one simplification window are held in
+   memory at a time. The text is usually a mapped_file view. Offers the empty/front/pop_front
+   subset of gcode_parser used for sending. */
+class gcode_stream
+{
+	std::string_view text;
+	size_t offset = 0;
+
+	gcode_parser parser;
+
+	affine transformation;
+	polyline_simplifier * simplifier = nullptr;
+	kinematic_segmenter * segmenter = nullptr;
+	bool started = false;
+
+	/* Blocks parsed ahead for simplification, so runs are only split every few thousand points. */
+	static constexpr size_t simplify_window = 4096;
+
+	/* Once all pending blocks are consumed, parses lines until at least one block is pending
+	   (a window of them when simplifying) or the text is exhausted. */
+	void fill()
+	{
+		if (!parser.empty() || offset >= text.length())
+			return;
+
+		const pos2 position = parser.get_position();
+		const size_t target = simplifier ? simplify_window : 1;
+
+		while (parser.size() < target && offset < text.length())
+		{
+			auto line_end = text.find('\n', offset);
+			if (line_end == std::string_view::npos)
+				line_end = text.length();
+
+			parser.add(text.substr(offset, line_end - offset));
+
+			offset = line_end + 1;
+		}
+
+		if (!transformation.identity())
+			parser.transform(transformation, position);
+
+		/* The machine starts at the origin; later windows continue from the last point sent. */
+		const pos2 start = started ? transformation.apply(position) : pos2(0.0f, 0.0f);
+
+		if (simplifier)
+			parser.simplify(*simplifier, start);
+
+		if (segmenter)
+			parser.segment(*segmenter, start);
+
+		started = true;
+	}
+
+public:
+	gcode_stream(std::string_view text, float arc_tolerance = default_arc_tolerance) : text(text)
+	{
+		parser.set_arc_tolerance(arc_tolerance);
+	}
+
+	/* Applies m to blocks as they are parsed. */
+	void set_transform(const affine & m) { transformation = m; }
+
+	/* Simplifies G1 runs with s, which keeps the running totals; s must outlive the stream. */
+	void set_simplifier(polyline_simplifier * s) { simplifier = s; }
+
+	/* Splits G1 moves with s after simplifying; s must outlive the stream. */
+	void set_segmenter(kinematic_segmenter * s) { segmenter = s; }
+
+	bool empty()
+	{
+		fill();
+		return parser.empty();
+	}
+
+	block front()
+	{
+		fill();
+		return parser.front();
+	}
+
+	void pop_front()
+	{
+		parser.pop_front();
+	}
+
+	/* Extents of the blocks parsed so far; complete once the stream has been drained. */
+	range get_x_extent() const { return parser.get_x_extent(); }
+	range get_y_extent() const { return parser.get_y_extent(); }
+
+	/* Fast pre-scan of the whole text on the given number of threads for its extents, reading
+	   only the coordinate words (see parallel_parser::scan_extents). */
+	static std::pair<range, range> scan_extents(std::string_view text, unsigned threads = 1)
+	{
+		return parallel_parser(text, default_arc_tolerance, threads).scan_extents();
+	}
+};
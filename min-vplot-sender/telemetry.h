@@ -0,0 +1,334 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <ostream>
+#include <string_view>
+
+#include "../status.h"
+
+/* Counts of durations in microseconds by power of two: bin k holds those over 2^(k-1) and up to
+   2^k us (bin 0 up to 1 us), so 32 bins reach past an hour. */
+struct log2_histogram
+{
+	static constexpr size_t bin_count = 32;
+
+	uint64_t counts[bin_count] = {};
+	uint64_t count = 0;
+	uint64_t sum_us = 0;
+	uint64_t max_us = 0;
+
+	static uint64_t bound_us(size_t bin) { return uint64_t(1) << bin; }
+
+	void add(uint64_t us)
+	{
+		size_t bin = 0;
+		while (bin + 1 < bin_count && bound_us(bin) < us)
+			bin++;
+
+		counts[bin]++;
+		count++;
+		sum_us += us;
+		max_us = std::max(max_us, us);
+	}
+
+	/* Upper bound of the bin holding the given fraction of the durations, at most the longest. */
+	uint64_t percentile_us(double fraction) const
+	{
+		uint64_t seen = 0;
+
+		for (size_t bin = 0; bin < bin_count; bin++)
+		{
+			seen += counts[bin];
+
+			if (seen > 0 && seen >= fraction * count)
+				return std::min(bound_us(bin), max_us);
+		}
+
+		return max_us;
+	}
+};
+
+/* What the sender saw of the link, from link_telemetry. */
+struct link_stats
+{
+	uint64_t starve_us = 0; /* idle gaps longer than this are counted as starving the controller */
+	uint64_t stall_us = 0;  /* silences longer than this with lines in flight are counted as stalls */
+
+	uint64_t start_us = 0;  /* "Ready" */
+	uint64_t end_us = 0;    /* the last message either way */
+
+	size_t sent = 0;        /* lines and frames */
+	size_t bytes_sent = 0;
+	size_t bytes_received = 0;
+	size_t peak_bytes_per_s = 0; /* sent in one second of the session */
+
+	size_t answers = 0;     /* "ok" */
+	size_t errors = 0;
+	size_t resend_requests = 0; /* "rs <n>" */
+	size_t discarded = 0;   /* lines or frames in flight at a resend request, never answered */
+
+	/* Send to answer, for each line or frame answered. */
+	log2_histogram round_trip;
+
+	/* Nothing in flight: from the answer emptying the window to the next send. The controller
+	   has read all it was sent, and only has its block buffer left to run. */
+	uint64_t idle_us = 0;
+	size_t idle_gaps = 0;
+	size_t starved = 0;
+	uint64_t longest_idle_us = 0;
+
+	/* Lines in flight, nothing received: a long move or pen change holding up the buffer, or
+	   a lost line or frame. */
+	size_t stalls = 0;
+	uint64_t longest_silence_us = 0;
+
+	/* The controller's "dwell: <ms> ms in <n> pen changes", sent whenever it comes to rest after
+	   pen changes and covering those since the report before, summed over the job. A rest before
+	   the last line was sent means it ran out of blocks. */
+	uint64_t dwell_ms = 0;
+	size_t pen_changes = 0;
+	size_t rests = 0;
+	size_t rests_mid_job = 0;
+
+	/* With --status: the queries and their reports (see ../status.h), and what the reports tell
+	   between the first and the last one. */
+	size_t status_queries = 0;
+	size_t status_reports = 0;
+	log2_histogram status_round_trip;
+	uint64_t controller_idle_ms = 0; /* the stepper ISR had nothing to execute */
+	uint64_t late_steps = 0;
+	size_t min_blocks = 0;
+	uint64_t blocks_sum = 0;
+};
+
+std::ostream & operator<<(std::ostream & of, const link_stats & s)
+{
+	const double wall_s = s.end_us > s.start_us ? (s.end_us - s.start_us) / 1e6 : 0.0;
+	const auto & rt = s.round_trip;
+
+	const auto flags = of.flags();
+	const auto precision = of.precision();
+	of << std::fixed << std::setprecision(1);
+
+	of << "Link: " << s.sent << " lines and frames in " << wall_s << " s; " << s.bytes_sent << " bytes sent ("
+		<< (wall_s > 0.0 ? s.bytes_sent / wall_s : 0.0) << " per s, peak " << s.peak_bytes_per_s << "), "
+		<< s.bytes_received << " received\n"
+		<< "  round trip       mean " << (rt.count ? rt.sum_us / 1e3 / rt.count : 0.0) << " ms, p50 <= "
+		<< rt.percentile_us(0.5) / 1e3 << " ms, p90 <= " << rt.percentile_us(0.9) / 1e3 << " ms, p99 <= "
+		<< rt.percentile_us(0.99) / 1e3 << " ms, max " << rt.max_us / 1e3 << " ms\n"
+		<< "  answers          " << s.answers << " ok, " << s.errors << " errors, " << s.resend_requests
+		<< " resend requests (" << s.discarded << " discarded)\n"
+		<< "  idle             " << s.idle_us / 1e6 << " s with nothing in flight in " << s.idle_gaps << " gaps, " << s.starved << " over "
+		<< s.starve_us / 1e3 << " ms (longest " << s.longest_idle_us / 1e3 << " ms)\n"
+		<< "  stalls           " << s.stalls << " silences over " << s.stall_us / 1e3 << " ms with lines in flight (longest "
+		<< s.longest_silence_us / 1e3 << " ms)\n"
+		<< "  controller       " << s.dwell_ms / 1e3 << " s pen dwell in " << s.pen_changes << " pen changes; at rest "
+		<< s.rests << " times, " << s.rests_mid_job << " before the last line\n";
+
+	if (s.status_queries)
+	{
+		const auto & st = s.status_round_trip;
+
+		of << "  status           " << s.status_reports << " reports of " << s.status_queries << " queries, mean "
+			<< (st.count ? st.sum_us / 1e3 / st.count : 0.0) << " ms, max " << st.max_us / 1e3 << " ms; "
+			<< s.controller_idle_ms / 1e3 << " s ISR idle, " << s.late_steps << " late steps, blocks buffered min "
+			<< s.min_blocks << " mean " << (s.status_reports ? static_cast<double>(s.blocks_sum) / s.status_reports : 0.0) << "\n";
+	}
+
+	of << "  round trips (us):";
+
+	of.flags(flags);
+	of.precision(precision);
+
+	for (size_t bin = 0; bin < rt.bin_count; bin++)
+		if (rt.counts[bin])
+			of << "  <=" << rt.bound_us(bin) << ": " << rt.counts[bin];
+
+	return of;
+}
+
+/* Follows the messages on the link, as the sender sends and receives them or as a session log
+   recorded them (see session_log.h), and keeps link_stats: each answer ("ok" or "error") is
+   matched to the oldest line or frame in flight, a resend request ("rs <n>") discards them all,
+   and "Ready" starts the session, nothing sent before it being answered. A status report is
+   matched to the oldest status query, outside the window.
+
+   Times are microseconds from any fixed point. Each event costs a few comparisons and no
+   allocation once the window has been filled, so the send loop can afford it on every line. */
+class link_telemetry
+{
+	std::deque<uint64_t> in_flight; /* send times */
+	std::deque<uint64_t> queries;   /* send times of the status queries unanswered */
+	status_report last_report;
+
+	uint64_t quiet_since_us = 0; /* the last answer, or the send that opened the window */
+	uint64_t idle_since_us = 0;
+	bool idle = false;
+
+	uint64_t second = 0;
+	size_t second_bytes = 0;
+
+	void answered(uint64_t t_us)
+	{
+		stats.round_trip.add(t_us - in_flight.front());
+		in_flight.pop_front();
+	}
+
+	void window_emptied(uint64_t t_us)
+	{
+		in_flight.clear();
+
+		idle = true;
+		idle_since_us = t_us;
+	}
+
+public:
+	link_stats stats;
+
+	link_telemetry(uint64_t starve_us = 10000, uint64_t stall_us = 1000000)
+	{
+		stats.starve_us = starve_us;
+		stats.stall_us = stall_us;
+	}
+
+	/* A line (bytes including its "\r\n") or frame sent at t_us. */
+	void sent(size_t bytes, uint64_t t_us)
+	{
+		if (idle)
+		{
+			const uint64_t gap_us = t_us - idle_since_us;
+
+			stats.idle_us += gap_us;
+			stats.idle_gaps++;
+			stats.longest_idle_us = std::max(stats.longest_idle_us, gap_us);
+
+			if (gap_us > stats.starve_us)
+				stats.starved++;
+
+			idle = false;
+		}
+
+		if (in_flight.empty())
+			quiet_since_us = t_us;
+
+		in_flight.push_back(t_us);
+
+		const uint64_t s = (t_us - stats.start_us) / 1000000;
+		if (s != second)
+		{
+			second = s;
+			second_bytes = 0;
+		}
+
+		second_bytes += bytes;
+		stats.peak_bytes_per_s = std::max(stats.peak_bytes_per_s, second_bytes);
+
+		stats.sent++;
+		stats.bytes_sent += bytes;
+		stats.rests_mid_job = stats.rests;
+		stats.end_us = t_us;
+	}
+
+	/* A status query sent at t_us; it is not answered like a line. */
+	void queried(uint64_t t_us)
+	{
+		queries.push_back(t_us);
+
+		stats.status_queries++;
+		stats.bytes_sent++;
+		stats.end_us = t_us;
+	}
+
+	/* A line received at t_us, without its "\r\n". */
+	void received(std::string_view line, uint64_t t_us)
+	{
+		stats.bytes_received += line.length() + 2;
+		stats.end_us = t_us;
+
+		status_report report;
+
+		if (!queries.empty() && report.parse(line.data(), static_cast<uint16_t>(line.length())))
+		{
+			stats.status_round_trip.add(t_us - queries.front());
+			queries.pop_front();
+
+			/* The controller's counters wrap at 2^16; their differences do not, between reports
+			   less than a minute apart. */
+			if (stats.status_reports++ == 0)
+			{
+				stats.min_blocks = report.blocks;
+			}
+			else
+			{
+				stats.controller_idle_ms += static_cast<uint16_t>(report.idle_ms - last_report.idle_ms);
+				stats.late_steps += static_cast<uint16_t>(report.late_steps - last_report.late_steps);
+			}
+
+			stats.min_blocks = std::min<size_t>(stats.min_blocks, report.blocks);
+			stats.blocks_sum += report.blocks;
+
+			last_report = report;
+			return;
+		}
+
+		const bool answer = line == "ok" || line.compare(0, 5, "error") == 0 || line.compare(0, 3, "rs ") == 0;
+
+		if (answer && !in_flight.empty())
+		{
+			const uint64_t silence_us = t_us - quiet_since_us;
+
+			stats.longest_silence_us = std::max(stats.longest_silence_us, silence_us);
+			if (silence_us > stats.stall_us)
+				stats.stalls++;
+
+			quiet_since_us = t_us;
+		}
+
+		if (line == "Ready")
+		{
+			stats.start_us = t_us;
+			second = 0;
+			second_bytes = 0;
+			window_emptied(t_us);
+		}
+		else if (line.compare(0, 3, "rs ") == 0)
+		{
+			stats.resend_requests++;
+			stats.discarded += in_flight.size();
+			window_emptied(t_us);
+		}
+		else if (answer && !in_flight.empty())
+		{
+			if (line == "ok")
+				stats.answers++;
+			else
+				stats.errors++;
+
+			answered(t_us);
+
+			if (in_flight.empty())
+				window_emptied(t_us);
+		}
+		else if (line.compare(0, 7, "dwell: ") == 0)
+		{
+			const char * const end = line.data() + line.length();
+			uint64_t ms = 0;
+			size_t pen_changes = 0;
+
+			const auto ms_end = std::from_chars(line.data() + 7, end, ms).ptr;
+			if (end - ms_end > 7) /* " ms in " */
+				std::from_chars(ms_end + 7, end, pen_changes);
+
+			stats.dwell_ms += ms;
+			stats.pen_changes += pen_changes;
+			stats.rests++;
+		}
+	}
+
+	/* Lines and frames sent and not yet answered. */
+	size_t get_in_flight() const { return in_flight.size(); }
+};
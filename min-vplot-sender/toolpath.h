@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+#include "affine.h"
+#include "block.h"
+
+/* Columnar store for parsed blocks: contiguous x/y coordinate arrays, a presence bitmask and
+   8 bit G/M codes per block, about 11 bytes each. Lines that are passed through unparsed
+   (comments, Z moves, etc.) are interned in a side table so repeated lines are stored once.
+
+   Blocks are materialized on access with get(); the text of a parsed block is not kept, as
+   only its formatted words are ever sent. */
+class toolpath
+{
+public:
+	enum flag : uint8_t
+	{
+		has_x = 1 << 0,
+		has_y = 1 << 1,
+		has_g = 1 << 2,
+		has_m = 1 << 3,
+		passthrough = 1 << 4
+	};
+
+	std::vector<float> xs;
+	std::vector<float> ys;
+	std::vector<uint8_t> flags;
+	std::vector<uint8_t> g_codes;
+	std::vector<uint8_t> m_codes;
+
+private:
+	/* (block index, interned line id) for passthrough blocks, in block order. */
+	std::vector<std::pair<uint32_t, uint32_t>> passthrough_lines;
+
+	std::deque<std::string> interned; /* deque: elements never move, so the map can key on them */
+	std::unordered_map<std::string_view, uint32_t> intern_ids;
+
+	uint32_t intern(std::string_view line)
+	{
+		const auto found = intern_ids.find(line);
+		if (found != intern_ids.end())
+			return found->second;
+
+		const auto id = static_cast<uint32_t>(interned.size());
+		interned.emplace_back(line);
+		intern_ids.emplace(interned.back(), id);
+
+		return id;
+	}
+
+	static bool fits_code(const optional<int> & code)
+	{
+		return !code || (*code >= 0 && *code <= 255);
+	}
+
+public:
+	toolpath() {}
+	toolpath(toolpath &&) = default;
+	toolpath & operator=(toolpath &&) = default;
+
+	/* The intern map's keys point into interned, so a copy needs its own. */
+	toolpath(const toolpath & other)
+		: xs(other.xs), ys(other.ys), flags(other.flags), g_codes(other.g_codes), m_codes(other.m_codes),
+		passthrough_lines(other.passthrough_lines), interned(other.interned)
+	{
+		for (uint32_t id = 0; id < interned.size(); id++)
+			intern_ids.emplace(interned[id], id);
+	}
+
+	toolpath & operator=(const toolpath & other)
+	{
+		if (this != &other)
+			*this = toolpath(other);
+
+		return *this;
+	}
+
+	size_t size() const { return flags.size(); }
+	bool empty() const { return flags.empty(); }
+
+	void reserve(size_t count)
+	{
+		xs.reserve(count);
+		ys.reserve(count);
+		flags.reserve(count);
+		g_codes.reserve(count);
+		m_codes.reserve(count);
+	}
+
+	/* Removes all blocks; the coordinate arrays keep their capacity. */
+	void clear()
+	{
+		xs.clear();
+		ys.clear();
+		flags.clear();
+		g_codes.clear();
+		m_codes.clear();
+		passthrough_lines.clear();
+
+		intern_ids.clear();
+		interned.clear();
+	}
+
+	void add(const block & b)
+	{
+		if (!b.parsed() || !fits_code(b.g_number) || !fits_code(b.m_number))
+		{
+			/* Codes outside 8 bits are rare enough to keep as their formatted text. */
+			const auto id = b.parsed() ? intern(std::string(b)) : intern(b.line);
+			passthrough_lines.emplace_back(static_cast<uint32_t>(size()), id);
+
+			xs.push_back(0.0f);
+			ys.push_back(0.0f);
+			flags.push_back(passthrough);
+			g_codes.push_back(0);
+			m_codes.push_back(0);
+			return;
+		}
+
+		xs.push_back(b.x ? *b.x : 0.0f);
+		ys.push_back(b.y ? *b.y : 0.0f);
+		g_codes.push_back(b.g_number ? static_cast<uint8_t>(*b.g_number) : 0);
+		m_codes.push_back(b.m_number ? static_cast<uint8_t>(*b.m_number) : 0);
+
+		flags.push_back(
+			(b.x ? has_x : 0) |
+			(b.y ? has_y : 0) |
+			(b.g_number ? has_g : 0) |
+			(b.m_number ? has_m : 0));
+	}
+
+	/* Adds the blocks of other after this toolpath's. */
+	void append(const toolpath & other)
+	{
+		const auto offset = static_cast<uint32_t>(size());
+
+		xs.insert(xs.end(), other.xs.begin(), other.xs.end());
+		ys.insert(ys.end(), other.ys.begin(), other.ys.end());
+		flags.insert(flags.end(), other.flags.begin(), other.flags.end());
+		g_codes.insert(g_codes.end(), other.g_codes.begin(), other.g_codes.end());
+		m_codes.insert(m_codes.end(), other.m_codes.begin(), other.m_codes.end());
+
+		std::vector<uint32_t> ids(other.interned.size());
+		for (size_t id = 0; id < ids.size(); id++)
+			ids[id] = intern(other.interned[id]);
+
+		for (const auto & line : other.passthrough_lines)
+			passthrough_lines.emplace_back(offset + line.first, ids[line.second]);
+	}
+
+	std::string_view passthrough_line(size_t idx) const
+	{
+		const auto found = std::lower_bound(passthrough_lines.begin(), passthrough_lines.end(),
+			std::make_pair(static_cast<uint32_t>(idx), 0u));
+
+		return interned[found->second];
+	}
+
+	block get(size_t idx) const
+	{
+		const uint8_t f = flags[idx];
+
+		if (f & passthrough)
+			return block(passthrough_line(idx), gcode_words());
+
+		block b(pos2(xs[idx], ys[idx]));
+
+		if (!(f & has_x))
+			b.x = nullopt;
+
+		if (!(f & has_y))
+			b.y = nullopt;
+
+		b.g_number = f & has_g ? optional<int>(g_codes[idx]) : nullopt;
+		b.m_number = f & has_m ? optional<int>(m_codes[idx]) : nullopt;
+
+		return b;
+	}
+
+	/* Applies m to every coordinate in place, in one pass over the coordinate columns. start is
+	   the position before the first block. If m mixes the axes, blocks with only one of X and Y
+	   get the other one from the position before them, so both change. */
+	void transform(const affine & m, pos2 start = pos2(0.0f, 0.0f))
+	{
+		if (!m.axis_aligned())
+		{
+			float x = start.first, y = start.second;
+
+			for (size_t idx = 0; idx < size(); idx++)
+			{
+				const uint8_t f = flags[idx];
+
+				if ((f & passthrough) || !(f & (has_x | has_y)))
+					continue;
+
+				if (f & has_x)
+					x = xs[idx];
+				else
+					xs[idx] = x;
+
+				if (f & has_y)
+					y = ys[idx];
+				else
+					ys[idx] = y;
+
+				flags[idx] = f | has_x | has_y;
+			}
+		}
+
+		/* Passthrough blocks and absent coordinates are transformed too and never read. */
+		float * const x = xs.data();
+		float * const y = ys.data();
+		const size_t count = size();
+
+		for (size_t idx = 0; idx < count; idx++)
+		{
+			const float px = x[idx], py = y[idx];
+
+			x[idx] = m.xx * px + m.xy * py + m.x0;
+			y[idx] = m.yx * px + m.yy * py + m.y0;
+		}
+	}
+
+	/* Removes the blocks whose keep entry is 0, preserving the order of the rest. Passthrough
+	   blocks must be kept. */
+	void retain(const std::vector<uint8_t> & keep)
+	{
+		size_t out = 0;
+		auto passthrough_line = passthrough_lines.begin();
+
+		for (size_t idx = 0; idx < size(); idx++)
+		{
+			if (!keep[idx])
+				continue;
+
+			if (flags[idx] & passthrough)
+				(passthrough_line++)->first = static_cast<uint32_t>(out);
+
+			xs[out] = xs[idx];
+			ys[out] = ys[idx];
+			flags[out] = flags[idx];
+			g_codes[out] = g_codes[idx];
+			m_codes[out] = m_codes[idx];
+			out++;
+		}
+
+		xs.resize(out);
+		ys.resize(out);
+		flags.resize(out);
+		g_codes.resize(out);
+		m_codes.resize(out);
+	}
+
+	/* Inserts extra[idx] points before each block idx, taken in order from points. Each one is a
+	   copy of the block it precedes, with its own X and Y. */
+	void subdivide(const std::vector<uint32_t> & extra, const std::vector<pos2> & points)
+	{
+		if (points.empty())
+			return;
+
+		const size_t count = size();
+		size_t out = count + points.size();
+		size_t next_point = points.size();
+		auto passthrough_line = passthrough_lines.rbegin();
+
+		xs.resize(out);
+		ys.resize(out);
+		flags.resize(out);
+		g_codes.resize(out);
+		m_codes.resize(out);
+
+		/* Back to front, so no block is overwritten before it has moved. */
+		for (size_t idx = count; idx-- > 0;)
+		{
+			out--;
+
+			xs[out] = xs[idx];
+			ys[out] = ys[idx];
+			flags[out] = flags[idx];
+			g_codes[out] = g_codes[idx];
+			m_codes[out] = m_codes[idx];
+
+			if (flags[out] & passthrough)
+				(passthrough_line++)->first = static_cast<uint32_t>(out);
+
+			const size_t moved = out;
+
+			for (uint32_t n = 0; n < extra[idx]; n++)
+			{
+				out--;
+				next_point--;
+
+				xs[out] = points[next_point].first;
+				ys[out] = points[next_point].second;
+				flags[out] = flags[moved] | has_x | has_y;
+				g_codes[out] = g_codes[moved];
+				m_codes[out] = m_codes[moved];
+			}
+		}
+	}
+
+	/* Bytes held by this store, including the passthrough side table. */
+	size_t memory_usage() const
+	{
+		size_t bytes = xs.capacity() * sizeof(float) + ys.capacity() * sizeof(float) +
+			flags.capacity() + g_codes.capacity() + m_codes.capacity() +
+			passthrough_lines.capacity() * sizeof(passthrough_lines[0]) +
+			interned.size() * sizeof(std::string);
+
+		for (const auto & line : interned)
+			bytes += line.capacity() + 1;
+
+		return bytes + intern_ids.size() * (sizeof(std::string_view) + sizeof(uint32_t) + 2 * sizeof(void *));
+	}
+};
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../types.h"
+
+using namespace std;
+
+/*
+ gen_nc
+
+ Writes a synthetic NC program of the given number of lines for benchmarks, the same for the
+ same arguments on every host. Each line is drawn from a mix of kinds, weighted by the options:
+
+ - G0 travel of 10 to 200 mm,
+ - G1 strokes of 0.1 to 5 mm, with an F word on one in ten,
+ - G2 and G3 arcs of 1 to 50 mm radius and up to half a turn, from the current position,
+ - comment lines, in parentheses or after ';',
+ - G20/G21 unit switches (coordinates follow in the new unit),
+ - pen changes, alternating M3 (lift) and M4 (lower).
+
+ Moves stay within 400 mm of the origin. Sizes take a k or M suffix, e.g. 10M.
+
+ Usage: gen_nc <lines> [-o <file>] [--seed 1] [--g0 5] [--g1 70] [--g2 6] [--g3 6] [--comment 5]
+               [--units 1] [--pen 4]
+ */
+
+namespace
+{
+	enum line_kind { g0, g1, g2, g3, comment, unit_switch, pen_change, kind_count };
+
+	const char * const kind_options[kind_count] = { "--g0", "--g1", "--g2", "--g3", "--comment", "--units", "--pen" };
+
+	constexpr double area_mm = 400.0;
+
+	size_t parse_size(const string & arg)
+	{
+		size_t suffix = 0;
+		const double value = stod(arg, &suffix);
+
+		if (suffix < arg.length() && (arg[suffix] == 'k' || arg[suffix] == 'K'))
+			return static_cast<size_t>(value * 1e3);
+
+		if (suffix < arg.length() && arg[suffix] == 'M')
+			return static_cast<size_t>(value * 1e6);
+
+		return static_cast<size_t>(value);
+	}
+
+	/* Appends lines to a buffer written out in large blocks. */
+	class line_writer
+	{
+		FILE * file;
+		vector<char> buf = vector<char>(1 << 20);
+		size_t used = 0;
+
+	public:
+		line_writer(FILE * file) : file(file) {}
+		~line_writer() { flush(); }
+
+		void flush()
+		{
+			fwrite(buf.data(), 1, used, file);
+			used = 0;
+		}
+
+		line_writer & operator<<(const char * text)
+		{
+			for (; *text; text++)
+				buf[used++] = *text;
+
+			return *this;
+		}
+
+		line_writer & operator<<(double value)
+		{
+			used = to_chars(buf.data() + used, buf.data() + buf.size(), value, chars_format::fixed, 4).ptr - buf.data();
+			return *this;
+		}
+
+		line_writer & operator<<(int value)
+		{
+			used = to_chars(buf.data() + used, buf.data() + buf.size(), value).ptr - buf.data();
+			return *this;
+		}
+
+		void end_line()
+		{
+			buf[used++] = '\n';
+
+			if (used > buf.size() - 256)
+				flush();
+		}
+	};
+}
+
+int main(int argc, const char * argv[])
+{
+	if (argc < 2)
+	{
+		cout << "usage: gen_nc <lines> [-o <file>] [--seed 1] [--g0 5] [--g1 70] [--g2 6] [--g3 6] [--comment 5] [--units 1] [--pen 4]" << endl;
+		return 1;
+	}
+
+	const size_t lines = parse_size(argv[1]);
+	string out_path;
+	unsigned seed = 1;
+	double weights[kind_count] = { 5, 70, 6, 6, 5, 1, 4 };
+
+	for (int arg_idx = 2; arg_idx + 1 < argc; arg_idx += 2)
+	{
+		const string arg = argv[arg_idx];
+		const auto option = find(begin(kind_options), end(kind_options), arg);
+
+		if (arg == "-o")
+			out_path = argv[arg_idx + 1];
+		else if (arg == "--seed")
+			seed = static_cast<unsigned>(stoul(argv[arg_idx + 1]));
+		else if (option != end(kind_options))
+			weights[option - begin(kind_options)] = stod(argv[arg_idx + 1]);
+		else
+		{
+			cout << "Unknown option: " << arg << endl;
+			return 1;
+		}
+	}
+
+	FILE * file = out_path.empty() ? stdout : fopen(out_path.c_str(), "wb");
+	if (!file)
+	{
+		cout << "Cannot write " << out_path << endl;
+		return 1;
+	}
+
+	/* Fixed engines and hand rolled draws: the standard distributions differ between libraries. */
+	mt19937 rng(seed);
+	auto uniform = [&](double low, double high) { return low + (high - low) * (rng() / 4294967296.0); };
+
+	double total = 0.0;
+	for (const double weight : weights)
+		total += weight;
+
+	{
+		line_writer out(file);
+
+		double x = 0.0, y = 0.0; /* mm */
+		bool inches = false;
+		bool lifted = true;
+
+		auto coordinate = [&](double mm) { return inches ? mm / 25.4 : mm; };
+
+		/* A step of the given length in a random direction, turned back towards the origin
+		   if it would leave the area. */
+		auto step = [&](double length, double & to_x, double & to_y)
+		{
+			const double angle = uniform(0.0, TWO_PI);
+
+			to_x = x + length * cos(angle);
+			to_y = y + length * sin(angle);
+
+			if (abs(to_x) > area_mm || abs(to_y) > area_mm)
+			{
+				to_x = x - length * cos(angle);
+				to_y = y - length * sin(angle);
+			}
+
+			to_x = clamp(to_x, -area_mm, area_mm);
+			to_y = clamp(to_y, -area_mm, area_mm);
+		};
+
+		out << "G21";
+		out.end_line();
+
+		for (size_t line = 1; line < lines; line++)
+		{
+			double pick = uniform(0.0, total);
+			int kind = 0;
+
+			while (kind < kind_count - 1 && pick >= weights[kind])
+				pick -= weights[kind++];
+
+			switch (kind)
+			{
+			case g0:
+			case g1:
+			{
+				double to_x, to_y;
+				step(kind == g0 ? uniform(10.0, 200.0) : uniform(0.1, 5.0), to_x, to_y);
+
+				out << (kind == g0 ? "G0 X" : "G1 X") << coordinate(to_x) << " Y" << coordinate(to_y);
+
+				if (kind == g1 && rng() % 10 == 0)
+					out << " F" << static_cast<int>(rng() % 3000 + 300);
+
+				x = to_x;
+				y = to_y;
+				break;
+			}
+			case g2:
+			case g3:
+			{
+				const double radius = uniform(1.0, 50.0);
+				const double start_angle = uniform(0.0, TWO_PI);
+				const double sweep = uniform(0.05, PI) * (kind == g2 ? -1.0 : 1.0);
+
+				/* Centered so the arc stays within the area. */
+				const double center_x = clamp(x - radius * cos(start_angle), -area_mm + radius, area_mm - radius);
+				const double center_y = clamp(y - radius * sin(start_angle), -area_mm + radius, area_mm - radius);
+				const double from_angle = atan2(y - center_y, x - center_x);
+				const double from_radius = hypot(x - center_x, y - center_y);
+
+				const double to_x = center_x + from_radius * cos(from_angle + sweep);
+				const double to_y = center_y + from_radius * sin(from_angle + sweep);
+
+				out << (kind == g2 ? "G2 X" : "G3 X") << coordinate(to_x) << " Y" << coordinate(to_y)
+					<< " I" << coordinate(center_x - x) << " J" << coordinate(center_y - y);
+
+				x = to_x;
+				y = to_y;
+				break;
+			}
+			case comment:
+				if (rng() % 2)
+					out << "(pass " << static_cast<int>(line) << ")";
+				else
+					out << "; line " << static_cast<int>(line);
+				break;
+
+			case unit_switch:
+				inches = !inches;
+				out << (inches ? "G20" : "G21");
+				break;
+
+			default:
+				lifted = !lifted;
+				out << (lifted ? "M3" : "M4");
+				break;
+			}
+
+			out.end_line();
+		}
+	}
+
+	if (file != stdout)
+		fclose(file);
+
+	return 0;
+}
@@ -0,0 +1,262 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __linux__
+#include "../linux/serial_linux.h"
+#else
+#include "../osx/serial_osx.h"
+#endif
+
+#include "../mapped_file.h"
+#include "../session_log.h"
+#include "../telemetry.h"
+
+using namespace std;
+
+/*
+ replay_session
+
+ Reads a session log written by min-vplot-sender --log and prints the link telemetry of the
+ recorded session; --dump lists its messages first, with their times since it started.
+
+ Given a serial port, usually the stand-in controller's (standin_controller), the recorded lines
+ and frames are sent to it again, each once as many answers ("Ready", "ok", "error", "rs <n>")
+ have come back as had before it in the recording: the sender's flow control, without the
+ sender or the NC file. With --paced, none goes out sooner after "Ready" than it did in the
+ recording either, so that a host falling behind is reproduced too. Status queries (--status)
+ are sent again in their place among the lines and frames, and not counted in flight. The replay's
+ telemetry follows the recording's, for comparison, and --log records the replay in turn.
+
+ Usage: replay_session <session log> [<port>] [--paced] [--dump] [--log <file>]
+ */
+
+namespace
+{
+	/* A line or frame to send again. */
+	struct message
+	{
+		session_log::record record;
+		size_t answers_before;
+	};
+
+	bool is_answer(string_view line)
+	{
+		return line == "Ready" || line == "ok" || line.compare(0, 5, "error") == 0 || line.compare(0, 3, "rs ") == 0;
+	}
+
+	void dump(const session_log::record & r)
+	{
+		cout << fixed << setprecision(6) << setw(12) << r.t_us / 1e6 << (r.type == session_log::line_received ? " < " : " > ");
+
+		if (r.type == session_log::bytes_sent)
+		{
+			cout << hex << setfill('0');
+
+			for (const char c : r.data)
+				cout << setw(2) << static_cast<unsigned>(static_cast<uint8_t>(c));
+
+			cout << dec << setfill(' ');
+		}
+		else
+		{
+			cout << r.data;
+		}
+
+		cout << '\n';
+	}
+}
+
+int main(int argc, const char * argv[])
+{
+	if (argc < 2)
+	{
+		cout << "usage: replay_session <session log> [<port>] [--paced] [--dump] [--log <file>]" << endl;
+		return 1;
+	}
+
+	string port, log_path;
+	bool paced = false, dump_records = false;
+
+	for (int arg_idx = 2; arg_idx < argc; arg_idx++)
+	{
+		const string arg = argv[arg_idx];
+
+		if (arg == "--paced")
+			paced = true;
+		else if (arg == "--dump")
+			dump_records = true;
+		else if (arg == "--log" && arg_idx + 1 < argc)
+			log_path = argv[++arg_idx];
+		else if (arg.compare(0, 2, "--") != 0 && port.empty())
+			port = arg;
+		else
+		{
+			cout << "Unknown option: " << arg << endl;
+			return 1;
+		}
+	}
+
+	mapped_file log_file;
+	session_log::reader reader;
+
+	if (!log_file.open(argv[1]) || !reader.open(log_file.view()))
+	{
+		cout << "Not a session log: " << argv[1] << endl;
+		return 1;
+	}
+
+	vector<message> messages;
+	link_telemetry recorded;
+	size_t answers = 0;
+	uint64_t recorded_ready_us = 0;
+
+	for (session_log::record r; reader.next(r);)
+	{
+		if (dump_records)
+			dump(r);
+
+		if (r.type == session_log::line_received)
+		{
+			recorded.received(r.data, r.t_us);
+
+			if (is_answer(r.data))
+				answers++;
+
+			if (r.data == "Ready")
+				recorded_ready_us = r.t_us;
+		}
+		else
+		{
+			if (r.type == session_log::query_sent)
+				recorded.queried(r.t_us);
+			else
+				recorded.sent(r.data.length() + (r.type == session_log::line_sent ? 2 : 0), r.t_us);
+
+			messages.push_back(message{ r, answers });
+		}
+	}
+
+	cout << "Recorded: " << recorded.stats << endl;
+
+	if (port.empty())
+		return 0;
+
+#ifdef __linux__
+	serial_linux serial;
+#else
+	serial_osx serial;
+#endif
+
+	if (!serial.setup(port))
+		return 1;
+
+	session_log::writer log;
+	if (!log_path.empty() && !log.open(log_path))
+	{
+		cout << "Cannot write session log: " << log_path << endl;
+		return 1;
+	}
+
+	using clock = chrono::steady_clock;
+
+	const auto epoch = clock::now();
+	auto now_us = [epoch] { return static_cast<uint64_t>(chrono::duration_cast<chrono::microseconds>(clock::now() - epoch).count()); };
+
+	constexpr uint64_t timeout_us = 5000000;
+
+	link_telemetry replayed;
+	size_t next = 0;
+	bool ready = false, failed = false;
+	uint64_t ready_us = 0, activity_us = 0;
+
+	answers = 0;
+
+	while (!failed && (next < messages.size() || replayed.get_in_flight() > 0))
+	{
+		if (!serial.wait(1 /* ms */))
+		{
+			failed = true;
+			break;
+		}
+
+		while (const auto response = serial.read_line())
+		{
+			const string_view line = *response;
+			const uint64_t t_us = now_us();
+
+			replayed.received(line, t_us);
+			log.add(session_log::line_received, t_us, line);
+
+			if (is_answer(line))
+				answers++;
+
+			if (line == "Ready")
+			{
+				ready = true;
+				ready_us = t_us;
+			}
+
+			activity_us = t_us;
+		}
+
+		for (; next < messages.size(); next++)
+		{
+			const auto & m = messages[next];
+			const bool line = m.record.type == session_log::line_sent;
+			const bool query = m.record.type == session_log::query_sent;
+
+			/* Before "Ready" (the ">" asking for it), always at the recorded time. */
+			const uint64_t due_us = !ready ? m.record.t_us :
+				paced && m.record.t_us > recorded_ready_us ? ready_us + (m.record.t_us - recorded_ready_us) : 0;
+
+			if (answers < m.answers_before || now_us() < due_us)
+				break;
+
+			if (!(line ? serial.write_line(m.record.data) : serial.write_bytes(m.record.data)))
+			{
+				failed = true;
+				break;
+			}
+
+			const uint64_t t_us = now_us();
+
+			if (query)
+				replayed.queried(t_us);
+			else
+				replayed.sent(m.record.data.length() + (line ? 2 : 0), t_us);
+
+			log.add(m.record.type, t_us, m.record.data);
+
+			activity_us = t_us;
+		}
+
+		if (!serial.flush())
+			failed = true;
+
+		if (now_us() - activity_us > timeout_us)
+		{
+			cout << "Nothing received for " << timeout_us / 1000000 << " s; " << messages.size() - next << " of "
+				<< messages.size() << " lines and frames not sent, " << replayed.get_in_flight() << " unanswered" << endl;
+			break;
+		}
+	}
+
+	if (failed)
+		cout << "Serial port error" << endl;
+
+	cout << "Replayed: " << replayed.stats << endl;
+
+	log.close();
+
+	if (!log.ok())
+	{
+		cout << "Session log write failed: " << log_path << endl;
+		return 1;
+	}
+
+	return next == messages.size() && replayed.get_in_flight() == 0 ? 0 : 1;
+}
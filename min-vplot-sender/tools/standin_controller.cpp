@@ -0,0 +1,354 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+#include "../../frame.h"
+#include "../../status.h"
+
+using namespace std;
+
+/*
+ standin_controller
+
+ Emulates a min-vplot controller on a pseudo terminal, so the sender's flow control can be
+ measured without a plotter. The model follows the firmware:
+
+ - bytes cross the link at the configured baud rate (10 bits per byte),
+ - they land in the AVR serial RX buffer; bytes arriving while it is full are lost,
+ - the main loop only reads the RX buffer while the block buffer has a free slot,
+ - each line is answered with "ok" as soon as it is parsed (after '>' comes "Ready"),
+ - after "$B", binary frames are read instead of lines, checked and answered as the firmware
+   does; an accepted frame's blocks enter the block buffer as it makes room, and no further
+   bytes are read until all have,
+ - blocks then execute one after another, each taking a fixed time,
+ - a status query ('?', see ../../status.h) is answered as it leaves the link, in a line or
+   between frames, with the blocks buffered and the time the block buffer stood empty,
+ - responses reach the host after a fixed USB adapter latency.
+
+ Prints the slave device to pass to the sender, and a report once the sender disconnects.
+
+ --corrupt flips one bit of a received frame byte with the given probability, to exercise
+ resending.
+
+ Usage: standin_controller [--baud 115200] [--rx-buffer 64] [--slots 16] [--block-ms 2] [--latency-ms 1]
+                           [--corrupt 0]
+ */
+
+struct standin_options
+{
+	double baud = 115200.0;
+	size_t rx_buffer = 64;
+	size_t slots = 16; /* BUFFER_SIZE */
+	double block_ms = 2.0;
+	double latency_ms = 1.0;
+	double corrupt = 0.0;
+};
+
+int main(int argc, const char * argv[])
+{
+	standin_options opt;
+
+	for (int arg_idx = 1; arg_idx + 1 < argc; arg_idx += 2)
+	{
+		const string arg = argv[arg_idx];
+		const double value = stod(argv[arg_idx + 1]);
+
+		if (arg == "--baud")
+			opt.baud = value;
+		else if (arg == "--rx-buffer")
+			opt.rx_buffer = static_cast<size_t>(value);
+		else if (arg == "--slots")
+			opt.slots = static_cast<size_t>(value);
+		else if (arg == "--block-ms")
+			opt.block_ms = value;
+		else if (arg == "--latency-ms")
+			opt.latency_ms = value;
+		else if (arg == "--corrupt")
+			opt.corrupt = value;
+		else
+		{
+			cout << "Unknown option: " << arg << endl;
+			return 1;
+		}
+	}
+
+	int master_fd = -1;
+	int slave_fd = -1;
+	char slave_name[256] = {};
+
+	if (openpty(&master_fd, &slave_fd, slave_name, nullptr, nullptr) != 0)
+	{
+		cout << "openpty failed: " << strerror(errno) << endl;
+		return 1;
+	}
+
+	termios tio;
+	tcgetattr(slave_fd, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave_fd, TCSANOW, &tio);
+
+	/* Without an open slave, reads on the master fail with EIO; that is how the end of the
+	   session is detected. */
+	close(slave_fd);
+
+	fcntl(master_fd, F_SETFL, fcntl(master_fd, F_GETFL) | O_NONBLOCK);
+
+	cout << slave_name << endl;
+
+	using clock = chrono::steady_clock;
+	const auto epoch = clock::now();
+	auto now_us = [epoch] { return chrono::duration<double, micro>(clock::now() - epoch).count(); };
+
+	const double byte_us = 10.0 * 1e6 / opt.baud;
+	const double block_us = opt.block_ms * 1000.0;
+
+	struct wire_byte
+	{
+		char c;
+		double arrival_us;
+	};
+
+	deque<wire_byte> wire;
+	double wire_free_us = 0.0;
+
+	deque<char> rx;
+	string line;
+	size_t queued_blocks = 0;
+
+	bool connected = false;
+	bool ready = false;
+	bool executing = false;
+	double block_end_us = 0.0;
+
+	bool frames_enabled = false;
+	frame_receiver frames;
+	frame_boundary boundary;
+	size_t frame_blocks = 0; /* of the last accepted frame, not yet in the block buffer */
+	bool frame_lift = true;
+	uint8_t frame_feed = FRAME_MAX_FEED;
+	double last_frame_byte_us = 0.0;
+
+	mt19937 rng(1);
+	bernoulli_distribution corrupt(opt.corrupt);
+
+	size_t bytes_received = 0, bytes_lost = 0, lines = 0, blocks_done = 0, gaps = 0;
+	size_t frames_accepted = 0, frames_rejected = 0, bits_flipped = 0, status_queries = 0;
+	double first_block_us = -1.0, idle_us = 0.0;
+
+	deque<pair<double, string>> responses; /* due time, text */
+
+	auto respond = [&](const string & text)
+	{
+		responses.emplace_back(now_us() + opt.latency_ms * 1000.0, text);
+	};
+
+	while (true)
+	{
+		double now = now_us();
+
+		char buf[256];
+		const auto count = read(master_fd, buf, sizeof(buf));
+
+		if (count > 0)
+		{
+			connected = true;
+
+			for (ssize_t n = 0; n < count; n++)
+			{
+				wire_free_us = max(now, wire_free_us) + byte_us;
+				wire.push_back(wire_byte{ buf[n], wire_free_us });
+			}
+		}
+		else if (count < 0 && errno == EIO)
+		{
+			if (connected && wire.empty() && !queued_blocks && !frame_blocks && !executing)
+				break;
+
+			this_thread::sleep_for(chrono::milliseconds(10));
+		}
+
+		/* Link -> RX buffer, less the status queries */
+		while (!wire.empty() && wire.front().arrival_us <= now)
+		{
+			const char c = wire.front().c;
+
+			bytes_received++;
+			wire.pop_front();
+
+			if (ready && c == STATUS_QUERY && (!frames_enabled || boundary.between()))
+			{
+				status_report status;
+				status.blocks = static_cast<uint8_t>(min<size_t>(queued_blocks, 255));
+				status.idle_ms = static_cast<uint16_t>(static_cast<uint64_t>(idle_us / 1000.0));
+
+				char report[STATUS_MAX_BYTES];
+				status.format(report);
+
+				status_queries++;
+				respond(string(report) + "\r\n");
+				continue;
+			}
+
+			if (frames_enabled)
+				boundary.add(static_cast<uint8_t>(c));
+
+			if (rx.size() < opt.rx_buffer)
+				rx.push_back(c);
+			else
+				bytes_lost++;
+		}
+
+		/* Frame blocks -> block buffer */
+		for (; frame_blocks > 0 && queued_blocks < opt.slots; frame_blocks--)
+			queued_blocks++;
+
+		/* RX buffer -> parse_line, only while the block buffer has room */
+		while (!rx.empty() && (frames_enabled ? frame_blocks == 0 : queued_blocks < opt.slots))
+		{
+			char c = rx.front();
+			rx.pop_front();
+
+			if (frames_enabled)
+			{
+				if (corrupt(rng))
+				{
+					c ^= 1 << uniform_int_distribution<int>(0, 7)(rng);
+					bits_flipped++;
+				}
+
+				const auto result = frames.add(static_cast<uint8_t>(c));
+				last_frame_byte_us = now;
+
+				if (result == frame_receiver::accepted)
+				{
+					frame_reader frame(frames.payload(), frames.payload_length());
+
+					frame_blocks = (frame.lift != frame_lift) + (frame.feed != frame_feed);
+					frame_lift = frame.lift;
+					frame_feed = frame.feed;
+
+					for (int32_t dx, dy; frame.next_point(dx, dy);)
+						frame_blocks++;
+
+					frames_accepted++;
+					respond("ok\r\n");
+
+					for (; frame_blocks > 0 && queued_blocks < opt.slots; frame_blocks--)
+						queued_blocks++;
+				}
+				else if (result == frame_receiver::repeated)
+				{
+					respond("ok\r\n");
+				}
+			}
+			else if (!ready)
+			{
+				if (c == '>')
+				{
+					respond("Ready\r\n");
+					ready = true;
+				}
+			}
+			else if (c == '\r')
+			{
+				/* the controller answers at the '\n' */
+			}
+			else if (c == '\n')
+			{
+				if (line == "$B")
+				{
+					frames_enabled = true;
+					respond("ok\r\n");
+					line.clear();
+				}
+				else if (!line.empty())
+				{
+					lines++;
+					queued_blocks++;
+					respond("ok\r\n");
+					line.clear();
+				}
+			}
+			else
+			{
+				line += c;
+			}
+		}
+
+		if (frames_enabled && rx.empty() && frames.has_input() && now - last_frame_byte_us > FRAME_TIMEOUT_MS * 1000.0)
+		{
+			frames.idle();
+			boundary.reset();
+			frames_rejected++;
+			respond("rs " + to_string(frames.expected_seq) + "\r\n");
+		}
+
+		/* Motion */
+		now = now_us();
+
+		if (executing && now >= block_end_us)
+		{
+			executing = false;
+			blocks_done++;
+		}
+
+		if (!executing && queued_blocks > 0)
+		{
+			if (first_block_us < 0.0)
+				first_block_us = now;
+			else if (now - block_end_us > byte_us)
+			{
+				idle_us += now - block_end_us;
+				gaps++;
+			}
+
+			queued_blocks--;
+			executing = true;
+			block_end_us = now + block_us;
+		}
+
+		while (!responses.empty() && responses.front().first <= now)
+		{
+			const string & text = responses.front().second;
+
+			if (write(master_fd, text.data(), text.length()) < 0 && errno != EIO)
+				cout << "write error: " << strerror(errno) << endl;
+
+			responses.pop_front();
+		}
+
+		this_thread::sleep_for(chrono::microseconds(20));
+	}
+
+	const double total_us = block_end_us - first_block_us;
+
+	cout << "lines: " << lines << ", blocks executed: " << blocks_done << endl;
+
+	if (frames_enabled)
+		cout << "frames accepted: " << frames_accepted << ", rejected: " << frames_rejected
+			<< " (" << bits_flipped << " bits flipped)" << endl;
+
+	cout << "bytes: " << bytes_received << ", lost to RX overflow: " << bytes_lost << endl;
+
+	if (status_queries)
+		cout << "status queries: " << status_queries << endl;
+	cout << "motion time: " << total_us / 1e6 << " s, idle between blocks: " << idle_us / 1e6
+		<< " s in " << gaps << " gaps (" << (total_us > 0.0 ? 100.0 * idle_us / total_us : 0.0) << "%)" << endl;
+
+	return bytes_lost ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <list>
+
+#include "types.h"
+#include "block.h"
+
+/* Blocks tracing the rectangle around the given extents with the pen lifted; used to check
+   placement on the sheet before plotting. */
+std::list<block> make_outline_trace(const range & x_extent, const range & y_extent)
+{
+	std::list<block> blocks;
+
+	blocks.push_back(block(pos2(x_extent.first, y_extent.first)));
+	blocks.push_back(block(pos2(x_extent.second, y_extent.first)));
+	blocks.push_back(block(pos2(x_extent.second, y_extent.second)));
+	blocks.push_back(block(pos2(x_extent.first, y_extent.second)));
+	blocks.push_back(block(pos2(x_extent.first, y_extent.first)));
+
+	return blocks;
+}
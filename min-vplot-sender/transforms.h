@@ -1,5 +1,6 @@
 #pragma once
 
+#include "affine.h"
 #include "block.h"
 
 block::transformer in_to_mm()
@@ -42,73 +43,44 @@ block::transformer mm_to_in()
 	};
 }
 
-block::transformer center_x(const range & x_extent)
+/* Geometric transforms, composed with affine::then. */
+
+affine center_x(const range & x_extent)
 {
 	auto x_center = (x_extent.second + x_extent.first) / 2.0f;
 
-	return [x_center](block b)
-	{
-		if (b.x)
-			b.x = *b.x - x_center;
-
-		return b;
-	};
+	return affine::translate(-x_center, 0.0f);
 }
 
-block::transformer center_y(const range & y_extent)
+affine center_y(const range & y_extent)
 {
 	auto y_center = (y_extent.second + y_extent.first) / 2.0f;
-	
-	return [y_center](block b)
-	{
-		if (b.y)
-			b.y = *b.y - y_center;
-		
-		return b;
-	};
+
+	return affine::translate(0.0f, -y_center);
 }
 
-block::transformer scale_width(const range & original_x_extent, float new_width)
+affine scale_width(const range & original_x_extent, float new_width)
 {
 	auto original_width = original_x_extent.second - original_x_extent.first;
 	auto scale_factor = new_width / original_width;
-	
-	return [scale_factor](block b)
-	{
-		if (b.x)
-			b.x = *b.x * scale_factor;
-		
-		if (b.y)
-			b.y = *b.y * scale_factor;
-		
-		return b;
-	};
+
+	return affine::scale(scale_factor, scale_factor);
 }
 
-block::transformer scale_height(const range & original_y_extent, float new_height)
+affine scale_height(const range & original_y_extent, float new_height)
 {
 	auto original_height = original_y_extent.second - original_y_extent.first;
 	auto scale_factor = new_height / original_height;
-	
-	return [scale_factor](block b)
-	{
-		if (b.x)
-			b.x = *b.x * scale_factor;
-		
-		if (b.y)
-			b.y = *b.y * scale_factor;
-		
-		return b;
-	};
+
+	return affine::scale(scale_factor, scale_factor);
 }
 
-block::transformer composite(std::list<block::transformer> & transforms)
+affine mirror_x()
 {
-	return [transforms](block b)
-	{
-		block tb = b;
-		for (auto t : transforms)
-			tb = t(tb);
-		return tb;
-	};
+	return affine::scale(-1.0f, 1.0f);
+}
+
+affine mirror_y()
+{
+	return affine::scale(1.0f, -1.0f);
 }
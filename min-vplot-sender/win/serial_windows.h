@@ -99,6 +99,18 @@ public:
 		}
 	}
 
+	virtual bool write_bytes(std::string_view bytes)
+	{
+		DWORD bytes_written = 0;
+		if (!WriteFile(m_handle, bytes.data(), static_cast<DWORD>(bytes.length()), &bytes_written, NULL))
+		{
+			std::cout << "write_serial error" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
 	virtual void sleep(const unsigned int ms) const
 	{
 		Sleep(ms);
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "types.h"
+
+/* Letter/number words of a single NC line, e.g. "G1 X10.5 Y-2" -> G=1, X=10.5, Y=-2.
+
+   The line is scanned once and no memory is allocated; comments in parentheses or after ';'
+   are skipped. Lower case letters are accepted. If a letter appears more than once, the
+   first occurrence wins. */
+struct gcode_words
+{
+	float values[26] = {};
+	uint32_t present = 0;
+
+	bool empty() const { return present == 0; }
+
+	bool has(char letter) const { return (present & bit(letter)) != 0; }
+
+	float get(char letter) const { return values[letter - 'A']; }
+
+	optional<float> get_float(char letter) const
+	{
+		if (has(letter))
+			return get(letter);
+
+		return nullopt;
+	}
+
+	optional<int> get_int(char letter) const
+	{
+		if (has(letter))
+			return static_cast<int>(get(letter));
+
+		return nullopt;
+	}
+
+	static gcode_words tokenize(std::string_view line)
+	{
+		gcode_words words;
+
+		const char * ptr = line.data();
+		const char * const end = ptr + line.size();
+
+		while (ptr < end)
+		{
+			char ch = *ptr++;
+
+			if (ch == '(')
+			{
+				while (ptr < end && *ptr++ != ')')
+					;
+				continue;
+			}
+
+			if (ch == ';')
+				break;
+
+			if (ch >= 'a' && ch <= 'z')
+				ch -= 'a' - 'A';
+
+			if (ch < 'A' || ch > 'Z')
+				continue;
+
+			float value;
+			if (read_number(ptr, end, value) && !words.has(ch))
+			{
+				words.values[ch - 'A'] = value;
+				words.present |= bit(ch);
+			}
+		}
+
+		return words;
+	}
+
+	/* Reads a signed decimal number at ptr, advancing ptr past it. Scientific notation is not
+	   recognized (the 'E' may be a word). Based on grbl's read_float, as is the number reader in
+	   the firmware's parse.cpp. */
+	static bool read_number(const char *& ptr, const char * end, float & value)
+	{
+		static const double neg_pow10[] = { 1e0, 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8, 1e-9 };
+		const int max_digits = 18;
+
+		const char * p = ptr;
+
+		while (p < end && *p == ' ')
+			p++;
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		uint64_t intval = 0;
+		int exp = 0;
+		int ndigit = 0;
+		bool decimal = false;
+
+		for (; p < end; p++)
+		{
+			const unsigned digit = static_cast<unsigned char>(*p) - '0';
+
+			if (digit <= 9)
+			{
+				if (++ndigit <= max_digits)
+				{
+					intval = intval * 10 + digit;
+					if (decimal)
+						exp--;
+				}
+				else if (!decimal)
+				{
+					exp++; /* drop overflow digits */
+				}
+			}
+			else if (*p == '.' && !decimal)
+			{
+				decimal = true;
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		if (!ndigit)
+			return false;
+
+		double dval = static_cast<double>(intval);
+
+		while (exp < -9)
+		{
+			dval *= 1e-9;
+			exp += 9;
+		}
+
+		while (exp > 0)
+		{
+			dval *= 10.0;
+			exp--;
+		}
+
+		dval *= neg_pow10[-exp];
+
+		value = static_cast<float>(negative ? -dval : dval);
+		ptr = p;
+
+		return true;
+	}
+
+private:
+	static uint32_t bit(char letter) { return 1u << (letter - 'A'); }
+};
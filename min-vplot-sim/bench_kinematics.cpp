@@ -0,0 +1,173 @@
+/* min-vplot-sim: Checks the firmware kinematics against double precision, and estimates their cost.
+
+   Random moves of up to 500 mm within a 1200 x 1100 mm drawing area are solved every mm, as
+   prepare_motion splits them, by line_kinematics and by interpolating the point for pos_from_pt;
+   the string lengths are compared with double precision ones, and the step targets they round
+   to. pt_from_pos is checked at the same points.
+
+   The AVR has no FPU, so the cost of a call is estimated from the float operations it takes, at
+   roughly the average cycle counts of the avr-libc routines for them, and from the 64 bit integer
+   operations of the INTEGER_KINEMATICS path, at the cycle counts of the libgcc routines and of
+   isqrt's loop. This is built both ways (bench_kinematics, bench_kinematics_integer); the host
+   time of line_kinematics::at is printed too, but says little about the AVR.
+
+   Usage: bench_kinematics [move count, default 100000] */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "Arduino.h"
+
+#include "config.h"
+#include "kinematics.h"
+
+namespace
+{
+  /* Float operations of a call, and their cycles on a 16 MHz AVR. */
+  struct float_ops
+  {
+    int add, mul, div, sqrt;
+
+    /* 64 bit multiplies, 64 bit adds and isqrt calls, for INTEGER_KINEMATICS. isqrt runs 21
+       iterations of a 64 bit shift by 2 and 32 bit shifts, compare and subtract: about 60. */
+    int mul64 = 0, add64 = 0, isqrt = 0;
+
+    long cycles() const
+    {
+      return add * 110L + mul * 150L + div * 480L + sqrt * 490L + mul64 * 200L + add64 * 16L + isqrt * 21L * 60L;
+    }
+  };
+
+  /* Counted from the source: adds include subtractions, compares and int/float conversions. */
+  const float_ops interpolated_ops = { 9, 6, 1, 2 }; /* f = x / length, the point, pos_from_pt */
+#if INTEGER_KINEMATICS
+  const float_ops line_ops = { 6, 3, 0, 0, 2, 4, 2 }; /* line_kinematics::at */
+  const float_ops line_start_ops = { 13, 13, 1, 0 };  /* line_kinematics::start, once per move */
+#else
+  const float_ops line_ops = { 6, 2, 0, 2 };         /* line_kinematics::at */
+  const float_ops line_start_ops = { 9, 10, 1, 0 };  /* line_kinematics::start, once per move */
+#endif
+  const float_ops forward_ops = { 5, 4, 2, 1 };      /* pt_from_pos */
+
+  double reference_length(double x, double y, double motor_x)
+  {
+    return std::hypot(x - motor_x, y - ORIGIN_Y);
+  }
+
+  void print_budget(const char * name, const float_ops & ops)
+  {
+    std::printf("%-28s %2d add %2d mul %d div %d sqrt", name, ops.add, ops.mul, ops.div, ops.sqrt);
+
+    if (ops.mul64 || ops.add64 || ops.isqrt)
+      std::printf(" %d mul64 %d add64 %d isqrt", ops.mul64, ops.add64, ops.isqrt);
+
+    std::printf(": %5ld cycles, %6.1f us at 16 MHz\n", ops.cycles(), ops.cycles() / 16.0);
+  }
+
+  /* isqrt against the largest r with r * r <= n, around squares and at random below 2^42. */
+  bool check_isqrt(std::mt19937 & rng)
+  {
+    std::uniform_int_distribution<uint64_t> radicand(0, (uint64_t(1) << 42) - 1);
+
+    for (int n = 0; n < 100000; n++)
+    {
+      const uint64_t r = radicand(rng) >> 21;
+
+      for (const uint64_t value : { r * r, r * r + 2 * r, r * r ? r * r - 1 : 0, radicand(rng) })
+      {
+        uint64_t root = (uint64_t)std::sqrt((double)value);
+
+        while (root * root > value)
+          root--;
+        while ((root + 1) * (root + 1) <= value)
+          root++;
+
+        if (isqrt(value) != root)
+        {
+          std::printf("isqrt(%llu) = %lu, not %llu\n", (unsigned long long)value, (unsigned long)isqrt(value), (unsigned long long)root);
+          return false;
+        }
+      }
+    }
+
+    return true;
+  }
+}
+
+int main(int argc, const char * argv[])
+{
+  const size_t count = argc > 1 ? std::stoul(argv[1]) : 100000;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> x_pos(-600.0f, 600.0f);
+  std::uniform_real_distribution<float> y_pos(-500.0f, 600.0f);
+  std::uniform_real_distribution<float> length(1.0f, 500.0f);
+  std::uniform_real_distribution<float> angle(0.0f, 2.0f * PI);
+
+  double line_error = 0.0, interpolated_error = 0.0, forward_error = 0.0;
+  long line_steps = 0, interpolated_steps = 0;
+  size_t points = 0;
+  std::chrono::steady_clock::duration line_time {};
+
+  for (size_t n = 0; n < count; n++)
+  {
+    const float x = x_pos(rng), y = y_pos(rng), a = angle(rng);
+    const float l = length(rng);
+
+    const cartesian_pt from(x, y);
+    const cartesian_pt to(std::clamp(x + l * std::cos(a), -600.0f, 600.0f), std::clamp(y + l * std::sin(a), -500.0f, 600.0f));
+    const float move_length = std::hypot(to.x - from.x, to.y - from.y);
+
+    if (!(move_length > 0.0f))
+      continue;
+
+    line_kinematics line;
+    line.start(from, to, move_length);
+
+    for (float s = 1.0f; s < move_length; s += 1.0f, points++)
+    {
+      const double f = (double)s / move_length;
+      const double px = from.x + (to.x - from.x) * f, py = from.y + (to.y - from.y) * f;
+      const double ref_a = reference_length(px, py, ORIGIN_X), ref_b = reference_length(px, py, -ORIGIN_X);
+      const long ref_a_steps = STEPS_PER_MM * ref_a, ref_b_steps = STEPS_PER_MM * ref_b;
+
+      const auto line_begin = std::chrono::steady_clock::now();
+      const plot_pos by_line = line.at(s);
+      line_time += std::chrono::steady_clock::now() - line_begin;
+
+      const float fi = s / move_length;
+      const plot_pos by_point = pos_from_pt(cartesian_pt(from.x + (to.x - from.x) * fi, from.y + (to.y - from.y) * fi));
+      const cartesian_pt back = pt_from_pos(by_point);
+
+      line_error = std::max({ line_error, std::abs(by_line.a - ref_a), std::abs(by_line.b - ref_b) });
+      interpolated_error = std::max({ interpolated_error, std::abs(by_point.a - ref_a), std::abs(by_point.b - ref_b) });
+      forward_error = std::max(forward_error, std::hypot(back.x - px, back.y - py));
+
+      line_steps = std::max({ line_steps,
+        std::abs((long)(STEPS_PER_MM * by_line.a) - ref_a_steps), std::abs((long)(STEPS_PER_MM * by_line.b) - ref_b_steps) });
+      interpolated_steps = std::max({ interpolated_steps,
+        std::abs((long)(STEPS_PER_MM * by_point.a) - ref_a_steps), std::abs((long)(STEPS_PER_MM * by_point.b) - ref_b_steps) });
+    }
+  }
+
+  const bool isqrt_ok = check_isqrt(rng);
+
+  std::printf("%zu points on %zu moves, one step is %.4f mm, %s kinematics\n", points, count, 1.0 / (STEPS_PER_MM),
+    INTEGER_KINEMATICS ? "integer" : "float");
+  std::printf("line_kinematics::at:         max error %.5f mm, %ld steps, %.1f ns per call on this host\n", line_error, line_steps,
+    std::chrono::duration<double, std::nano>(line_time).count() / std::max(points, size_t(1)));
+  std::printf("interpolated pos_from_pt:    max error %.5f mm, %ld steps\n", interpolated_error, interpolated_steps);
+  std::printf("pt_from_pos (of the above):  max error %.5f mm\n", forward_error);
+
+  print_budget("line_kinematics::at", line_ops);
+  print_budget("interpolated pos_from_pt", interpolated_ops);
+  print_budget("line_kinematics::start", line_start_ops);
+  print_budget("pt_from_pos", forward_ops);
+
+  /* Truncating to steps can round either side of a step boundary: one step is the bound. */
+  return line_steps <= 1 && isqrt_ok ? 0 : 1;
+}
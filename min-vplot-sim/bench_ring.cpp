@@ -0,0 +1,132 @@
+/* min-vplot-sim: Checks the ring behind the block buffer and the segment queue (see ring.h).
+
+   Wraparound: a ring of 8 is filled and emptied in steps of every size, so that its indices wrap
+   at 256 at every position, checking the count, full and empty, and the items in between.
+
+   Concurrent access: a producer thread pushes numbered items, of several bytes so that a torn or
+   early read shows up, while a consumer thread pops and checks them in order, with no locks, as
+   the main loop and the stepper ISR do.
+
+   Usage: bench_ring [item count for the concurrent check, default 10000000] */
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "ring.h"
+
+namespace
+{
+  struct item
+  {
+    uint32_t n;
+    uint32_t check; /* ~n */
+    long pad[2];    /* n, -n */
+  };
+
+  int errors = 0;
+
+  void fail(const char * what, unsigned long at)
+  {
+    if (errors++ < 10)
+      std::printf("error: %s at %lu\n", what, at);
+  }
+
+  void check_wraparound()
+  {
+    ring<uint32_t, 8> queue;
+    uint32_t pushed = 0, popped = 0;
+
+    for (int round = 0; round < 2000; round++)
+    {
+      const int fill = round % 9; /* 0 to 8 */
+
+      for (int i = 0; i < fill; i++)
+      {
+        if (queue.full())
+          fail("full early", pushed);
+
+        queue.back() = pushed++;
+        queue.push();
+      }
+
+      if (queue.count() != fill)
+        fail("count", pushed);
+      if (queue.full() != (fill == 8))
+        fail("full", pushed);
+
+      /* In between, by index, as the planner walks the block buffer. */
+      uint32_t expected = popped;
+      for (uint8_t index = queue.get_front(); index != queue.get_back(); index++)
+        if (queue.at(index) != expected++)
+          fail("item by index", expected);
+
+      while (!queue.empty())
+      {
+        if (queue.front() != popped++)
+          fail("item", popped);
+        queue.pop();
+      }
+    }
+
+    std::printf("wraparound: %lu items through a ring of 8, indices wrapped %lu times\n",
+      (unsigned long)pushed, (unsigned long)pushed / 256);
+  }
+
+  void check_concurrent(uint32_t count)
+  {
+    static ring<item, 8> queue;
+    unsigned long full_waits = 0, empty_waits = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::thread producer([&]() {
+      for (uint32_t n = 0; n < count; n++)
+      {
+        for (; queue.full(); full_waits++)
+          std::this_thread::yield(); /* the other thread may share the one core */
+
+        item & slot = queue.back();
+        slot.n = n;
+        slot.check = ~n;
+        slot.pad[0] = n;
+        slot.pad[1] = -(long)n;
+        queue.push();
+      }
+    });
+
+    std::thread consumer([&]() {
+      for (uint32_t n = 0; n < count; n++)
+      {
+        for (; queue.empty(); empty_waits++)
+          std::this_thread::yield();
+
+        const item & slot = queue.front();
+        if (slot.n != n || slot.check != ~n || slot.pad[0] != (long)n || slot.pad[1] != -(long)n)
+          fail("concurrent item", n);
+        queue.pop();
+      }
+    });
+
+    producer.join();
+    consumer.join();
+
+    const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("concurrent: %lu items in %.3f s (%.1f M/s), %lu full and %lu empty polls\n",
+      (unsigned long)count, s, count / s / 1e6, full_waits, empty_waits);
+  }
+}
+
+int main(int argc, const char * argv[])
+{
+  const uint32_t count = argc > 1 ? std::stoul(argv[1]) : 10000000;
+
+  check_wraparound();
+  check_concurrent(count);
+
+  std::printf("%d errors\n", errors);
+
+  return errors ? 1 : 0;
+}
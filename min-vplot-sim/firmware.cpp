@@ -0,0 +1,5 @@
+/* min-vplot-sim: Builds the unmodified sketch as a C++ translation unit. */
+
+#include "Arduino.h"
+
+#include "../min-vplot.ino"
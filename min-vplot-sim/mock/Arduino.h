@@ -0,0 +1,72 @@
+/* min-vplot-sim: Arduino core API subset used by the firmware, backed by sim/runtime.cpp. */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+using std::abs;
+
+#define PI 3.1415926535897932384626433832795
+#define TWO_PI 6.283185307179586476925286766559
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+/* The Arduino core defines these as macros that accept mixed argument types. Decayed: with both
+   arguments of one type, the conditional is an lvalue of a parameter. */
+template <typename A, typename B>
+inline auto max(A a, B b) -> std::decay_t<decltype(a > b ? a : b)> { return a > b ? a : b; }
+
+template <typename A, typename B>
+inline auto min(A a, B b) -> std::decay_t<decltype(a < b ? a : b)> { return a < b ? a : b; }
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+
+void delay(unsigned long ms);
+unsigned long millis();
+unsigned long micros();
+
+void noInterrupts();
+void interrupts();
+
+#define SERIAL_TX_BUFFER_SIZE 64
+
+class HardwareSerial
+{
+public:
+  void begin(unsigned long) {}
+  void setTimeout(unsigned long) {}
+  void flush(); /* waits until the TX buffer has been sent */
+
+  explicit operator bool() const { return true; }
+
+  int read();
+  int peek();
+  int available();
+  int availableForWrite();
+
+  size_t write(const char * str);
+
+  size_t print(const char * str) { return write(str); }
+  size_t print(char c) { const char str[2] = { c, 0 }; return write(str); }
+  size_t print(int value) { return print(static_cast<long>(value)); }
+  size_t print(unsigned int value) { return print(static_cast<unsigned long>(value)); }
+  size_t print(long value) { char buf[24]; snprintf(buf, sizeof(buf), "%ld", value); return write(buf); }
+  size_t print(unsigned long value) { char buf[24]; snprintf(buf, sizeof(buf), "%lu", value); return write(buf); }
+  size_t print(double value, int digits = 2) { char buf[48]; snprintf(buf, sizeof(buf), "%.*f", digits, value); return write(buf); }
+
+  size_t println() { return write("\r\n"); }
+
+  template <typename T>
+  size_t println(T value) { return print(value) + println(); }
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,3 @@
+/* min-vplot-sim: EEPROM is included by the firmware but not used. */
+
+#pragma once
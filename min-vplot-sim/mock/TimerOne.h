@@ -0,0 +1,18 @@
+/* min-vplot-sim: TimerOne mock; the period drives sim::advance. */
+
+#pragma once
+
+class TimerOne
+{
+public:
+  unsigned long period_us = 0;
+  void (*isr)() = nullptr;
+
+  void initialize(unsigned long period);
+
+  /* Like the AVR timer, from within the ISR this times the period that has just begun. */
+  void setPeriod(unsigned long period) { period_us = period; }
+  void attachInterrupt(void (*fn)()) { isr = fn; }
+};
+
+extern TimerOne Timer1;
@@ -0,0 +1,74 @@
+/* min-vplot-sim: Host simulation of the min-vplot firmware. */
+
+#include "program.h"
+
+#include <fstream>
+
+/* Kept apart from the firmware translation units: the sender's types.h and the Arduino
+   headers both define PI/TWO_PI. */
+#include "../min-vplot-sender/parse.h"
+#include "../min-vplot-sender/frame_encoder.h"
+
+static bool parse_file(const std::string & path, float segment_tolerance, gcode_parser & parser)
+{
+  std::ifstream file(path);
+  if (!file)
+    return false;
+
+  for (std::string line; std::getline(file, line);)
+    parser.add(line);
+
+  if (segment_tolerance > 0.0f)
+  {
+    kinematic_segmenter segmenter(segment_tolerance);
+    parser.segment(segmenter, pos2(0.0f, 0.0f)); // the machine starts at the origin
+  }
+
+  return true;
+}
+
+std::vector<std::string> load_program(const std::string & path, float segment_tolerance)
+{
+  std::vector<std::string> lines;
+
+  gcode_parser parser;
+  if (!parse_file(path, segment_tolerance, parser))
+    return lines;
+
+  for (; !parser.empty(); parser.pop_front())
+    lines.push_back(parser.front());
+
+  lines.push_back(block(pos2(0.0f, 0.0f))); // return to home
+
+  return lines;
+}
+
+std::vector<std::string> load_frames(const std::string & path, float segment_tolerance)
+{
+  std::vector<std::string> frames;
+
+  gcode_parser parser;
+  if (!parse_file(path, segment_tolerance, parser))
+    return frames;
+
+  frame_encoder encoder;
+
+  auto add = [&](const block & b)
+  {
+    if (!encoder.add(b))
+    {
+      frames.push_back(encoder.finish());
+      encoder.add(b);
+    }
+  };
+
+  for (; !parser.empty(); parser.pop_front())
+    add(parser.front());
+
+  add(block(pos2(0.0f, 0.0f))); // return to home
+
+  if (!encoder.empty())
+    frames.push_back(encoder.finish());
+
+  return frames;
+}
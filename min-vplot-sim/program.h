@@ -0,0 +1,14 @@
+/* min-vplot-sim: Host simulation of the min-vplot firmware. */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+/* Reads an NC file and returns the lines the sender would transmit for it: arcs expanded,
+   units converted, G1 moves split to segment_tolerance if positive (--segment), followed by
+   the return to home. Empty if the file cannot be read. */
+std::vector<std::string> load_program(const std::string & path, float segment_tolerance = 0.0f);
+
+/* The same program packed into binary frames (see ../frame.h), numbered from 0. */
+std::vector<std::string> load_frames(const std::string & path, float segment_tolerance = 0.0f);
@@ -0,0 +1,196 @@
+/* min-vplot-sim: Host simulation of the min-vplot firmware. */
+
+#include "runtime.h"
+
+#include "Arduino.h"
+#include "TimerOne.h"
+
+namespace sim
+{
+  uint64_t now_us = 0;
+  bool interrupts_enabled = true;
+  bool in_delay = false;
+  void (*tick_observer)() = nullptr;
+
+  serial_link link;
+
+  static uint64_t next_tick_us = 0;
+  static bool tick_pending = false;
+
+  static void fire_tick()
+  {
+    if (Timer1.isr)
+      Timer1.isr();
+
+    tick_pending = false;
+  }
+
+  void advance(uint64_t us)
+  {
+    const uint64_t target = now_us + us;
+
+    while (Timer1.period_us && next_tick_us <= target)
+    {
+      now_us = next_tick_us;
+      link.deliver(now_us);
+
+      if (interrupts_enabled)
+        fire_tick();
+      else
+        tick_pending = true; /* the AVR latches one pending compare interrupt */
+
+      if (tick_observer)
+        tick_observer();
+
+      next_tick_us += Timer1.period_us;
+    }
+
+    now_us = target;
+    link.deliver(now_us);
+  }
+
+  void set_interrupts(bool enabled)
+  {
+    interrupts_enabled = enabled;
+
+    if (enabled && tick_pending)
+      fire_tick();
+  }
+
+  void start_timer()
+  {
+    next_tick_us = now_us + Timer1.period_us;
+  }
+
+  static uint64_t byte_us(double baud)
+  {
+    return static_cast<uint64_t>(10.0 * 1e6 / baud + 0.5);
+  }
+
+  void serial_link::send(const std::string & bytes)
+  {
+    const uint64_t byte_us = sim::byte_us(baud);
+
+    for (const char c : bytes)
+    {
+      wire_free_us = std::max(now_us, wire_free_us) + byte_us;
+      wire.emplace_back(wire_free_us, c);
+    }
+  }
+
+  void serial_link::deliver(uint64_t until_us)
+  {
+    while (!wire.empty() && wire.front().first <= until_us)
+    {
+      if (rx.size() < rx_buffer_size)
+        rx.push_back(wire.front().second);
+      else
+        rx_lost++;
+
+      wire.pop_front();
+    }
+
+    while (!tx_wire.empty() && tx_wire.front().first <= until_us)
+    {
+      tx.push_back(tx_wire.front().second);
+      tx_wire.pop_front();
+    }
+  }
+
+  void serial_link::transmit(char c)
+  {
+    while (tx_wire.size() >= tx_buffer_size)
+      advance(tx_wire.front().first - now_us);
+
+    tx_free_us = std::max(now_us, tx_free_us) + byte_us(baud);
+    tx_wire.emplace_back(tx_free_us, c);
+
+    if (c == '\n')
+      tx_lines++;
+  }
+
+  void serial_link::flush()
+  {
+    if (!tx_wire.empty())
+      advance(tx_free_us - now_us);
+  }
+}
+
+/* Arduino runtime */
+
+HardwareSerial Serial;
+TimerOne Timer1;
+
+void delay(unsigned long ms)
+{
+  sim::in_delay = true;
+  sim::advance(ms * 1000ULL);
+  sim::in_delay = false;
+}
+
+unsigned long millis()
+{
+  return static_cast<unsigned long>(sim::now_us / 1000);
+}
+
+unsigned long micros()
+{
+  return static_cast<unsigned long>(sim::now_us);
+}
+
+void noInterrupts()
+{
+  sim::set_interrupts(false);
+}
+
+void interrupts()
+{
+  sim::set_interrupts(true);
+}
+
+int HardwareSerial::read()
+{
+  if (sim::link.rx.empty())
+    return -1;
+
+  const char c = sim::link.rx.front();
+  sim::link.rx.pop_front();
+  return static_cast<unsigned char>(c);
+}
+
+int HardwareSerial::peek()
+{
+  if (sim::link.rx.empty())
+    return -1;
+
+  return static_cast<unsigned char>(sim::link.rx.front());
+}
+
+int HardwareSerial::available()
+{
+  return static_cast<int>(sim::link.rx.size());
+}
+
+int HardwareSerial::availableForWrite()
+{
+  return static_cast<int>(sim::link.tx_buffer_size - sim::link.tx_wire.size());
+}
+
+size_t HardwareSerial::write(const char * str)
+{
+  for (const char * c = str; *c; c++)
+    sim::link.transmit(*c);
+
+  return strlen(str);
+}
+
+void HardwareSerial::flush()
+{
+  sim::link.flush();
+}
+
+void TimerOne::initialize(unsigned long period)
+{
+  period_us = period;
+  sim::start_timer();
+}
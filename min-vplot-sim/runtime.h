@@ -0,0 +1,63 @@
+/* min-vplot-sim: Host simulation of the min-vplot firmware. */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+
+/* Virtual time and peripherals shared by the Arduino mocks and the simulation driver.
+   Nothing here runs in real time: the clock only moves when the driver (or a delay() in the
+   firmware) advances it, and the timer ISR fires once for every period crossed. */
+namespace sim
+{
+  /* Current virtual time in microseconds. */
+  extern uint64_t now_us;
+
+  /* Moves the clock forward, delivering serial bytes and firing the timer ISR on the way. */
+  void advance(uint64_t us);
+
+  /* Interrupt state, see noInterrupts()/interrupts(). */
+  extern bool interrupts_enabled;
+  void set_interrupts(bool enabled);
+
+  /* True while the firmware is inside delay(). */
+  extern bool in_delay;
+
+  /* Starts the timer ISR period from the current time; see TimerOne::initialize. */
+  void start_timer();
+
+  /* Called after every timer ISR (or every timer period while interrupts are disabled). */
+  extern void (*tick_observer)();
+
+  /* Serial link: host -> controller bytes travel at baud rate into the RX buffer, and controller
+     -> host bytes out of the TX buffer; writing blocks while the TX buffer is full. */
+  struct serial_link
+  {
+    double baud = 115200.0;
+    size_t rx_buffer_size = 64; /* SERIAL_RX_BUFFER_SIZE */
+
+    std::deque<std::pair<uint64_t, char>> wire; /* arrival time, byte */
+    uint64_t wire_free_us = 0;
+
+    std::deque<char> rx;
+    size_t rx_lost = 0;
+
+    size_t tx_buffer_size = 64; /* SERIAL_TX_BUFFER_SIZE */
+
+    std::deque<std::pair<uint64_t, char>> tx_wire; /* time the byte is out, byte */
+    uint64_t tx_free_us = 0;
+    size_t tx_lines = 0; /* line ends written by the controller */
+
+    std::string tx; /* controller output received, not yet consumed by the driver */
+
+    void send(const std::string & bytes);
+    void deliver(uint64_t until_us);
+
+    /* Controller side: queues a byte for the host, and waits for the TX buffer to empty. */
+    void transmit(char c);
+    void flush();
+  };
+
+  extern serial_link link;
+}
@@ -0,0 +1,634 @@
+/* min-vplot-sim: Host simulation of the min-vplot firmware.
+
+   Runs setup() and loop() from min-vplot.ino against mocked Arduino peripherals on a virtual
+   clock, feeding an NC program the way the sender does (character counting flow control over
+   a serial link at baud rate). The timer ISR fires at the end of each period it sets, in virtual
+   time.
+
+   Usage: min-vplot-sim <nc file> [--trace <csv>] [--baud 115200] [--rx-buffer 64]
+                        [--loop-us 20] [--parse-us 300] [--plan-us 80] [--segment-us 160]
+                        [--binary] [--corrupt 0] [--segment <mm>] [--status <hz>]
+                        [--require-full]
+
+   --binary sends binary frames (see ../frame.h) instead of text lines, and --corrupt flips
+   one bit of a frame byte on the wire with the given probability, to exercise resending.
+   --segment splits G1 moves as the sender's option does. --status sends a status query (see
+   ../status.h) between lines or frames at the given rate, outside the character count, and
+   gives the time to each report. --require-full fails the run unless the block buffer, the
+   segment queue and the host's send window were each full at some point, so a check that
+   passes has had the flow control and the planner under load. Configure with
+   -DCMAKE_CXX_FLAGS=-DLINE_CORRECTION=0 to run the firmware without its line correction.
+
+   loop() costs no host time in the simulation, so each pass is charged a fixed virtual cost:
+   loop-us for every pass, plus parse-us when a line was parsed, plan-us for every buffered block
+   the planner walks when a block is added (a sqrt in each of its two passes) and segment-us for
+   every step segment prepare_motion queued (about 3 sqrts and 2 divides, by the code's own
+   estimate of ~500 cycles each; see bench_kinematics). A frame is charged parse-us like a line.
+   Output leaves at baud rate through a 64 byte TX buffer, so loop() itself takes virtual time
+   when it waits for it; the loop pass line gives the mean and largest cost of a pass.
+
+   Moves are counted as the step segments the ISR executes, and deviation is measured from
+   the line between their end points. The peak step rate is the most steps either motor took
+   in 10 ms, per second; the ISR steps at most every MIN_STEP_PERIOD_US. ISR load is given as
+   timer interrupts per second, while the motors move and otherwise. */
+
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "runtime.h"
+#include "program.h"
+
+#include "config.h"
+#include "geo.h"
+#include "buffer.h"
+#include "segment.h"
+#include "machine.h"
+#include "status.h"
+
+extern machine_state current_state;
+
+void setup();
+void loop();
+
+struct sim_options
+{
+  std::string nc_path;
+  std::string trace_path;
+
+  double baud = 115200.0;
+  size_t rx_buffer = 64;
+
+  uint64_t loop_us = 20;
+  uint64_t parse_us = 300;
+  uint64_t plan_us = 80;
+  uint64_t segment_us = 160;
+
+  bool binary = false;
+  double corrupt = 0.0;
+
+  float segment_tolerance = 0.0f; /* off */
+
+  double status_hz = 0.0; /* off */
+
+  bool require_full = false;
+
+  double max_hours = 48.0;
+};
+
+/* Host side of the link: character counting, as the sender's --streaming mode. With frames,
+   the sender's resending: "rs <n>" means nothing is in flight any more, send again from
+   frame n. */
+struct host
+{
+  std::vector<std::string> lines; /* or frames, numbered from 0 */
+  bool frames = false;
+  size_t next = 0;
+  size_t acked = 0; /* frames: all before this one were accepted */
+
+  std::deque<size_t> in_flight;
+  size_t in_flight_bytes = 0;
+  size_t rx_buffer = 64;
+
+  bool ready = false;
+  bool negotiating = false;
+  std::string input;
+
+  size_t frames_resent = 0;
+  size_t window_waits = 0; /* lines or frames that waited for room in the send window */
+  bool waiting = false;
+  size_t lines_unsent = 0; /* from the first line longer than the RX buffer, when the job was aborted */
+  bool aborted = false;
+
+  uint64_t status_period_us = 0; /* off */
+  uint64_t next_status_us = 0;
+  std::deque<uint64_t> queries; /* times of those unanswered */
+
+  size_t status_reports = 0;
+  size_t bad_reports = 0;
+  uint64_t report_us = 0; /* query to report, summed */
+  uint64_t max_report_us = 0;
+  status_report last_report;
+  size_t longest_report = 0;
+
+  std::mt19937 rng{ 1 };
+  std::bernoulli_distribution corrupt{ 0.0 };
+  size_t bits_flipped = 0;
+
+  bool done() const { return !negotiating && next == lines.size() && in_flight.empty(); }
+
+  void acknowledge()
+  {
+    in_flight_bytes -= in_flight.front();
+    in_flight.pop_front();
+  }
+
+  void send(const std::string & bytes)
+  {
+    sim::link.send(bytes);
+    in_flight.push_back(bytes.length());
+    in_flight_bytes += bytes.length();
+  }
+
+  void pump()
+  {
+    input.append(sim::link.tx);
+    sim::link.tx.clear();
+
+    size_t line_end;
+    while ((line_end = input.find("\r\n")) != std::string::npos)
+    {
+      const std::string line = input.substr(0, line_end);
+      input.erase(0, line_end + 2);
+
+      if (line == "Ready")
+      {
+        ready = true;
+
+        if (frames)
+        {
+          send("$B\r\n");
+          negotiating = true;
+        }
+      }
+      else if (negotiating && !in_flight.empty())
+      {
+        acknowledge();
+        negotiating = false;
+
+        if (line != "ok")
+        {
+          std::cout << "controller: " << line << std::endl;
+          frames = false;
+          lines.clear(); /* nothing to fall back to */
+        }
+      }
+      else if (frames && line == "ok" && !in_flight.empty())
+      {
+        acknowledge();
+        acked++;
+      }
+      else if (frames && line.compare(0, 3, "rs ") == 0 && !in_flight.empty())
+      {
+        while (!in_flight.empty())
+          acknowledge();
+
+        /* The first frame at or after acked with the expected sequence number. */
+        const uint8_t expected = static_cast<uint8_t>(std::stoi(line.substr(3)));
+        acked += static_cast<uint8_t>(expected - acked);
+
+        frames_resent += next - acked;
+        next = acked;
+      }
+      else if ((line == "ok" || line.compare(0, 5, "error") == 0) && !in_flight.empty())
+      {
+        acknowledge();
+      }
+      else if (line[0] == '<' && !queries.empty())
+      {
+        if (!last_report.parse(line.data(), static_cast<uint16_t>(line.length())))
+          bad_reports++;
+
+        longest_report = std::max(longest_report, line.length());
+
+        const uint64_t elapsed_us = sim::now_us - queries.front();
+        queries.pop_front();
+
+        status_reports++;
+        report_us += elapsed_us;
+        max_report_us = std::max(max_report_us, elapsed_us);
+      }
+      else
+      {
+        std::cout << "controller: " << line << std::endl;
+      }
+    }
+
+    if (ready && status_period_us && sim::now_us >= next_status_us)
+    {
+      sim::link.send(std::string(1, STATUS_QUERY));
+      queries.push_back(sim::now_us);
+      next_status_us = sim::now_us + status_period_us;
+    }
+
+    while (ready && !negotiating && next < lines.size())
+    {
+      std::string bytes = frames ? lines[next] : lines[next] + "\r\n";
+
+      if (!frames && bytes.length() > rx_buffer)
+      {
+        std::cout << "line longer than the RX buffer, job aborted: " << lines[next] << std::endl;
+        lines_unsent = lines.size() - next;
+        next = lines.size(); /* as by the sender */
+        aborted = true;
+        break;
+      }
+
+      if (!in_flight.empty() && in_flight_bytes + bytes.length() > rx_buffer)
+      {
+        if (!waiting)
+          window_waits++;
+
+        waiting = true;
+        break;
+      }
+
+      waiting = false;
+
+      if (frames)
+      {
+        for (auto & c : bytes)
+        {
+          if (corrupt(rng))
+          {
+            c ^= 1 << std::uniform_int_distribution<int>(0, 7)(rng);
+            bits_flipped++;
+          }
+        }
+      }
+
+      send(bytes);
+      next++;
+    }
+  }
+};
+
+/* Motion statistics, sampled on every timer tick. The time up to a tick is counted in the state
+   the tick before it saw, as the ISR only changes the state when it runs. */
+struct metrics
+{
+  std::ofstream trace;
+
+  bool armed = false; /* set once setup() has homed the motor positions */
+  bool started = false;
+  bool was_moving = false;
+  bool was_settling = false;
+
+  uint64_t armed_us = 0;
+  uint64_t start_us = 0;
+  uint64_t last_motion_us = 0;
+  uint64_t last_tick_us = 0;
+
+  uint64_t motion_us = 0;
+  uint64_t idle_us = 0;
+  uint64_t dwell_us = 0;
+  uint64_t pending_idle_us = 0; /* only counted once motion resumes */
+  uint64_t pending_dwell_us = 0;
+  uint64_t moves = 0;
+
+  uint64_t passes = 0; /* of loop(), with their virtual cost */
+  uint64_t pass_us = 0;
+  uint64_t max_pass_us = 0;
+  uint64_t blocked_us = 0; /* of it, waiting on serial output */
+  uint64_t buffer_full_passes = 0; /* ending with the block buffer full */
+  uint64_t segments_full_passes = 0; /* ending with the segment queue full */
+
+  uint64_t motion_interrupts = 0; /* ISR runs while moving */
+  uint64_t other_interrupts = 0;
+
+  long last_a = 0, last_b = 0;
+  int last_servo = -1;
+
+  long a_dest = 0, b_dest = 0;
+
+  uint64_t window_start_us = 0;
+  long window_a = 0, window_b = 0; /* steps in the window */
+  double peak_step_rate = 0.0;
+
+  cartesian_pt segment_start, segment_end;
+  double max_deviation = 0.0;
+  double max_pen_down_deviation = 0.0;
+};
+
+static metrics stats;
+
+static bool is_moving()
+{
+  return current_state.motor_a.get_position() != current_state.a_dest ||
+    current_state.motor_b.get_position() != current_state.b_dest;
+}
+
+/* Forward kinematics in double precision from motor step positions. */
+static void plotter_xy(long a_steps, long b_steps, double & x, double & y)
+{
+  const double a = a_steps / (STEPS_PER_MM);
+  const double b = b_steps / (STEPS_PER_MM);
+
+  x = (b * b - a * a) / (2.0 * STEPPER_DISTANCE_MM);
+
+  const double dx = x - ORIGIN_X;
+  y = ORIGIN_Y - std::sqrt(std::max(0.0, a * a - dx * dx));
+}
+
+static double distance_to_segment(double x, double y, const cartesian_pt & p0, const cartesian_pt & p1)
+{
+  const double vx = p1.x - p0.x, vy = p1.y - p0.y;
+  const double wx = x - p0.x, wy = y - p0.y;
+
+  const double len_sq = vx * vx + vy * vy;
+  const double t = len_sq > 0.0 ? std::min(1.0, std::max(0.0, (wx * vx + wy * vy) / len_sq)) : 0.0;
+
+  return std::hypot(wx - t * vx, wy - t * vy);
+}
+
+static void observe_tick()
+{
+  const long a = current_state.motor_a.get_position();
+  const long b = current_state.motor_b.get_position();
+  const bool moving = is_moving();
+
+  if (stats.trace.is_open())
+  {
+    if (a != stats.last_a || b != stats.last_b)
+      stats.trace << sim::now_us << ",step," << a << "," << b << "\n";
+
+    if (current_state.pen_servo.get_degrees() != stats.last_servo)
+      stats.trace << sim::now_us << ",servo," << (int)current_state.pen_servo.get_degrees() << ",\n";
+  }
+
+  const long a_steps = std::abs(a - stats.last_a);
+  const long b_steps = std::abs(b - stats.last_b);
+
+  stats.last_a = a;
+  stats.last_b = b;
+  stats.last_servo = current_state.pen_servo.get_degrees();
+
+  if (!stats.armed)
+    return;
+
+  const uint64_t elapsed_us = sim::now_us - stats.last_tick_us;
+  stats.last_tick_us = sim::now_us;
+
+  if (stats.was_moving)
+    stats.motion_interrupts++;
+  else
+    stats.other_interrupts++;
+
+  stats.window_a += a_steps;
+  stats.window_b += b_steps;
+
+  if (sim::now_us - stats.window_start_us >= 10000)
+  {
+    stats.peak_step_rate = std::max(stats.peak_step_rate,
+      std::max(stats.window_a, stats.window_b) * 1e6 / (sim::now_us - stats.window_start_us));
+    stats.window_start_us = sim::now_us;
+    stats.window_a = stats.window_b = 0;
+  }
+
+  if (current_state.a_dest != stats.a_dest || current_state.b_dest != stats.b_dest)
+  {
+    double x, y;
+    plotter_xy(current_state.a_dest, current_state.b_dest, x, y);
+
+    stats.a_dest = current_state.a_dest;
+    stats.b_dest = current_state.b_dest;
+
+    stats.segment_start = stats.segment_end;
+    stats.segment_end = cartesian_pt(x, y);
+    stats.moves++;
+  }
+
+  if (!stats.started)
+  {
+    stats.was_moving = moving;
+
+    if (!moving)
+      return;
+
+    stats.started = true;
+    stats.start_us = sim::now_us;
+  }
+  else if (stats.was_moving)
+  {
+    stats.motion_us += elapsed_us;
+    stats.last_motion_us = sim::now_us;
+  }
+  else if (stats.was_settling)
+  {
+    stats.pending_dwell_us += elapsed_us;
+  }
+  else
+  {
+    stats.pending_idle_us += elapsed_us;
+  }
+
+  if (moving)
+  {
+    if (!stats.was_moving)
+    {
+      stats.idle_us += stats.pending_idle_us;
+      stats.dwell_us += stats.pending_dwell_us;
+      stats.pending_idle_us = stats.pending_dwell_us = 0;
+    }
+
+    double x, y;
+    plotter_xy(a, b, x, y);
+
+    const double deviation = distance_to_segment(x, y, stats.segment_start, stats.segment_end);
+    stats.max_deviation = std::max(stats.max_deviation, deviation);
+
+    if (current_state.pen_servo.get_degrees() == 0)
+      stats.max_pen_down_deviation = std::max(stats.max_pen_down_deviation, deviation);
+  }
+
+  stats.was_moving = moving;
+  stats.was_settling = current_state.settling;
+}
+
+static bool parse_args(int argc, const char * argv[], sim_options & opt)
+{
+  for (int arg_idx = 1; arg_idx < argc; arg_idx++)
+  {
+    const std::string arg = argv[arg_idx];
+    const bool has_value = arg_idx + 1 < argc;
+
+    if (arg == "--trace" && has_value)
+      opt.trace_path = argv[++arg_idx];
+    else if (arg == "--baud" && has_value)
+      opt.baud = std::stod(argv[++arg_idx]);
+    else if (arg == "--rx-buffer" && has_value)
+      opt.rx_buffer = std::stoul(argv[++arg_idx]);
+    else if (arg == "--loop-us" && has_value)
+      opt.loop_us = std::stoull(argv[++arg_idx]);
+    else if (arg == "--parse-us" && has_value)
+      opt.parse_us = std::stoull(argv[++arg_idx]);
+    else if (arg == "--plan-us" && has_value)
+      opt.plan_us = std::stoull(argv[++arg_idx]);
+    else if (arg == "--segment-us" && has_value)
+      opt.segment_us = std::stoull(argv[++arg_idx]);
+    else if (arg == "--segment" && has_value)
+      opt.segment_tolerance = std::stof(argv[++arg_idx]);
+    else if (arg == "--binary")
+      opt.binary = true;
+    else if (arg == "--corrupt" && has_value)
+      opt.corrupt = std::stod(argv[++arg_idx]);
+    else if (arg == "--status" && has_value)
+      opt.status_hz = std::stod(argv[++arg_idx]);
+    else if (arg == "--require-full")
+      opt.require_full = true;
+    else if (arg.compare(0, 2, "--") != 0 && opt.nc_path.empty())
+      opt.nc_path = arg;
+    else
+      return false;
+  }
+
+  return !opt.nc_path.empty();
+}
+
+int main(int argc, const char * argv[])
+{
+  sim_options opt;
+
+  if (!parse_args(argc, argv, opt))
+  {
+    std::cout << "usage: min-vplot-sim <nc file> [--trace <csv>] [--baud 115200] [--rx-buffer 64]\n"
+      "                     [--loop-us 20] [--parse-us 300] [--plan-us 80] [--segment-us 160]\n"
+      "                     [--binary] [--corrupt 0] [--segment <mm>] [--status <hz>]\n"
+      "                     [--require-full]" << std::endl;
+    return 1;
+  }
+
+  host controller_host;
+  controller_host.lines = opt.binary ? load_frames(opt.nc_path, opt.segment_tolerance) : load_program(opt.nc_path, opt.segment_tolerance);
+  controller_host.frames = opt.binary;
+  controller_host.corrupt = std::bernoulli_distribution(opt.corrupt);
+  controller_host.rx_buffer = opt.rx_buffer;
+  controller_host.status_period_us = opt.status_hz > 0.0 ? static_cast<uint64_t>(1e6 / opt.status_hz) : 0;
+
+  if (controller_host.lines.empty())
+  {
+    std::cout << "Input file error: " << opt.nc_path << std::endl;
+    return 1;
+  }
+
+  if (!opt.trace_path.empty())
+  {
+    stats.trace.open(opt.trace_path);
+    stats.trace << "t_us,event,a_steps|degrees,b_steps\n";
+  }
+
+  sim::link.baud = opt.baud;
+  sim::link.rx_buffer_size = opt.rx_buffer;
+  sim::tick_observer = observe_tick;
+
+  sim::link.send(">");
+
+  setup();
+
+  stats.a_dest = current_state.a_dest;
+  stats.b_dest = current_state.b_dest;
+  stats.last_a = current_state.motor_a.get_position();
+  stats.last_b = current_state.motor_b.get_position();
+  stats.window_start_us = sim::now_us;
+  stats.last_tick_us = sim::now_us;
+  stats.armed_us = sim::now_us;
+  stats.armed = true;
+
+  const uint64_t limit_us = static_cast<uint64_t>(opt.max_hours * 3600e6);
+  bool stalled = false;
+
+  while (true)
+  {
+    controller_host.pump();
+
+    const int queued = get_segment_count();
+    const int back = get_buffer_back();
+    const size_t answered = sim::link.tx_lines;
+    const uint64_t pass_start_us = sim::now_us;
+
+    loop();
+
+    const uint64_t blocked_us = sim::now_us - pass_start_us; /* waiting on serial output */
+    const bool parsed = sim::link.tx_lines != answered; /* parse_line answers every line */
+
+    /* The ISR only runs within loop() while it is blocked. */
+    const int prepared = std::max(get_segment_count() - queued, 0);
+    const int added = (uint8_t)(get_buffer_back() - back);
+    const int buffered = get_buffer_count();
+
+    controller_host.pump();
+
+    const uint64_t charged_us = opt.loop_us + (parsed ? opt.parse_us : 0) + added * buffered * opt.plan_us + prepared * opt.segment_us;
+    sim::advance(charged_us);
+
+    stats.passes++;
+    stats.pass_us += blocked_us + charged_us;
+    stats.max_pass_us = std::max(stats.max_pass_us, blocked_us + charged_us);
+    stats.blocked_us += blocked_us;
+
+    if (get_buffer_full())
+      stats.buffer_full_passes++;
+
+    if (get_segments_full())
+      stats.segments_full_passes++;
+
+    if (controller_host.done() && get_buffer_empty() && get_segments_empty() && !is_moving() && !current_state.settling)
+      break;
+
+    if (sim::now_us > limit_us)
+    {
+      stalled = true;
+      break;
+    }
+  }
+
+  /* One more pass at rest, for what the controller reports at the end of the job. */
+  loop();
+  sim::link.flush();
+  controller_host.pump();
+
+  const double plot_s = (stats.last_motion_us - stats.start_us) / 1e6;
+  const double motion_s = stats.motion_us / 1e6;
+  const double idle_s = stats.idle_us / 1e6;
+  const double other_s = (sim::now_us - stats.armed_us) / 1e6 - motion_s;
+
+  if (opt.binary)
+    std::printf("frames sent:           %zu (%zu resent, %zu bits flipped)\n", controller_host.lines.size(),
+      controller_host.frames_resent, controller_host.bits_flipped);
+  else
+    std::printf("lines sent:            %zu (%zu not sent)\n", controller_host.lines.size() - controller_host.lines_unsent,
+      controller_host.lines_unsent);
+  std::printf("virtual time:          %.3f s\n", sim::now_us / 1e6);
+  std::printf("plot time:             %.3f s (first to last step)\n", plot_s);
+  std::printf("moving:                %.3f s in %llu moves\n", motion_s, (unsigned long long)stats.moves);
+  std::printf("idle between blocks:   %.3f s (%.1f%%, mean %.3f ms per move)\n", idle_s,
+    plot_s > 0.0 ? 100.0 * idle_s / plot_s : 0.0, stats.moves ? 1000.0 * idle_s / stats.moves : 0.0);
+  std::printf("pen lift dwell:        %.3f s\n", stats.dwell_us / 1e6);
+  std::printf("peak step rate:        %.0f steps/s (at most %.0f)\n", stats.peak_step_rate, 1e6 / MIN_STEP_PERIOD_US);
+  std::printf("loop pass:             mean %.0f us, max %llu us (%.3f s blocked on serial output)\n",
+    stats.passes ? static_cast<double>(stats.pass_us) / stats.passes : 0.0, (unsigned long long)stats.max_pass_us, stats.blocked_us / 1e6);
+  std::printf("timer interrupts:      %.0f per s moving, %.0f per s otherwise\n",
+    motion_s > 0.0 ? stats.motion_interrupts / motion_s : 0.0, other_s > 0.0 ? stats.other_interrupts / other_s : 0.0);
+  std::printf("max deviation:         %.3f mm (pen down %.3f mm)\n", stats.max_deviation, stats.max_pen_down_deviation);
+  if (controller_host.status_period_us)
+  {
+    const auto & h = controller_host;
+    std::printf("status reports:        %zu of %zu queries (%zu malformed, longest %zu bytes), mean %.3f ms, max %.3f ms; last: %u steps late, %.3f s idle\n",
+      h.status_reports, h.status_reports + h.queries.size(), h.bad_reports, h.longest_report, h.status_reports ? h.report_us / 1e3 / h.status_reports : 0.0,
+      h.max_report_us / 1e3, static_cast<unsigned>(h.last_report.late_steps), h.last_report.idle_ms / 1e3);
+  }
+
+  std::printf("buffers full:          block buffer in %llu passes, segment queue in %llu, %zu %s waited for the send window\n",
+    (unsigned long long)stats.buffer_full_passes, (unsigned long long)stats.segments_full_passes, controller_host.window_waits,
+    opt.binary ? "frames" : "lines");
+  std::printf("serial bytes lost:     %zu\n", sim::link.rx_lost);
+
+  const bool not_full = opt.require_full && (!stats.buffer_full_passes || !stats.segments_full_passes || !controller_host.window_waits);
+
+  if (stalled)
+    std::printf("STALLED: job did not complete within %.0f virtual hours\n", opt.max_hours);
+
+  if (controller_host.aborted)
+    std::printf("ABORTED: a line is longer than the %zu byte RX buffer\n", controller_host.rx_buffer);
+
+  if (not_full)
+    std::printf("NOT FULL: the block buffer, segment queue or send window never filled\n");
+
+  return stalled || controller_host.aborted || not_full || sim::link.rx_lost ? 1 : 0;
+}
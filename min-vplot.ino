@@ -6,161 +6,186 @@
 #include "geo.h"
 #include "config.h"
 #include "buffer.h"
+#include "segment.h"
+#include "planner.h"
+#include "kinematics.h"
 #include "machine.h"
 #include "gcode.h"
 #include "parse.h"
+#include "status.h"
 
 machine_state current_state;
 
 
-/* Inverse kinematics: Calculate plotter position from cartesian coordinates. */
-plot_pos pos_from_pt(const cartesian_pt & pt)
+/* Step period of the faster motor to take steps in seconds, in 1/256 us; at least
+ * MIN_STEP_PERIOD_US. */
+uint32_t period_from_steps(long steps, float seconds)
 {
-  float dxa = pt.x - ORIGIN_X;
-  float dxb = pt.x + ORIGIN_X;
+  const float period = seconds * 1000000.0 /* us / s */ * 256.0 / steps;
 
-  float dy = pt.y - ORIGIN_Y;
+  if (period < MIN_STEP_PERIOD_US * 256.0)
+    return MIN_STEP_PERIOD_US * 256UL;
 
-  return plot_pos(
-    sqrt(dxa * dxa + dy * dy),
-    sqrt(dxb * dxb + dy * dy)
-  );
-};
+  return period < 4.0e9 ? (uint32_t)period : 4000000000UL;
+}
 
+static float unqueued_seconds = 0.0; /* of segments too short for a step, added to the next one */
 
-/* This function calculates destination data, stored in the current state, the speed for new moves and sets the motor speeds. */
-void do_move(const cartesian_pt & next_pt)
+/* Queues a segment from the end of the queued motion to next_pos, taking seconds; next_pos
+ * becomes the new end. The ISR starts it as soon as the segments before it are complete. */
+void queue_segment(const plot_pos & next_pos, float seconds)
 {
-  /* Disable the stepper ISR while we calculate. */
-  noInterrupts();
-
   bool log_debug = false;
 
   if (log_debug)
   {
     Serial.print("New position: ");
-    Serial.print(next_pt.x);
-    Serial.print(" ");
-    Serial.println(next_pt.y);
-  }
-
-  current_state.pt = next_pt;
-
-  const plot_pos next_pos = pos_from_pt(next_pt);
-
-  if (log_debug)
-  {
-    Serial.print("New pos: ");
     Serial.print(next_pos.a);
     Serial.print(" ");
     Serial.println(next_pos.b);
   }
 
-  float da = next_pos.a - current_state.pos.a;
-  float db = next_pos.b - current_state.pos.b;
+  current_state.pos = next_pos;
 
-  if (log_debug)
-  {
-    Serial.print("Change length: ");
-    Serial.print(da);
-    Serial.print(" ");
-    Serial.println(db);
-  }
+  step_segment & segment = segments_back();
 
-  current_state.pos = next_pos;
+  segment.a_dest = STEPS_PER_MM * next_pos.a;
+  segment.b_dest = STEPS_PER_MM * next_pos.b;
+  segment.pen = false;
 
-  long new_a_steps = STEPS_PER_MM * next_pos.a;
-  long new_b_steps = STEPS_PER_MM * next_pos.b;
+  seconds += unqueued_seconds;
 
-  if (current_state.a_steps - new_a_steps == 0 && current_state.b_steps - new_b_steps == 0)
+  if (segment.a_dest == current_state.a_steps && segment.b_dest == current_state.b_steps)
   {
+    unqueued_seconds = seconds;
     return;
   }
 
-  current_state.a_dest = new_a_steps;
-  current_state.b_dest = new_b_steps;
+  unqueued_seconds = 0.0;
+
+  segment.period = period_from_steps(
+    max(abs(segment.a_dest - current_state.a_steps), abs(segment.b_dest - current_state.b_steps)), seconds);
 
   if (log_debug)
   {
     Serial.print("Step dest: ");
-    Serial.print(current_state.a_dest);
+    Serial.print(segment.a_dest);
     Serial.print(" ");
-    Serial.println(current_state.b_dest);
+    Serial.print(segment.b_dest);
+    Serial.print(" Period: ");
+    Serial.println(segment.period);
   }
 
-  calculate_and_set_speed_ratio(da, db);
+  current_state.a_steps = segment.a_dest;
+  current_state.b_steps = segment.b_dest;
+
+  segments_push();
+}
+
+/* Queues a pen change after the queued segments; the ones after it wait for the servo to
+ * settle, while the main loop goes on reading and preparing them. */
+void do_lift(bool lift)
+{
+  bool log_debug = false;
 
   if (log_debug)
   {
-    Serial.print("A speed: ");
-    Serial.print(current_state.motor_a.getSpeed());
-    Serial.print(" B speed: " );
-    Serial.println(current_state.motor_b.getSpeed());
+    Serial.print("Servo: ");
+    Serial.println(lift ? SERVO_LIFT_POSITION : 0);
   }
 
- interrupts();
+  current_state.lift = lift;
+
+  step_segment & segment = segments_back();
+
+  segment.a_dest = current_state.a_steps;
+  segment.b_dest = current_state.b_steps;
+  segment.period = 0;
+  segment.pen = true;
+  segment.lift = lift;
+
+  segments_push();
 }
 
-void calculate_and_set_speed_ratio(float da, float db)
+/* True while the ISR has steps left in its current segment, or waits for the pen. Only read
+ * with the segment queue empty: the ISR then has nothing to pop, so the destinations cannot
+ * change under us. The positions are longs the ISR steps, copied with interrupts off so their
+ * bytes are read from one step. */
+bool get_moving()
 {
-  /* Calculate feeds such that we arrive at the end of the segment on both axes simultaneously.
-   * This is now called from prepare_motion to correct the difference between cartesian and kinematic lines.
-   * TODO: Improve to use Bresenham. */
+  noInterrupts();
+  const long a = current_state.motor_a.get_position();
+  const long b = current_state.motor_b.get_position();
+  const bool settling = current_state.settling;
+  interrupts();
 
-  float a_speed = current_state.feed;
-  float b_speed = current_state.feed;
+  return a != current_state.a_dest || b != current_state.b_dest || settling;
+}
 
-  long a_current_steps = current_state.motor_a.getPositionSteps();
-  long b_current_steps = current_state.motor_b.getPositionSteps();
+/* Reports the time waited for the pen servo, once the machine has come to rest with nothing
+ * left to do: at the end of a job, or wherever the sender fell behind in one. Each report covers
+ * the pen changes since the one before, so a job that ran dry gives several partial reports;
+ * the sender sums them (telemetry.h) and counts the rests before its last line. */
+static void report_dwell()
+{
+  if (!get_buffer_empty() || !get_segments_empty() || get_moving())
+    return;
 
-  long da_steps = abs(current_state.a_dest - a_current_steps);
-  long db_steps = abs(current_state.b_dest - b_current_steps);
+  noInterrupts();
+  const unsigned long dwell_ms = current_state.dwell_ms;
+  const unsigned int pen_changes = current_state.pen_changes;
+  current_state.dwell_ms = 0UL;
+  current_state.pen_changes = 0;
+  interrupts();
 
-  if (abs(da) > abs(db))
-  {
-    b_speed = a_speed * abs(db / da);
+  if (pen_changes == 0)
+    return;
 
-    if (abs(db_steps) > 0)
-    {
-      b_speed = max(b_speed, 1.0);
-    }
-  }
-  else
-  {
-    a_speed = b_speed * abs(da / db);
+  Serial.print("dwell: ");
+  Serial.print(dwell_ms);
+  Serial.print(" ms in ");
+  Serial.print(pen_changes);
+  Serial.println(" pen changes");
+}
 
-    if (abs(da_steps) > 0)
-    {
-      a_speed = max(a_speed, 1.0);
-    }
-  }
+static bool report_status();
 
-  a_speed = da > 0 ? a_speed : -a_speed;
-  b_speed = db > 0 ? b_speed : -b_speed;
+static gc_block block; /* the move being split into segments */
+static bool block_pending = false;
 
-  current_state.motor_a.setSpeed(a_speed);
-  current_state.motor_b.setSpeed(b_speed);
-}
+static long block_end_x = 0;       /* where the move ends, in block units; kept exact, as the */
+static long block_end_y = 0;       /* moves only give the change from the one before */
 
-void do_lift(bool lift)
+static cartesian_pt block_start;   /* where the move starts */
+static cartesian_pt block_end;
+static float block_length = 0.0;   /* mm */
+static plot_pos block_start_pos;
+static plot_pos block_end_pos;
+static line_kinematics block_line; /* string lengths along the move */
+static float block_entry_speed = 0.0;
+static float block_done = 0.0;     /* mm of the move queued */
+
+static float speed = 0.0;          /* mm/s at the end of the queued segments */
+
+/* Speed to leave the move at: the planned entry speed of the next one, or 0 before a pen change
+ * or the end of the buffer. */
+static float get_exit_speed()
 {
-  bool log_debug = false;
+  if (get_buffer_empty())
+    return 0.0;
 
-  if (log_debug)
-  {
-    Serial.print("Servo: ");
-    Serial.println(lift ? SERVO_LIFT_POSITION : 0);
-  }
+  const gc_block & next = buffer_current();
 
-  current_state.lift = lift;
-  current_state.servo.moveToDegrees(lift ? SERVO_LIFT_POSITION : 0);
-}
+  if (!next.is_move() && next.lift != current_state.lift)
+    return 0.0;
 
-/* Prepare motion from the buffer; if we have arrived at our end point, start the next move. */
+  return next.get_entry_speed();
+}
 
-/* This is called from the main loop, so there is a certain amount of delay from the end of
- * one movement to the start of another (for instance, while reading serial inputs or calculating
- * speeds below). It would be better if the stepper interrupt was allowed to advance to the next move. */
+/* Prepare motion: split moves from the buffer into step segments along their planned speed
+ * profiles (see planner.h), until the segment queue is full. The stepper ISR starts each segment
+ * the moment the one before it completes, so motion only waits on the main loop if the queue
+ * runs dry. */
 
 void prepare_motion()
 {
@@ -168,149 +193,379 @@ void prepare_motion()
   pinMode(ENABLE_PIN, OUTPUT);
   digitalWrite(ENABLE_PIN, HIGH);
 
-  long a_current_steps = current_state.motor_a.getPositionSteps();
-  long b_current_steps = current_state.motor_b.getPositionSteps();
-
-  if (a_current_steps == current_state.a_dest && b_current_steps == current_state.b_dest)
+  while (!get_segments_full())
   {
-    if (!get_buffer_empty())
+    if (!block_pending)
     {
-      bool was_full = get_buffer_full();
-      gc_block block = buffer_advance();
+      if (get_buffer_empty())
+        return;
 
-      if (block.pt.x != current_state.pt.x || block.pt.y != current_state.pt.y)
+      const gc_block & next = buffer_current();
+
+      if (next.is_move())
       {
-         do_move(block.pt);
+        block = next;
+        buffer_advance();
+        block_pending = true;
+
+        block_end_x += block.dx;
+        block_end_y += block.dy;
+
+        block_start = current_state.pt;
+        block_end = cartesian_pt(block_end_x * (1.0 / BLOCK_UNITS_PER_MM), block_end_y * (1.0 / BLOCK_UNITS_PER_MM));
+        block_length = block.get_length();
+        block_start_pos = current_state.pos;
+        block_end_pos = pos_from_pt(block_end);
+#if LINE_CORRECTION
+        block_line.start(block_start, block_end, block_length);
+#endif
+        block_entry_speed = speed;
+        block_done = 0.0;
+
+        current_state.feed = block.feed;
       }
-      else if (block.lift != current_state.lift)
+      else if (next.lift != current_state.lift)
       {
-        do_lift(block.lift);
-        delay(1000); /* Wait for motion to complete (interrupt still fires) */
-
-        /* TODO: Avoid updating servo outside of delay to eliminate jitter. */
+        /* The moves before it end at rest (see get_exit_speed). */
+        do_lift(next.lift);
+        buffer_advance();
+        speed = 0.0;
+        continue;
       }
       else
       {
-        current_state.feed = block.feed;
+        current_state.feed = next.feed;
+        buffer_advance();
+        continue;
       }
+    }
+
+    /* Hold the speed for SEGMENT_TIME_MS, starting from rest at ACCELERATION_MM_PER_S2. */
+    const float segment_s = SEGMENT_TIME_MS / 1000.0;
+    float distance = segment_s * max(speed, ACCELERATION_MM_PER_S2 * segment_s);
+
+#if LINE_CORRECTION
+    /* Moving the steppers at constant speeds creates an arc in cartesian space, so segments
+     * are no longer than LINE_SEGMENT_MM along the straight cartesian line, to keep their arcs
+     * close to it. */
+    distance = min(distance, LINE_SEGMENT_MM);
+#endif
+
+    const float x = min(block_done + distance, block_length);
+    const float next_speed = profile_speed(block, block_entry_speed, get_exit_speed(), x);
+
+    /* Constant acceleration over the segment; from rest to rest, the peak is sqrt(a * d). */
+    float mean_speed_x2 = speed + next_speed;
+
+    if (mean_speed_x2 * mean_speed_x2 < ACCELERATION_MM_PER_S2 * (x - block_done))
+      mean_speed_x2 = sqrt(ACCELERATION_MM_PER_S2 * (x - block_done));
+
+    const float seconds = 2.0 * (x - block_done) / mean_speed_x2;
 
-      if (was_full)
-        Serial.println("ok"); // let connection know we are ready for more input
+    block_done = x;
+    speed = next_speed;
+
+    if (x >= block_length)
+    {
+      block_pending = false;
+      current_state.pt = block_end;
+      queue_segment(block_end_pos, seconds);
+      continue;
     }
+
+#if LINE_CORRECTION
+    /* float divide/sqrt is ~500 avr clock cycles. (0.03125ms @ 16Mhz?)
+     * A segment costs about 3 sqrts and 2 divides (speed profile, inverse kinematics, step rate). */
+    queue_segment(block_line.at(x), seconds);
+#else
+    /* The sender has split the line so constant motor speeds stay close to it. */
+    const float f = x / block_length;
+
+    queue_segment(plot_pos(block_start_pos.a + (block_end_pos.a - block_start_pos.a) * f,
+      block_start_pos.b + (block_end_pos.b - block_start_pos.b) * f), seconds);
+#endif
   }
-  else /* moving to destination */
+}
+
+/* Main loop: parse serial inputs and prepare motion from the buffer. Received bytes are parsed
+ * as they come (see parse_char), at most up to the end of a line per pass, and answers go out
+ * through the TX buffer of Serial, which its interrupt empties. "ok" is shorter than any line it
+ * answers, but "error: Invalid number", the M0 printout and the dwell report are not, so a run
+ * of them can fill the TX buffer, and the pass then blocks in Serial until there is room. A
+ * status query is answered on the pass that receives it, unless the TX buffer has no room for
+ * the report; it never blocks. */
+void loop()
+{
+  static bool status_pending = false;
+
+  if (read_input())
+    status_pending = true;
+
+  if (get_frames_enabled())
   {
-    /* Moving the steppers at constant speeds creates an arc in cartesian space, so
-     * we must constantly re-calculate speeds to keep us on a straight cartesian line.
-     *
-     * This method creates a vector from the current plotter cartesian position to the
-     * commanded cartesian target point, creates a target point for setting speeds a short
-     * distance away to minimize error (here 1mm), then sets speeds to arrive at that point.
-     *
-     * If the length to destination is less than 1mm, our error will be minimal so skip.
-     *
-     * float divide/sqrt is ~500 avr clock cycles. (0.03125ms @ 16Mhz?)
-     * I count 13 divides/mults and 4 sqrts in these calculations for perhaps .5 ms total.
-     */
-
-    const plot_pos pos = current_state.get_current_plot_pos();
-    const cartesian_pt pt = current_state.get_current_cartesian_location();
-
-    const cartesian_vec vec(current_state.pt.x /* g-code target */ - pt.x, current_state.pt.y - pt.y);
-    const float vec_length = sqrt(vec.x * vec.x + vec.y * vec.y);
-
-    if (vec_length > 1.0)
+    read_frames();
+  }
+  else
+  {
+    /* Leave input in the input buffer while the block buffer is full, or has yet to take the
+     * rest of a long move; the sender stops sending once it has filled the RX buffer, so nothing
+     * is lost. Lines end at '\r' or '\n'; read_input() drops the '\n' of "\r\n". */
+    int c;
+
+    while (!buffer_fill() && !get_buffer_full() && (c = input_read()) != -1)
     {
-      const cartesian_vec norm_vec(vec.x / vec_length, vec.y / vec_length);
+      if (parse_char(c, current_state))
+        break;
+    }
+  }
 
-      cartesian_pt speed_target_pt(norm_vec.x + pt.x, norm_vec.y + pt.y);
-      plot_pos speed_target_pos = pos_from_pt(speed_target_pt);
+  prepare_motion();
+  report_dwell();
 
-      calculate_and_set_speed_ratio(speed_target_pos.a - pos.a, speed_target_pos.b - pos.b);
+  if (status_pending)
+    status_pending = !report_status();
+}
 
-      bool log_debug = false;
-      if (log_debug)
-      {
-        Serial.print(pos.a);
-        Serial.print(" ");
-        Serial.print(pos.b);
-        Serial.print(" ");
-        Serial.print(pt.x);
-        Serial.print(" ");
-        Serial.print(pt.y);
-        Serial.print(" ");
-        Serial.print(norm_vec.x);
-        Serial.print(" ");
-        Serial.print(norm_vec.y);
-        Serial.print(" ");
-        Serial.print("A speed: ");
-        Serial.print(current_state.motor_a.getSpeed());
-        Serial.print(" B speed: " );
-        Serial.println(current_state.motor_b.getSpeed());
-      }
-    }
+/* Step generator state of the segment the ISR is executing. The major motor, the one with more
+ * steps, steps every period of the segment; the minor motor steps each time its Bresenham error
+ * passes the major step count, so its last step falls on the major's last one. */
+static stepper * major_motor = &current_state.motor_a;
+static stepper * minor_motor = &current_state.motor_b;
+
+static long major_steps = 0L;
+static long minor_steps = 0L;
+static long steps_left = 0L; /* of the major motor */
+static long minor_error = 0L;
+
+/* The ISR keeps time as the sum of the timer periods it has set: when it runs, and when the
+ * next step and servo pulse edge are due. Times wrap, so they are only compared by difference. */
+static unsigned long isr_us = 0;
+static unsigned long isr_period_us = IDLE_PERIOD_US;
+static unsigned long step_us = 0;
+static unsigned long servo_us = 0;
+
+static uint8_t step_fraction = 0; /* 1/256 us left over from the last step time */
+
+static unsigned long pen_moved_us = 0; /* when the servo was last given a new position */
+
+static unsigned int idle_us = 0; /* with nothing to execute, under a ms, not yet in idle_ms */
+
+static bool get_due(unsigned long event_us)
+{
+  return (long)(isr_us - event_us) >= 0;
+}
+
+/* Moves the next step time on by the segment period, carrying the fraction of a us. */
+static void schedule_step()
+{
+  const uint32_t period = current_state.period + step_fraction;
+
+  step_us += period >> 8;
+  step_fraction = period & 0xff;
+}
+
+/* Gives the servo the position for lift, unless it has it already. */
+static void move_pen(bool lift)
+{
+  const uint8_t degrees = lift ? SERVO_LIFT_POSITION : 0;
+
+  if (current_state.pen_servo.get_degrees() != degrees)
+  {
+    current_state.pen_servo.move_to_degrees(degrees);
+    pen_moved_us = isr_us;
   }
 }
 
-static char line[128];
+/* A pen change waits, without steps, until PEN_SETTLE_MS after the servo got its position. */
+static void start_pen(const step_segment & segment)
+{
+  move_pen(segment.lift);
 
-/* Main loop: parse serial inputs and prepare motion from the buffer. */
-void loop()
+  current_state.period = 0;
+  current_state.pen_changes++;
+
+  step_us = pen_moved_us + PEN_SETTLE_MS * 1000UL;
+
+  if (get_due(step_us))
+    return;
+
+  steps_left = 1;
+  current_state.settling = true;
+  current_state.dwell_ms += (step_us - isr_us + 500) / 1000;
+}
+
+static void start_segment(const step_segment & segment)
 {
-  char c;
-  uint8_t char_counter = 0;
+  if (segment.pen)
+  {
+    start_pen(segment);
+    return;
+  }
 
-  while (true)
+  const long da = segment.a_dest - current_state.a_dest;
+  const long db = segment.b_dest - current_state.b_dest;
+
+  current_state.motor_a.set_direction(da < 0 ? -1 : 1);
+  current_state.motor_b.set_direction(db < 0 ? -1 : 1);
+
+  const long a_steps = abs(da);
+  const long b_steps = abs(db);
+
+  if (a_steps >= b_steps)
   {
-    if ((c = Serial.read()) != -1)
-    {
-      if ((c == '\n') || (c == '\r')) // End of line reached
-      {
-        line[char_counter] = 0; // Set string termination character.
+    major_motor = &current_state.motor_a;
+    minor_motor = &current_state.motor_b;
+    major_steps = a_steps;
+    minor_steps = b_steps;
+  }
+  else
+  {
+    major_motor = &current_state.motor_b;
+    minor_motor = &current_state.motor_a;
+    major_steps = b_steps;
+    minor_steps = a_steps;
+  }
 
-        if (char_counter > 0)
-        {
-          //Serial.println(line);
-          parse_line(line, current_state);
+  steps_left = major_steps;
+  minor_error = 0L;
 
-          char_counter = 0;
-        }
+  current_state.a_dest = segment.a_dest;
+  current_state.b_dest = segment.b_dest;
+  current_state.period = segment.period;
 
-        memset(line, 0, 128);
-      }
-      else
+  /* The first step is a period after the last one of the segment before, or after now. */
+  step_us = isr_us;
+  step_fraction = 0;
+  schedule_step();
+
+  /* Lifting starts with the last segment before it, which slows to a stop in well under the
+   * time the servo takes to turn the pen off the paper. */
+  const step_segment * next = segments_peek();
+
+  if (next && next->pen && next->lift)
+    move_pen(true);
+}
+
+/* Main interrupt routine, drives steppers and servo. Runs when the next step or servo pulse
+ * edge is due, and sets the timer for the one after: it runs as often as the motors step, plus
+ * twice per servo frame, and every IDLE_PERIOD_US while they stand still. */
+void stepper_isr()
+{
+  isr_us += isr_period_us;
+
+  if (steps_left > 0 && get_due(step_us))
+  {
+    if (current_state.settling) /* the pen is in place */
+    {
+      current_state.settling = false;
+      steps_left = 0;
+    }
+    else
+    {
+      major_motor->step();
+
+      minor_error += minor_steps;
+
+      if (minor_error >= major_steps)
       {
-        line[char_counter++] = c;
+        minor_error -= major_steps;
+        minor_motor->step();
       }
+
+      if (isr_us != step_us) /* held back by MIN_STEP_PERIOD_US */
+        current_state.late_steps++;
+
+      steps_left--;
+      schedule_step();
     }
+  }
+
+  /* Start the next segment on the last step of this one. */
+  step_segment segment;
+
+  if (steps_left == 0 && segments_pop(segment))
+    start_segment(segment);
+
+  if (get_due(servo_us))
+    servo_us += current_state.pen_servo.update();
+
+  unsigned long next_us = isr_us + IDLE_PERIOD_US;
+
+  if (steps_left > 0 && (long)(step_us - next_us) < 0)
+    next_us = step_us;
+
+  if ((long)(servo_us - next_us) < 0)
+    next_us = servo_us;
 
-    prepare_motion();
+  /* An event due within MIN_STEP_PERIOD_US waits for it; later steps keep their times. */
+  isr_period_us = max((long)(next_us - isr_us), (long)MIN_STEP_PERIOD_US);
+  Timer1.setPeriod(isr_period_us);
 
-    Serial.flush();
+  if (steps_left == 0)
+  {
+    for (idle_us += isr_period_us; idle_us >= 1000; idle_us -= 1000)
+      current_state.idle_ms++;
   }
 }
 
-/* Main interrupt routine, drives steppers and servo. Called every INTERRUPT_PERIOD_US. */
-void stepper_isr()
+/* Writes the status report (see status.h) if the TX buffer has room for it; false if not. The
+ * state of the ISR is copied with interrupts off, and the step rates follow from the segment's
+ * period and the motors' share of its steps. Only a report longer than the TX buffer, with
+ * positions past 2^20 steps, is written into a partly full one, and waits there for room. */
+static bool report_status()
 {
-  if (current_state.motor_a.getPositionSteps() != current_state.a_dest)
-    current_state.motor_a.step();
+  noInterrupts();
+  status_report status;
+  status.a = current_state.motor_a.get_position();
+  status.b = current_state.motor_b.get_position();
+  status.a_dest = current_state.a_dest;
+  status.b_dest = current_state.b_dest;
+  status.idle_ms = current_state.idle_ms;
+  status.late_steps = current_state.late_steps;
+  const bool settling = current_state.settling;
+  const bool moving = steps_left > 0 && !settling;
+  const uint32_t period = current_state.period;
+  const long major = major_steps;
+  const long minor = minor_steps;
+  const stepper * const major_stepper = major_motor;
+  const stepper * const minor_stepper = minor_motor;
+  interrupts();
+
+  if (moving && period > 0)
+  {
+    const float major_rate = 256000000.0 /* 1/256 us per s */ / period;
+    const long major_signed = lround(major_rate) * major_stepper->get_direction();
+    const long minor_signed = lround(major_rate * minor / major) * minor_stepper->get_direction();
+
+    status.a_rate = major_stepper == &current_state.motor_a ? major_signed : minor_signed;
+    status.b_rate = major_stepper == &current_state.motor_a ? minor_signed : major_signed;
+  }
+
+  status.blocks = get_buffer_count();
+  status.segments = get_segment_count();
+  status.pen = settling ? 'S' : current_state.pen_servo.get_degrees() != 0 ? 'U' : 'D';
+
+  char line[STATUS_MAX_BYTES];
+  const uint8_t length = status.format(line);
 
-  if (current_state.motor_b.getPositionSteps() != current_state.b_dest)
-    current_state.motor_b.step();
+  if (Serial.availableForWrite() < min(length + 2, SERIAL_TX_BUFFER_SIZE - 1))
+    return false;
 
-   current_state.servo.update();
+  Serial.println(line);
+  return true;
 }
 
 void setup()
 {
-  Timer1.initialize(INTERRUPT_PERIOD_US);
+  current_state.pen_servo.enable();
+
+  Timer1.initialize(IDLE_PERIOD_US);
   Timer1.attachInterrupt(stepper_isr);
 
   /* Reset the servo position; upon startup, the horn should be pushing the pen tip off the surface. */
-  current_state.servo.moveToDegrees(0);
+  current_state.pen_servo.move_to_degrees(0);
   delay(1000);
-  current_state.servo.moveToDegrees(SERVO_LIFT_POSITION);
+  current_state.pen_servo.move_to_degrees(SERVO_LIFT_POSITION);
 
   Serial.begin(115200);
   Serial.setTimeout(0); /* This allows us to prepare the next move without blocking on inputs. */
@@ -334,9 +589,6 @@ void setup()
   current_state.motor_a.enable();
   current_state.motor_b.enable();
 
-  current_state.motor_a.setSpeed(0);
-  current_state.motor_b.setSpeed(0);
-
-  current_state.motor_a.setPosition(current_state.a_steps);
-  current_state.motor_b.setPosition(current_state.b_steps);
+  current_state.motor_a.set_position(current_state.a_steps);
+  current_state.motor_b.set_position(current_state.b_steps);
 }
@@ -7,113 +7,453 @@
 #include "gcode.h"
 #include "buffer.h"
 #include "machine.h"
+#include "frame.h"
+#include "status.h"
+#include "ring.h"
 
-#include "grbl_read_float.h" // from grbl
+static ring<uint8_t, INPUT_BUFFER_SIZE> input;
 
-void parse_line(char * line, machine_state & current_state)
+static bool frames_enabled = false;
+static frame_receiver frames;
+static frame_boundary boundary; /* of the frames in the input, for the status queries */
+static bool after_cr = false; /* the last text byte taken was '\r' */
+
+static frame_reader frame; /* accepted frame whose blocks are being added */
+static bool frame_pending = false;
+
+static long frame_x = 0; /* last point, in 1 / FRAME_UNITS_PER_MM mm */
+static long frame_y = 0;
+
+static_assert(FRAME_UNITS_PER_MM == BLOCK_UNITS_PER_MM, "frame points are buffered as they are");
+
+/* A coordinate of a text line in block units, rounded. */
+static long block_units(float mm)
 {
-  uint8_t char_counter = 0;
-  bool movement = false;
-  bool comment = false;
+  return lround(max(min(mm, BLOCK_MAX_COORDINATE_MM), -BLOCK_MAX_COORDINATE_MM) * BLOCK_UNITS_PER_MM);
+}
 
-  gc_block current_block = buffer_last();
+bool get_frames_enabled()
+{
+  return frames_enabled;
+}
+
+/* The input buffer holds as many bytes as the sender keeps in flight, so the RX buffer behind it
+ * never fills; a query is still taken out of the RX buffer while the input buffer is full. In
+ * text lines, a query may come anywhere; in frames, only between them, as it may be a byte of
+ * one. The '\n' of "\r\n" is dropped here: the line was answered at the '\r', so the sender
+ * no longer counts the '\n' in flight, and left waiting for room it would hold up the queries
+ * behind it. */
+bool read_input()
+{
+  bool query = false;
+  int c;
 
-  while (line[char_counter] != 0)
+  while ((c = Serial.peek()) != -1)
   {
-    char ch = line[char_counter];
+    const bool is_query = c == STATUS_QUERY && (!frames_enabled || boundary.between());
+    const bool is_crlf = !frames_enabled && c == '\n' && after_cr;
 
-    if (ch == ' ' || ch == '\r' || ch == '\n')
-    {
-      char_counter++;
-      continue;
-    }
+    if (!is_query && !is_crlf && input.full())
+      break;
+
+    Serial.read();
 
-    if (ch == '(' || comment)
+    if (is_query)
     {
-      comment = true;
-      char_counter++;
+      query = true;
       continue;
     }
 
-    if (ch == ')')
-    {
-      comment = false;
-      char_counter++;
+    if (frames_enabled)
+      boundary.add(c);
+    else
+      after_cr = c == '\r';
+
+    if (is_crlf)
       continue;
-    }
 
-    char_counter++; // TODO is this needed?
+    input.back() = c;
+    input.push();
+  }
+
+  return query;
+}
+
+int input_read()
+{
+  if (input.empty())
+    return -1;
 
-    float value = 0.0;
-    if (read_float(line, &char_counter, &value))
+  const uint8_t c = input.front();
+  input.pop();
+
+  return c;
+}
+
+static void answer_frame(frame_receiver::result result)
+{
+  switch (result)
+  {
+    case frame_receiver::accepted:
+      frame = frame_reader(frames.payload(), frames.payload_length());
+      frame_pending = true;
+      Serial.println("ok");
+      break;
+
+    case frame_receiver::repeated:
+      Serial.println("ok");
+      break;
+
+    case frame_receiver::rejected:
+      Serial.print("rs ");
+      Serial.println((int)frames.expected_seq);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/* Frames set the pen and feed before their points, so a change is queued as a block of its own,
+ * as the text lines M3/M4/F would be. True while blocks are left. */
+static bool add_frame_blocks()
+{
+  while (frame_pending)
+  {
+    if (buffer_fill() || get_buffer_full())
+      return true;
+
+    gc_block block = buffer_last();
+    const int feed = min((int)frame.feed, MAX_FEED_MM_PER_S);
+
+    if (frame.lift != block.lift)
     {
-      if (value > 1e9 || value < -1e9 || value == NAN)
-      {
-        Serial.print("Parsing error: ");
-        Serial.println(value);
-      }
+      block.lift = frame.lift;
+    }
+    else if (feed != block.feed)
+    {
+      block.feed = feed;
+    }
+    else
+    {
+      int32_t dx, dy;
 
-      if (ch == 'G')
+      if (!frame.next_point(dx, dy))
       {
-        current_state.rapid = value == 1;
+        frame_pending = false;
+        break;
       }
-      else if (ch == 'M')
-      {
-        if (value == 0.0) /* diagnostic printout */
-        {
-          Serial.print(current_state.a_dest);
-          Serial.print(" ");
-          Serial.print(current_state.motor_a.getSpeed());
-          Serial.print(" ");
-          Serial.print(current_state.b_dest);
-          Serial.print(" ");
-          Serial.print(current_state.motor_b.getSpeed());
-          Serial.print(" ");
-          Serial.print(current_state.motor_a.getPositionSteps());
-          Serial.print(" ");
-          Serial.println(current_state.motor_b.getPositionSteps());
-        }
-        else
-        {
-          current_block.lift = value == 3;
-        }
-      }
-      else if (ch == 'F')
-      {
-        current_block.feed = min((int)value, MAX_FEED_MM_PER_S);
-      }
-      else if (ch == 'X')
+
+      frame_x += dx;
+      frame_y += dy;
+    }
+
+    buffer_add(block, frame_x, frame_y);
+  }
+
+  return false;
+}
+
+void read_frames()
+{
+  static unsigned long last_byte_ms = 0;
+
+  while (!add_frame_blocks())
+  {
+    const int byte = input_read();
+
+    if (byte == -1)
+    {
+      if (frames.has_input() && millis() - last_byte_ms > FRAME_TIMEOUT_MS)
       {
-        current_block.pt.x = value;
+        boundary.reset();
+        answer_frame(frames.idle());
       }
-      else if (ch == 'Y')
+
+      return;
+    }
+
+    last_byte_ms = millis();
+    answer_frame(frames.add(byte));
+  }
+}
+
+/* Text lines are parsed a byte at a time as they arrive, so no line is held and no pass of
+ * the main loop parses more than the bytes it read. The words of a line go into line_block,
+ * which is buffered at its end. */
+enum parse_state : uint8_t
+{
+  parse_word,    /* between words */
+  parse_number,  /* in the number of word_letter */
+  parse_comment, /* in "(...)" */
+  parse_command, /* in a line starting with '$' */
+  parse_error    /* in the rest of a line that is answered "error" */
+};
+
+static parse_state state = parse_word;
+static uint8_t line_length = 0; /* bytes of the line so far, up to 255 */
+static gc_block line_block;     /* its feed and pen state */
+static long line_x;             /* and where it moves to, in block units */
+static long line_y;
+
+/* The number being read, after grbl's read_float: its digits as an integer, and the power of
+ * ten to scale them by. Digits past MAX_INT_DIGITS only move the decimal point. */
+#define MAX_INT_DIGITS 8
+
+static char word_letter;
+static bool number_negative;
+static bool number_decimal;
+static uint8_t number_length;
+static uint8_t number_digits;
+static uint32_t number_value;
+static int8_t number_exponent;
+
+static float get_number()
+{
+  float value = (float)number_value;
+
+  /* At most two multiplies for the usual E0 to E-4. */
+  if (value != 0)
+  {
+    int8_t exponent = number_exponent;
+
+    while (exponent <= -2)
+    {
+      value *= 0.01;
+      exponent += 2;
+    }
+
+    if (exponent < 0)
+    {
+      value *= 0.1;
+    }
+    else if (exponent > 0)
+    {
+      do
       {
-        current_block.pt.y = value;
-      }
+        value *= 10.0;
+      } while (--exponent > 0);
+    }
+  }
 
-      continue;
+  return number_negative ? -value : value;
+}
+
+/* Adds c to the number; false if it is not part of it. */
+static bool add_to_number(char c)
+{
+  const uint8_t digit = c - '0';
+
+  if (digit <= 9)
+  {
+    if (++number_digits <= MAX_INT_DIGITS)
+    {
+      if (number_decimal)
+        number_exponent--;
+
+      number_value = number_value * 10 + digit;
     }
-    else
+    else if (!number_decimal)
     {
-      Serial.print("Invalid number: ");
-      Serial.println(line);
-      return;
+      number_exponent++;
     }
+  }
+  else if (c == '.' && !number_decimal)
+  {
+    number_decimal = true;
+  }
+  else if ((c == '-' || c == '+') && number_length == 0)
+  {
+    number_negative = c == '-';
+  }
+  else
+  {
+    return false;
+  }
+
+  number_length++;
+  return true;
+}
 
-    char_counter++;
+static void apply_word(char letter, float value, machine_state & current_state)
+{
+  if (value > 1e9 || value < -1e9)
+  {
+    Serial.print("Parsing error: ");
+    Serial.println(value);
   }
 
-  if (!get_buffer_full())
+  if (letter == 'G')
   {
-    buffer_add(current_block);
+    current_state.rapid = value == 1;
+  }
+  else if (letter == 'M')
+  {
+    if (value == 0.0) /* diagnostic printout, of the stepper ISR's state copied with it off */
+    {
+      noInterrupts();
+      const long a_dest = current_state.a_dest;
+      const long b_dest = current_state.b_dest;
+      const uint32_t period = current_state.period;
+      const long a = current_state.motor_a.get_position();
+      const long b = current_state.motor_b.get_position();
+      interrupts();
 
-    if (!get_buffer_full())
+      Serial.print(a_dest);
+      Serial.print(" ");
+      Serial.print(b_dest);
+      Serial.print(" ");
+      Serial.print(period);
+      Serial.print(" ");
+      Serial.print(a);
+      Serial.print(" ");
+      Serial.println(b);
+    }
+    else
     {
-      Serial.println("ok");
+      line_block.lift = value == 3;
     }
   }
+  else if (letter == 'F')
+  {
+    line_block.feed = (int)max(min(value, MAX_FEED_MM_PER_S), 0.0); /* in range of the 7 bit field, as frame.h */
+  }
+  else if (letter == 'X')
+  {
+    line_x = block_units(value);
+  }
+  else if (letter == 'Y')
+  {
+    line_y = block_units(value);
+  }
+}
+
+/* Ends the number of the current word: applies the word, or fails the line if it has no digits. */
+static void end_number(machine_state & current_state)
+{
+  if (number_digits == 0)
+  {
+    state = parse_error;
+    return;
+  }
+
+  apply_word(word_letter, get_number(), current_state);
+  state = parse_word;
+}
+
+/* Answers the line and starts the next one. */
+static void end_line(machine_state & current_state)
+{
+  if (state == parse_number)
+    end_number(current_state);
+
+  if (state == parse_command && word_letter == 'B') /* "$B": switch to binary frames; older firmware answers "error" */
+  {
+    frame_x = get_buffer_end_x();
+    frame_y = get_buffer_end_y();
+    frames_enabled = true;
+
+    Serial.println("ok");
+  }
+  else if (state == parse_error || state == parse_command)
+  {
+    Serial.println("error: Invalid number"); /* still one response per line, see below */
+  }
   else
   {
-    Serial.println("dropped");
+    /* The main loop only reads serial input while the buffer has room and holds no part of a
+     * move, so the block always fits; what does not of a long move is added as the buffer makes
+     * room, before the next line is read. Every line is answered with exactly one "ok" (or
+     * "error"), which lets the sender count the bytes still pending in our RX buffer and keep it
+     * full (grbl-style character counting). */
+    buffer_add(line_block, line_x, line_y);
+
+    Serial.println("ok");
+  }
+
+  state = parse_word;
+  line_length = 0;
+}
+
+bool parse_char(char c, machine_state & current_state)
+{
+  if (c == '\r' || c == '\n')
+  {
+    if (line_length == 0) /* an empty line */
+      return false;
+
+    end_line(current_state);
+    return true;
+  }
+
+  if (line_length < 255)
+    line_length++;
+
+  if (line_length == 1)
+  {
+    line_block = buffer_last();
+    line_x = get_buffer_end_x();
+    line_y = get_buffer_end_y();
+
+    if (c == '$')
+    {
+      state = parse_command;
+      word_letter = 0;
+      return false;
+    }
   }
+
+  switch (state)
+  {
+    case parse_error:
+      return false;
+
+    case parse_comment:
+      if (c == ')')
+        state = parse_word;
+
+      return false;
+
+    case parse_command:
+      if (word_letter == 0 && c == 'B')
+        word_letter = c;
+      else
+        state = parse_error;
+
+      return false;
+
+    case parse_number:
+      if (add_to_number(c))
+        return false;
+
+      end_number(current_state);
+
+      if (state == parse_error)
+        return false;
+
+      break; /* c starts the next word */
+
+    default:
+      break;
+  }
+
+  if (c == ' ')
+    return false;
+
+  if (c == '(')
+  {
+    state = parse_comment;
+    return false;
+  }
+
+  word_letter = c;
+  number_negative = false;
+  number_decimal = false;
+  number_length = 0;
+  number_digits = 0;
+  number_value = 0;
+  number_exponent = 0;
+
+  state = parse_number;
+  return false;
 }
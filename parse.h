@@ -2,6 +2,26 @@
 
 #pragma once
 
+#include <stdint.h>
+
 class machine_state;
 
-void parse_line(char * line, machine_state & current_state);
+#define INPUT_BUFFER_SIZE 64 /* received bytes waiting to be parsed, a power of two */
+
+/* Moves received bytes from the serial RX buffer to the input buffer, taking out the status
+ * queries among them (see status.h); true if there was one. */
+bool read_input();
+
+/* The next byte of the input buffer, or -1 if it is empty. */
+int input_read();
+
+/* Parses the next received byte of a text line; true once it has ended and been answered. */
+bool parse_char(char c, machine_state & current_state);
+
+/* Binary frames (see frame.h), read instead of text lines once the line "$B" was received. */
+bool get_frames_enabled();
+
+/* Reads frames from the input buffer until one is accepted whose blocks do not all fit in the buffer; the
+ * rest of its blocks are added on later calls, as the buffer makes room, before any further
+ * bytes are read. */
+void read_frames();
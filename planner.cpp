@@ -0,0 +1,95 @@
+/* min-vplot: Minimal motion controller for v-plotter. */
+
+#include "Arduino.h"
+
+#include "planner.h"
+#include "buffer.h"
+#include "config.h"
+
+static cartesian_vec previous_unit; /* direction of the last move planned */
+static float previous_feed = 0.0;   /* its feed; 0 if the machine stops before the next move */
+
+/* Highest speed reached from v over distance at ACCELERATION_MM_PER_S2 (or slowed to v from). */
+static float reachable_speed(float v, float distance)
+{
+  return sqrt(v * v + 2.0 * ACCELERATION_MM_PER_S2 * distance);
+}
+
+void planner_add(gc_block & block, const gc_block & previous)
+{
+  const cartesian_vec vec(block.dx, block.dy); /* in block units */
+  const float length = sqrt(vec.x * vec.x + vec.y * vec.y);
+
+  block.length = length + 0.5; /* a move is at least one unit long */
+  block.entry_speed = 0;
+
+  if (block.length == 0)
+  {
+    /* A pen change stops the machine; a feed change does not limit the moves around it. */
+    block.set_max_entry_speed(block.lift != previous.lift ? 0.0 : MAX_FEED_MM_PER_S);
+
+    if (block.lift != previous.lift)
+      previous_feed = 0.0;
+
+    return;
+  }
+
+  const cartesian_vec unit(vec.x / length, vec.y / length);
+
+  /* Junction speed after grbl: the speed at which a circle through the corner, JUNCTION_DEVIATION_MM
+   * from it, is taken at ACCELERATION_MM_PER_S2 centripetal acceleration. */
+  const float cos_theta = -(previous_unit.x * unit.x + previous_unit.y * unit.y);
+  const float sin_theta_d2 = sqrt(max(0.5 * (1.0 - cos_theta), 0.0));
+
+  float junction_speed = block.feed;
+
+  if (sin_theta_d2 < 0.999)
+    junction_speed = sqrt(ACCELERATION_MM_PER_S2 * JUNCTION_DEVIATION_MM * sin_theta_d2 / (1.0 - sin_theta_d2));
+
+  block.set_max_entry_speed(min(junction_speed, min((float)block.feed, previous_feed)));
+
+  previous_unit = unit;
+  previous_feed = block.feed;
+}
+
+void planner_recalculate()
+{
+  if (get_buffer_empty())
+    return;
+
+  const int front = get_buffer_front();
+  const int back = get_buffer_back();
+
+  /* Backward: each block must be able to slow down to the entry speed of the next one. */
+  float exit_speed = 0.0;
+  int index = back;
+
+  do
+  {
+    index = buffer_prev(index);
+
+    gc_block & block = buffer_at(index);
+    block.set_entry_speed(min(block.get_max_entry_speed(), reachable_speed(exit_speed, block.get_length())));
+    exit_speed = block.get_entry_speed();
+  }
+  while (index != front);
+
+  /* Forward: and not enter faster than the block before it can speed up to. */
+  for (int next = buffer_next(index); next != back; index = next, next = buffer_next(next))
+  {
+    const gc_block & block = buffer_at(index);
+    gc_block & next_block = buffer_at(next);
+
+    next_block.set_entry_speed(min(next_block.get_entry_speed(), reachable_speed(block.get_entry_speed(), block.get_length())));
+  }
+}
+
+float profile_speed(const gc_block & block, float entry_speed, float exit_speed, float x)
+{
+  /* Compared squared, for one sqrt per segment. */
+  const float feed_sq = (float)block.feed * block.feed;
+  const float accelerate_sq = entry_speed * entry_speed + 2.0 * ACCELERATION_MM_PER_S2 * x;
+  const float decelerate_sq = exit_speed * exit_speed + 2.0 * ACCELERATION_MM_PER_S2 * (block.get_length() - x);
+
+  return sqrt(min(feed_sq, min(accelerate_sq, decelerate_sq)));
+}
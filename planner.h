@@ -0,0 +1,21 @@
+/* min-vplot: Minimal motion controller for v-plotter. */
+
+#pragma once
+
+#include "gcode.h"
+
+/* Look-ahead planner over the block buffer. Each move gets a trapezoidal speed profile along the
+ * pen path: it accelerates at ACCELERATION_MM_PER_S2 from its entry speed, cruises at its feed
+ * and decelerates to the entry speed of the move after it. Entry speeds are limited by the angle
+ * between moves (JUNCTION_DEVIATION_MM) and re-planned as blocks arrive; the last block buffered
+ * always ends at rest, so the machine can stop if no more come. */
+
+/* Sets length and max_entry_speed of block, about to be buffered after previous. */
+void planner_add(gc_block & block, const gc_block & previous);
+
+/* Re-plans the entry speeds of the buffered blocks: backward from the last one, which ends at
+ * rest, then forward from the first. */
+void planner_recalculate();
+
+/* Speed (mm/s) at distance x along block, entered at entry_speed and left at exit_speed. */
+float profile_speed(const gc_block & block, float entry_speed, float exit_speed, float x);
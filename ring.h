@@ -0,0 +1,79 @@
+/* min-vplot: Minimal motion controller for v-plotter. */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifndef ARDUINO
+#include <atomic>
+#endif
+
+/* Single producer, single consumer ring of SIZE items, a power of two up to 128.
+ *
+ * The indices count pushes and pops, and wrap at 256 rather than at SIZE: the difference is the
+ * number of items, so every slot can be used (there is no free slot to tell full from empty), and
+ * an item is at its index masked by SIZE - 1. Each side only writes its own index, so neither
+ * side needs to disable interrupts or lock, whether the other is an ISR or (on the host) a thread.
+ *
+ * Each side publishes its index with a release store and reads the other's with an acquire load,
+ * so a pushed item is written before the consumer sees it, and a popped one read before the
+ * producer reuses its slot. On the AVR a one byte store is atomic and memory accesses are not
+ * reordered, so a volatile index and a compiler barrier give that (avr-libc has no <atomic>); on
+ * the host, where the sim and bench_ring run, the indices are std::atomic. */
+template <typename T, uint8_t SIZE>
+class ring
+{
+  static_assert(SIZE > 0 && SIZE <= 128 && (SIZE & (SIZE - 1)) == 0, "ring size must be a power of two up to 128");
+
+#ifdef ARDUINO
+  typedef volatile uint8_t index_type;
+
+  static void barrier() { __asm__ __volatile__("" ::: "memory"); }
+
+  static uint8_t load(const index_type & index)
+  {
+    const uint8_t value = index;
+    barrier();
+    return value;
+  }
+
+  static void store(index_type & index, uint8_t value)
+  {
+    barrier();
+    index = value;
+  }
+#else
+  typedef std::atomic<uint8_t> index_type;
+
+  static uint8_t load(const index_type & index) { return index.load(std::memory_order_acquire); }
+  static void store(index_type & index, uint8_t value) { index.store(value, std::memory_order_release); }
+#endif
+
+  T items[SIZE];
+
+  index_type front_index { 0 }; /* pops; written by the consumer */
+  index_type back_index { 0 };  /* pushes; written by the producer */
+
+public:
+  bool empty() const { return load(front_index) == load(back_index); }
+  bool full() const { return count() == SIZE; }
+
+  uint8_t count() const { return load(back_index) - load(front_index); }
+
+  /* Items by index, from get_front() up to (not including) get_back(); indices wrap at 256,
+   * so step them as uint8_t. Only for the side that owns the items between them. */
+  uint8_t get_front() const { return load(front_index); }
+  uint8_t get_back() const { return load(back_index); }
+
+  T & at(uint8_t index) { return items[index & (SIZE - 1)]; }
+
+  /* Producer: the free slot to fill (if not full), then push() to hand it over. */
+  T & back() { return at(load(back_index)); }
+
+  void push() { store(back_index, load(back_index) + 1); }
+
+  /* Consumer: the oldest item (if not empty), then pop() once done with it. */
+  T & front() { return at(load(front_index)); }
+
+  void pop() { store(front_index, load(front_index) + 1); }
+};
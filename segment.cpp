@@ -0,0 +1,51 @@
+/* min-vplot: Minimal motion controller for v-plotter. */
+
+#include "segment.h"
+#include "ring.h"
+
+#include <stdint.h>
+
+#define SEGMENT_QUEUE_SIZE 8
+
+static ring<step_segment, SEGMENT_QUEUE_SIZE> segment_queue;
+
+bool get_segments_empty()
+{
+  return segment_queue.empty();
+}
+
+bool get_segments_full()
+{
+  return segment_queue.full();
+}
+
+int get_segment_count()
+{
+  return segment_queue.count();
+}
+
+step_segment & segments_back()
+{
+  return segment_queue.back();
+}
+
+void segments_push()
+{
+  segment_queue.push();
+}
+
+bool segments_pop(step_segment & segment)
+{
+  if (segment_queue.empty())
+    return false;
+
+  segment = segment_queue.front();
+  segment_queue.pop();
+
+  return true;
+}
+
+const step_segment * segments_peek()
+{
+  return segment_queue.empty() ? 0 : &segment_queue.front();
+}
@@ -0,0 +1,39 @@
+/* min-vplot: Minimal motion controller for v-plotter. */
+
+#pragma once
+
+#include <stdint.h>
+
+/* A move at constant motor speeds, prepared by the main loop and executed by the stepper ISR:
+ * the motor with more steps to go steps every period, the other in proportion (see stepper_isr).
+ * Or a pen change: the motors stand still while the servo moves and settles (PEN_SETTLE_MS). */
+struct step_segment
+{
+  long a_dest = 0L;
+  long b_dest = 0L;
+
+  uint32_t period = 0; /* between steps of the faster motor, in 1/256 us */
+
+  bool pen = false;  /* a pen change, to lift */
+  bool lift = false;
+};
+
+/* Segment queue, filled by the main loop and emptied by the stepper ISR (a ring, see ring.h),
+ * so neither side needs to disable interrupts. */
+
+bool get_segments_empty();
+
+bool get_segments_full();
+
+/* Number of segments queued. */
+int get_segment_count();
+
+/* Main loop: the free slot to fill, then segments_push() to hand it to the ISR. */
+step_segment & segments_back();
+void segments_push();
+
+/* ISR: removes the oldest segment into segment; false if there is none. */
+bool segments_pop(step_segment & segment);
+
+/* ISR: the oldest segment, left in the queue; 0 if there is none. */
+const step_segment * segments_peek();
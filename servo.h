@@ -0,0 +1,42 @@
+/* min-vplot: Minimal motion controller for v-plotter. */
+
+#pragma once
+
+#include "Arduino.h"
+
+#define SERVO_FRAME_US 20000 /* from the start of one pulse to the next */
+
+/* Pulse output of the pen lift servo. The stepper ISR sets each edge of the pulse train when it
+ * is due, as it does the steps, and schedules itself for the next one from update(). */
+class servo
+{
+  uint8_t pin;
+  uint16_t pulse_min; /* us at 0 degrees */
+  uint16_t pulse_max; /* us at 180 degrees */
+
+  volatile uint8_t degrees = 0; /* one byte, so the ISR never reads half of a change */
+  bool high = false;
+
+public:
+  servo(uint8_t pin, uint16_t pulse_min, uint16_t pulse_max) :
+    pin(pin), pulse_min(pulse_min), pulse_max(pulse_max) {}
+
+  void enable()
+  {
+    pinMode(pin, OUTPUT);
+  }
+
+  void move_to_degrees(uint8_t value) { degrees = value; }
+  uint8_t get_degrees() const { return degrees; }
+
+  /* Sets the next edge of the pulse train; returns the microseconds to the edge after it. */
+  uint16_t update()
+  {
+    const uint16_t pulse_us = pulse_min + (uint32_t)(pulse_max - pulse_min) * degrees / 180;
+
+    high = !high;
+    digitalWrite(pin, high ? HIGH : LOW);
+
+    return high ? pulse_us : SERVO_FRAME_US - pulse_us;
+  }
+};
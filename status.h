@@ -0,0 +1,180 @@
+/* min-vplot: Minimal motion controller for v-plotter. */
+
+#pragma once
+
+#include <stdint.h>
+
+/* Real-time status report, shared by the firmware, the sender and the host tools like frame.h.
+ *
+ * The byte STATUS_QUERY is taken out of the serial input as the main loop receives it, anywhere
+ * in a text line or between binary frames, rather than waiting behind the lines or frames
+ * buffered before it, and answered with one line:
+ *
+ *   <a,b,a_dest,b_dest,a_rate,b_rate,blocks,segments,pen,idle,late>
+ *
+ * - a, b: the motor positions in steps,
+ * - a_dest, b_dest: the destination of the segment the stepper ISR is executing,
+ * - a_rate, b_rate: the motors' step rates in steps/s, negative winding string in, 0 at rest,
+ * - blocks, segments: the blocks buffered and step segments queued,
+ * - pen: 'U' lifted, 'D' down, 'S' standing still for the servo to settle,
+ * - idle: milliseconds the stepper ISR has had nothing to execute, since start up,
+ * - late: steps the ISR took after their time since start up, due closer to the event before
+ *   them than MIN_STEP_PERIOD_US.
+ *
+ * idle and late wrap at 2^16, so take differences between reports, at least one a minute.
+ *
+ * The numbers are hexadecimal, with a '-' before negative ones, so the AVR formats them with
+ * shifts rather than divisions. With positions under 2^20 steps (13 m of string) a report takes
+ * at most 54 bytes besides its "\r\n", within the 63 the AVR's serial TX buffer holds. The
+ * firmware writes it once the TX buffer has room for it, so the main loop does not wait for it;
+ * no "ok" follows, and the sender does not count the query against the RX buffer, as it never
+ * stays there. */
+
+#define STATUS_QUERY '?'
+
+#define STATUS_MAX_BYTES 80 /* a report line at its longest, with the terminating zero */
+
+struct status_report
+{
+  long a = 0L;
+  long b = 0L;
+  long a_dest = 0L;
+  long b_dest = 0L;
+  long a_rate = 0L;
+  long b_rate = 0L;
+
+  uint8_t blocks = 0;
+  uint8_t segments = 0;
+  char pen = 'U';
+
+  uint16_t idle_ms = 0;
+  uint16_t late_steps = 0;
+
+private:
+  static char * put(char * out, uint32_t value, char separator)
+  {
+    uint8_t digits = 1;
+
+    while (digits < 8 && (value >> (4 * digits)) != 0)
+      digits++;
+
+    for (int8_t n = digits - 1; n >= 0; n--)
+      *out++ = "0123456789abcdef"[(value >> (4 * n)) & 0xF];
+
+    *out++ = separator;
+    return out;
+  }
+
+  static char * put_signed(char * out, long value, char separator)
+  {
+    if (value < 0)
+    {
+      *out++ = '-';
+      return put(out, (uint32_t)-value, separator);
+    }
+
+    return put(out, (uint32_t)value, separator);
+  }
+
+  static bool get(const char *& in, const char * end, uint32_t & value, char separator)
+  {
+    value = 0;
+
+    const char * const start = in;
+
+    for (; in < end && *in != separator; in++)
+    {
+      const char c = *in;
+      const uint8_t digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : 16;
+
+      if (digit == 16 || in - start == 8)
+        return false;
+
+      value = (value << 4) | digit;
+    }
+
+    if (in == start || in == end)
+      return false;
+
+    in++; /* the separator */
+    return true;
+  }
+
+  static bool get_signed(const char *& in, const char * end, long & value, char separator)
+  {
+    const bool negative = in < end && *in == '-';
+    uint32_t magnitude;
+
+    if (negative)
+      in++;
+
+    if (!get(in, end, magnitude, separator))
+      return false;
+
+    value = negative ? -(long)magnitude : (long)magnitude;
+    return true;
+  }
+
+public:
+  /* Writes the report line, without "\r\n" but with a terminating zero, to buf of
+   * STATUS_MAX_BYTES; returns its length. */
+  uint8_t format(char * buf) const
+  {
+    char * out = buf;
+
+    *out++ = '<';
+    out = put_signed(out, a, ',');
+    out = put_signed(out, b, ',');
+    out = put_signed(out, a_dest, ',');
+    out = put_signed(out, b_dest, ',');
+    out = put_signed(out, a_rate, ',');
+    out = put_signed(out, b_rate, ',');
+    out = put(out, blocks, ',');
+    out = put(out, segments, ',');
+    *out++ = pen;
+    *out++ = ',';
+    out = put(out, idle_ms, ',');
+    out = put(out, late_steps, '>');
+    *out = 0;
+
+    return (uint8_t)(out - buf);
+  }
+
+  /* Reads a report line, without its "\r\n"; false if it is not one. */
+  bool parse(const char * line, uint16_t length)
+  {
+    const char * in = line;
+    const char * const end = line + length;
+    uint32_t count;
+
+    if (length < 2 || *in++ != '<' || end[-1] != '>')
+      return false;
+
+    if (!get_signed(in, end, a, ',') || !get_signed(in, end, b, ',') || !get_signed(in, end, a_dest, ',') ||
+        !get_signed(in, end, b_dest, ',') || !get_signed(in, end, a_rate, ',') || !get_signed(in, end, b_rate, ','))
+      return false;
+
+    if (!get(in, end, count, ','))
+      return false;
+    blocks = (uint8_t)count;
+
+    if (!get(in, end, count, ','))
+      return false;
+    segments = (uint8_t)count;
+
+    if (end - in < 2 || in[1] != ',')
+      return false;
+    pen = *in;
+    in += 2;
+
+    if (!get(in, end, count, ',') || count > 0xFFFF)
+      return false;
+    idle_ms = (uint16_t)count;
+
+    if (!get(in, end, count, '>') || count > 0xFFFF || in != end)
+      return false;
+    late_steps = (uint16_t)count;
+
+    return true;
+  }
+};
@@ -0,0 +1,46 @@
+/* min-vplot: Minimal motion controller for v-plotter. */
+
+#pragma once
+
+#include "Arduino.h"
+
+/* Step and direction outputs of one motor driver, and its position in steps. Only the stepper ISR
+ * steps the motor; it decides when, so both motors of a segment can be stepped from one timer. */
+class stepper
+{
+  uint8_t step_pin;
+  uint8_t dir_pin;
+
+  bool reverse; /* the driver turns the other way round: invert the direction pin */
+  int8_t dir = 1;
+
+  volatile long position = 0L;
+
+public:
+  stepper(bool reverse, uint8_t step_pin, uint8_t dir_pin) :
+    step_pin(step_pin), dir_pin(dir_pin), reverse(reverse) {}
+
+  void enable()
+  {
+    pinMode(step_pin, OUTPUT);
+    pinMode(dir_pin, OUTPUT);
+  }
+
+  void set_position(long steps) { position = steps; }
+  long get_position() const { return position; }
+  int8_t get_direction() const { return dir; }
+
+  /* Direction of the following steps: +1 lets string out, -1 winds it in. */
+  void set_direction(int8_t direction)
+  {
+    dir = direction;
+    digitalWrite(dir_pin, (direction > 0) != reverse ? HIGH : LOW);
+  }
+
+  void step()
+  {
+    digitalWrite(step_pin, HIGH);
+    position += dir;
+    digitalWrite(step_pin, LOW);
+  }
+};